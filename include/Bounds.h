@@ -0,0 +1,53 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <cfloat>
+
+#include <glm/glm.hpp>
+#include <glm/ext.hpp>
+
+#include "Primitive.h"
+#include "PrimitiveStore.h"
+
+// Axis aligned bounding box, empty by default.
+// Axes a primitive doesn't bound ( planes ) use +/-FLT_MAX
+struct Bounds
+{
+    glm::vec3 Min = glm::vec3( FLT_MAX );
+    glm::vec3 Max = glm::vec3( -FLT_MAX );
+
+    Bounds() {}
+    Bounds( const glm::vec3& min, const glm::vec3& max ) : Min( min ), Max( max ) {}
+
+    void Extend( const glm::vec3& p ) { Min = glm::min( Min, p ); Max = glm::max( Max, p ); }
+    void Extend( const Bounds& b ) { Min = glm::min( Min, b.Min ); Max = glm::max( Max, b.Max ); }
+
+    bool Empty() const { return Min.x > Max.x || Min.y > Max.y || Min.z > Max.z; }
+    bool Bounded() const { return Min.x > -FLT_MAX && Min.y > -FLT_MAX && Min.z > -FLT_MAX && Max.x < FLT_MAX && Max.y < FLT_MAX && Max.z < FLT_MAX; }
+
+    glm::vec3 Extent() const { return Max - Min; }
+    glm::vec3 Center() const { return ( Min + Max ) * 0.5f; }
+    float SurfaceArea() const;
+    int LongestAxis() const;
+
+    Bounds Intersection( const Bounds& b ) const { return Bounds( glm::max( Min, b.Min ), glm::min( Max, b.Max ) ); }
+};
+
+// Whether primitives of a type have finite bounds, planes don't and are traced apart from the acceleration structures
+extern bool IsBounded( Primitive::ObjectType type );
+
+// World space bounds of a primitive's actual shape under its orientation and scale
+extern Bounds ComputePrimitiveBounds( Primitive::ObjectType type, const glm::vec3& position, const glm::quat& orientation, const glm::vec3& scale );
+extern Bounds ComputePrimitiveBounds( const PrimitiveStore& primitives, PrimitiveHandle handle );
+
+// Whether the surface of a bounded primitive, all a ray can hit, passes through a box.
+// Exact under any orientation and scale, so boxes wholly inside a sphere or box primitive, or beside
+// a tilted disc or polygon, are rejected. sides is the polygon's side count, unused by other types
+extern bool PrimitiveOverlapsBox( Primitive::ObjectType type, const glm::vec3& position, const glm::quat& orientation, const glm::vec3& scale, float sides, const Bounds& box );
+extern bool PrimitiveOverlapsBox( const PrimitiveStore& primitives, PrimitiveHandle handle, const Bounds& box );
+
+// Bounds of every bounded primitive in the store, unbounded ones are left to an UnboundedList.
+// Axes nothing bounds ( e.g. a scene of planes ) default to [ -1, 1 ]
+extern Bounds ComputeSceneBounds( const PrimitiveStore& primitives );
+
+#endif // BOUNDS_H
@@ -0,0 +1,14 @@
+#ifndef CPUREFERENCE_H
+#define CPUREFERENCE_H
+
+#include <string>
+
+// Renders the test scene on the CPU without opening a window or creating a GL context
+namespace CPUReference
+{
+    // Builds the named structure ( grid, bvh, two-level-grid, hashed-grid or octree ) over the test scene,
+    // renders one frame from the camera's starting view and saves it to path as a PPM
+    bool Render( const std::string& structure, const std::string& path, int width, int height );
+}
+
+#endif // CPUREFERENCE_H
@@ -0,0 +1,115 @@
+#ifndef CPUTRACER_H
+#define CPUTRACER_H
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Ray.h"
+#include "Primitive.h"
+#include "PrimitiveStore.h"
+#include "TileScheduler.h"
+#include "accell/Grid.h"
+#include "accell/BVH.h"
+#include "accell/WideBVH.h"
+#include "accell/TwoLevelGrid.h"
+#include "accell/HashedGrid.h"
+#include "accell/Octree.h"
+
+// Per-frame view parameters, matching the uniforms consumed by Raytracer.frag
+struct CPUTracerView
+{
+    glm::vec3 CameraPos = glm::vec3( 0.0f );
+    glm::mat4 CameraRot = glm::mat4( 1.0f );
+    float FOV = glm::radians( 90.0f );
+
+    float AmbientIntensity = 0.2f;
+    glm::vec4 SkyLightColor = glm::vec4( 1.0f );
+    glm::vec3 SkyLightDirection = glm::vec3( 0.0f, 1.0f, 0.0f );
+
+    // Mirrors the CPU-exposed shader constants
+    bool LowAccuracyMode = false;
+    bool DisableShadows = false;
+    bool DisableLighting = false;
+    bool DrawDepthBuffer = false;
+};
+
+struct CPUTracerStats
+{
+    int Threads = 0;
+    long long Rays = 0;
+    float Seconds = 0.0f;
+    float RaysPerSecond = 0.0f;
+    float Efficiency = 0.0f; // Busy time over threads * wall time
+};
+
+// Renders a scene on the CPU using the same algorithm as Raytracer.frag,
+// with the structures' batched ray queries finding hits, Collisions as the intersection kernels
+// and screen tiles balanced across all cores by a TileScheduler
+class CPUTracer
+{
+public:
+    // Tiles run on scheduler, which must outlive the tracer
+    CPUTracer( int width, int height, TileScheduler& scheduler );
+
+    void Resize( int width, int height );
+    // store must have current transforms ( PrimitiveStore::UpdateTransforms )
+    void Render( const std::vector< Primitive* >& primitives, const PrimitiveStore& store, const Grid* grid, const CPUTracerView& view );
+    void Render( const std::vector< Primitive* >& primitives, const PrimitiveStore& store, const WideBVH< WIDE_BVH_WIDTH >* bvh, const CPUTracerView& view );
+    void Render( const std::vector< Primitive* >& primitives, const PrimitiveStore& store, const TwoLevelGrid* twoLevelGrid, const CPUTracerView& view );
+    void Render( const std::vector< Primitive* >& primitives, const PrimitiveStore& store, const HashedGrid* hashedGrid, const CPUTracerView& view );
+    void Render( const std::vector< Primitive* >& primitives, const PrimitiveStore& store, const Octree* octree, const CPUTracerView& view );
+    bool SaveImage( const std::string& path ) const;
+
+    int GetWidth() const { return m_width; }
+    int GetHeight() const { return m_height; }
+    const std::vector< glm::vec4 >& GetColorBuffer() const { return m_colorBuffer; }
+    const std::vector< float >& GetDepthBuffer() const { return m_depthBuffer; }
+    const CPUTracerStats& GetStats() const { return m_stats; }
+    const TileScheduler& GetScheduler() const { return m_scheduler; }
+
+private:
+    struct RayData
+    {
+        int HitID = -1; // -1 = No hit, >= 0 = Hit Object ID
+        ObjectMaterial HitMaterial;
+        glm::vec3 Origin = glm::vec3( 0.0f );
+        glm::vec3 Position = glm::vec3( 0.0f );
+        glm::vec3 Normal = glm::vec3( 0.0f );
+        float Backface = 0.0f;
+        glm::vec3 PortalPosition = glm::vec3( 0.0f );
+    };
+
+    void renderFrame( const std::vector< Primitive* >& primitives, const PrimitiveStore& store, const CPUTracerView& view );
+    void renderTile( int tile, long long& rayCount );
+    glm::vec4 renderPixel( int x, int y, float& depth, long long& rayCount ) const;
+
+    void castRay( Ray ray, int iterations, RayData& rayData, long long& rayCount ) const;
+    bool intersectRay( const Ray& ray, RayHit& hit ) const;
+    bool loadHit( const Ray& ray, const RayHit& hit, RayData& rayData ) const;
+    void checkWarp( Ray& ray ) const;
+    bool checkRecast( Ray& ray, RayData& rayData ) const;
+    void primitiveIntersection( const Primitive* primitive, const IsectData& isectData, RayData& rayData ) const;
+
+    int m_width;
+    int m_height;
+    TileScheduler& m_scheduler;
+    std::vector< float > m_tileCosts; // Last frame's per-tile costs, seeding this frame's deques
+
+    std::vector< glm::vec4 > m_colorBuffer;
+    std::vector< float > m_depthBuffer;
+    CPUTracerStats m_stats;
+
+    // Frame state, read-only while tiles are being rendered
+    const std::vector< Primitive* >* m_primitives = 0;
+    ArrayView< PrimitiveTransform > m_transforms;
+    const Grid* m_grid = 0;
+    const WideBVH< WIDE_BVH_WIDTH >* m_bvh = 0;
+    const TwoLevelGrid* m_twoLevelGrid = 0;
+    const HashedGrid* m_hashedGrid = 0;
+    const Octree* m_octree = 0;
+    CPUTracerView m_view;
+};
+
+#endif // CPUTRACER_H
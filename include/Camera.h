@@ -3,25 +3,30 @@
 
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
+#include <functional>
 #include <vector>
 
 #include "Ray.h"
 #include "Primitive.h"
+#include "PrimitiveStore.h"
+
+// Closest hit query over the scene's primitives, normally the active acceleration structure's IntersectRays
+typedef std::function< int( const Ray* rays, int rayCount, RayHit* hits ) > SceneRayQuery;
 
 class Camera
 {
 public:
     Camera();
 
-    void Update( const std::vector<Primitive*>& primitives );
+    void Update( const std::vector<Primitive*>& primitives, const PrimitiveStore& store, const SceneRayQuery& intersectRays );
 
     glm::vec3 GetPosition() const { return m_position; };
     glm::mat4 GetRotation() const { return m_cameraRotX * m_cameraRotY; }
     glm::vec3 GetWarpFactor() const { return m_warpFactor; }
 
 private:
-    void portalTransport( const Primitive* portal, const IsectData& isectData );
-    void updateWarpFactor( const std::vector<Primitive*>& primitives );
+    void portalTransport( const Primitive* portal, const Ray& ray, const RayHit& hit );
+    void updateWarpFactor( const PrimitiveStore& store );
 
     glm::vec3 m_position = glm::vec3( 10.0f, 0, 15.0f );
     glm::vec3 m_prevPosition = m_position;
@@ -1,11 +1,13 @@
 #ifndef COLLISIONS_H
 #define COLLISIONS_H
 
+#include <vector>
 #include <glm/glm.hpp>
 using namespace glm;
 
 #include "Ray.h"
 #include "Primitive.h"
+#include "PrimitiveStore.h"
 
 static Ray localRay( const Ray& ray, const vec3& position, const quat& orientation, const vec3& scale )
 {
@@ -29,13 +31,30 @@ static IsectData worldIsectData( const IsectData& isectData, const vec3& positio
     wIsectData.Position = orientation * wIsectData.Position;
     wIsectData.Position += position;
 
-    wIsectData.Normal *= scale;
+    wIsectData.Normal /= scale;
     wIsectData.Normal = orientation * wIsectData.Normal;
     wIsectData.Normal = normalize( wIsectData.Normal );
 
     return wIsectData;
 }
 
+// Same as above, using a primitive's cached matrices
+static Ray localRay( const Ray& ray, const PrimitiveTransform& transform )
+{
+    return Ray( vec3( transform.InverseWorld * vec4( ray.Origin, 1.0f ) ),
+                vec3( transform.InverseWorld * vec4( ray.Direction, 0.0f ) ) );
+}
+
+static IsectData worldIsectData( const IsectData& isectData, const PrimitiveTransform& transform )
+{
+    IsectData wIsectData = isectData;
+
+    wIsectData.Position = vec3( transform.World * vec4( isectData.Position, 1.0f ) );
+    wIsectData.Normal = normalize( vec3( transform.Normal * vec4( isectData.Normal, 0.0f ) ) );
+
+    return wIsectData;
+}
+
 namespace Collisions
 {
     extern float NEAR_PLANE;
@@ -87,11 +106,64 @@ namespace Collisions
         IsectData& isectData
     );
 
+    extern bool IsectAABBPrimitive(
+        const Ray& ray,
+        const Primitive* object,
+        IsectData& isectData
+        );
+
     extern bool IsectConvexPolyPrimitive(
         const Ray& ray,
         const Primitive* object,
         IsectData& isectData
         );
+
+    // Dispatches to the intersection function matching object->Type
+    extern bool IsectPrimitive(
+        const Ray& ray,
+        const Primitive* object,
+        IsectData& isectData
+        );
+
+    extern bool IsectPrimitive(
+        const Ray& ray,
+        const Primitive* object,
+        const PrimitiveTransform& transform,
+        IsectData& isectData
+        );
+
+    // Batched Ray Queries
+    // ClosestHit finds the nearest hit and its normal, AnyHit stops each ray at its first hit
+    enum RayQueryMode { ClosestHit, AnyHit };
+
+    // Clears hits to "no hit" with maxDistance as the ray limit
+    extern void InitRayHits( RayHit* hits, int count, float maxDistance = FAR_PLANE );
+
+    // Intersects rays against primitives, tightening hits in place so that several
+    // queries can be chained ( hits must be initialised with InitRayHits ).
+    // transforms are the primitives' cached transforms, which must be current ( PrimitiveStore::UpdateTransforms ).
+    // Rays with an any-hit result already recorded are skipped.
+    // Returns the number of rays that hit something in this query
+    extern int IntersectRays(
+        const Ray* rays,
+        int rayCount,
+        const std::vector< Primitive* >& primitives,
+        ArrayView< PrimitiveTransform > transforms,
+        RayHit* hits,
+        RayQueryMode mode = ClosestHit
+        );
+
+    // As above, testing only primitives[ indices[ 0 .. indexCount ) ]
+    extern int IntersectRays(
+        const Ray* rays,
+        int rayCount,
+        const std::vector< Primitive* >& primitives,
+        ArrayView< PrimitiveTransform > transforms,
+        const int* indices,
+        int indexCount,
+        RayHit* hits,
+        RayQueryMode mode = ClosestHit
+        );
 }
 
 #endif // COLLISIONS_H
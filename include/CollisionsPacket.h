@@ -0,0 +1,288 @@
+#ifndef COLLISIONSPACKET_H
+#define COLLISIONSPACKET_H
+
+#include <glm/glm.hpp>
+#include <glm/ext.hpp>
+
+#include "Simd.h"
+#include "Ray.h"
+#include "Primitive.h"
+#include "Collisions.h"
+
+// W rays in structure-of-arrays form, one ray per lane
+template< int W >
+struct RayPacket
+{
+    SimdFloat< W > OriginX, OriginY, OriginZ;
+    SimdFloat< W > DirectionX, DirectionY, DirectionZ;
+    SimdFloat< W > Distance; // Hits at or beyond this t are rejected
+
+    RayPacket() {}
+
+    // Gathers count ( <= W ) rays, padding unused lanes with a copy of the first ray
+    RayPacket( const Ray* rays, int count, float distance = Collisions::FAR_PLANE )
+    {
+        float ox[ W ], oy[ W ], oz[ W ], dx[ W ], dy[ W ], dz[ W ];
+        for( int i = 0; i < W; ++i )
+        {
+            const Ray& ray = rays[ i < count ? i : 0 ];
+            ox[ i ] = ray.Origin.x; oy[ i ] = ray.Origin.y; oz[ i ] = ray.Origin.z;
+            dx[ i ] = ray.Direction.x; dy[ i ] = ray.Direction.y; dz[ i ] = ray.Direction.z;
+        }
+
+        OriginX = SimdFloat< W >::Load( ox ); OriginY = SimdFloat< W >::Load( oy ); OriginZ = SimdFloat< W >::Load( oz );
+        DirectionX = SimdFloat< W >::Load( dx ); DirectionY = SimdFloat< W >::Load( dy ); DirectionZ = SimdFloat< W >::Load( dz );
+        Distance = SimdFloat< W >( distance );
+    }
+};
+
+namespace Collisions
+{
+    /*
+     * Packet helpers
+     */
+    // Transforms a packet into local primitive space with the primitive's cached inverse world matrix,
+    // whose entries are broadcast once and shared by every lane
+    template< int W >
+    RayPacket< W > localRay( const RayPacket< W >& rays, const PrimitiveTransform& transform )
+    {
+        const mat4& m = transform.InverseWorld;
+
+        const SimdFloat< W >& ox = rays.OriginX;
+        const SimdFloat< W >& oy = rays.OriginY;
+        const SimdFloat< W >& oz = rays.OriginZ;
+
+        RayPacket< W > lRays;
+        lRays.OriginX = ox * SimdFloat< W >( m[ 0 ][ 0 ] ) + oy * SimdFloat< W >( m[ 1 ][ 0 ] ) + oz * SimdFloat< W >( m[ 2 ][ 0 ] ) + SimdFloat< W >( m[ 3 ][ 0 ] );
+        lRays.OriginY = ox * SimdFloat< W >( m[ 0 ][ 1 ] ) + oy * SimdFloat< W >( m[ 1 ][ 1 ] ) + oz * SimdFloat< W >( m[ 2 ][ 1 ] ) + SimdFloat< W >( m[ 3 ][ 1 ] );
+        lRays.OriginZ = ox * SimdFloat< W >( m[ 0 ][ 2 ] ) + oy * SimdFloat< W >( m[ 1 ][ 2 ] ) + oz * SimdFloat< W >( m[ 2 ][ 2 ] ) + SimdFloat< W >( m[ 3 ][ 2 ] );
+
+        const SimdFloat< W >& dx = rays.DirectionX;
+        const SimdFloat< W >& dy = rays.DirectionY;
+        const SimdFloat< W >& dz = rays.DirectionZ;
+        lRays.DirectionX = dx * SimdFloat< W >( m[ 0 ][ 0 ] ) + dy * SimdFloat< W >( m[ 1 ][ 0 ] ) + dz * SimdFloat< W >( m[ 2 ][ 0 ] );
+        lRays.DirectionY = dx * SimdFloat< W >( m[ 0 ][ 1 ] ) + dy * SimdFloat< W >( m[ 1 ][ 1 ] ) + dz * SimdFloat< W >( m[ 2 ][ 1 ] );
+        lRays.DirectionZ = dx * SimdFloat< W >( m[ 0 ][ 2 ] ) + dy * SimdFloat< W >( m[ 1 ][ 2 ] ) + dz * SimdFloat< W >( m[ 2 ][ 2 ] );
+
+        lRays.Distance = rays.Distance;
+
+        return lRays;
+    }
+
+    // Shared plane test for the flat local-space primitives ( plane normal PLANE_NORMAL through the origin )
+    template< int W >
+    SimdMask< W > isectLocalPlane( const RayPacket< W >& lr, SimdFloat< W >& t )
+    {
+        const SimdFloat< W > zero( 0.0f );
+
+        SimdFloat< W > ndr = lr.DirectionY;
+        t = -lr.OriginY / ndr;
+
+        SimdMask< W > hit = ndr != zero; // ndr == 0.0
+        hit = hit & ( t >= SimdFloat< W >( NEAR_PLANE ) ); // t >= NEAR_PLANE
+        hit = hit & ( t < lr.Distance ); // t < Distance
+
+        return hit;
+    }
+
+    /*
+     * Ray Intersection (Generic)
+     * Each returns the mask of lanes that hit and writes their t to t
+     */
+    template< int W >
+    SimdMask< W > IsectPlane(
+        const RayPacket< W >& rays,
+        const vec3& planePosition,
+        const vec3& planeNormal,
+        SimdFloat< W >& t
+        )
+    {
+        SimdFloat< W > nx( planeNormal.x ), ny( planeNormal.y ), nz( planeNormal.z );
+
+        SimdFloat< W > ndr = nx * rays.DirectionX + ny * rays.DirectionY + nz * rays.DirectionZ;
+        SimdFloat< W > ndo = nx * rays.OriginX + ny * rays.OriginY + nz * rays.OriginZ;
+        SimdFloat< W > D( dot( planeNormal, planePosition ) );
+
+        t = -( ndo - D ) / ndr;
+
+        return ndr != SimdFloat< W >( 0.0f ); // ndr == 0.0
+    }
+
+    template< int W >
+    SimdMask< W > IsectAABB(
+        const RayPacket< W >& rays,
+        const vec3& p0,
+        const vec3& p1,
+        SimdFloat< W >& t
+        )
+    {
+        const SimdFloat< W > one( 1.0f );
+        SimdFloat< W > idx = one / rays.DirectionX;
+        SimdFloat< W > idy = one / rays.DirectionY;
+        SimdFloat< W > idz = one / rays.DirectionZ;
+
+        // Backface if the origin lies strictly inside the box
+        SimdMask< W > backface =
+            ( rays.OriginX > SimdFloat< W >( p0.x ) ) & ( rays.OriginX < SimdFloat< W >( p1.x ) ) &
+            ( rays.OriginY > SimdFloat< W >( p0.y ) ) & ( rays.OriginY < SimdFloat< W >( p1.y ) ) &
+            ( rays.OriginZ > SimdFloat< W >( p0.z ) ) & ( rays.OriginZ < SimdFloat< W >( p1.z ) );
+
+        // Calculate intersection using the slab method ( clip ray against box per-axis )
+        SimdFloat< W > t0x = ( SimdFloat< W >( p0.x ) - rays.OriginX ) * idx;
+        SimdFloat< W > t1x = ( SimdFloat< W >( p1.x ) - rays.OriginX ) * idx;
+        SimdFloat< W > t0y = ( SimdFloat< W >( p0.y ) - rays.OriginY ) * idy;
+        SimdFloat< W > t1y = ( SimdFloat< W >( p1.y ) - rays.OriginY ) * idy;
+        SimdFloat< W > t0z = ( SimdFloat< W >( p0.z ) - rays.OriginZ ) * idz;
+        SimdFloat< W > t1z = ( SimdFloat< W >( p1.z ) - rays.OriginZ ) * idz;
+
+        SimdFloat< W > tmin = min( t0x, t1x );
+        SimdFloat< W > tmax = max( t0x, t1x );
+        tmin = max( tmin, min( t0y, t1y ) );
+        tmax = min( tmax, max( t0y, t1y ) );
+        tmin = max( tmin, min( t0z, t1z ) );
+        tmax = min( tmax, max( t0z, t1z ) );
+
+        // Check hit against ray limits
+        t = select( backface, tmax, tmin );
+
+        SimdMask< W > hit = tmin <= tmax;
+        hit = hit & ( t >= SimdFloat< W >( NEAR_PLANE ) );
+
+        return hit;
+    }
+
+    /*
+     * Ray Intersection (Object)
+     * t is returned in the parameter space of the input rays, as with the scalar versions.
+     * transform is the primitive's cached transform ( PrimitiveStore::GetTransforms )
+     */
+    template< int W >
+    SimdMask< W > IsectPlanePrimitive(
+        const RayPacket< W >& rays,
+        const Primitive* object,
+        const PrimitiveTransform& transform,
+        SimdFloat< W >& t
+        )
+    {
+        RayPacket< W > lr = localRay( rays, transform );
+
+        return isectLocalPlane( lr, t );
+    }
+
+    template< int W >
+    SimdMask< W > IsectSpherePrimitive(
+        const RayPacket< W >& rays,
+        const Primitive* object,
+        const PrimitiveTransform& transform,
+        SimdFloat< W >& t
+        )
+    {
+        RayPacket< W > lr = localRay( rays, transform );
+
+        const SimdFloat< W > one( 1.0f );
+
+        // The geometric solution needs a unit direction, scale t back into ray space afterwards
+        SimdFloat< W > dirLength = sqrt( lr.DirectionX * lr.DirectionX + lr.DirectionY * lr.DirectionY + lr.DirectionZ * lr.DirectionZ );
+        SimdFloat< W > invDirLength = one / dirLength;
+        SimdFloat< W > dx = lr.DirectionX * invDirLength;
+        SimdFloat< W > dy = lr.DirectionY * invDirLength;
+        SimdFloat< W > dz = lr.DirectionZ * invDirLength;
+
+        SimdFloat< W > ll = lr.OriginX * lr.OriginX + lr.OriginY * lr.OriginY + lr.OriginZ * lr.OriginZ;
+        SimdMask< W > backface = ll <= one;
+
+        SimdFloat< W > tca = -( lr.OriginX * dx + lr.OriginY * dy + lr.OriginZ * dz );
+        SimdFloat< W > ds = ll - tca * tca;
+
+        SimdMask< W > hit = ds <= one;
+
+        SimdFloat< W > thc = sqrt( max( one - ds, SimdFloat< W >( 0.0f ) ) );
+
+        SimdFloat< W > t0 = tca - thc; // Entry t
+        SimdFloat< W > t1 = tca + thc; // Exit t
+
+        t = select( backface, t1, t0 ) * invDirLength;
+
+        hit = hit & ( t >= SimdFloat< W >( NEAR_PLANE ) );
+        hit = hit & ( t < lr.Distance ); // t < Distance
+
+        return hit;
+    }
+
+    template< int W >
+    SimdMask< W > IsectDiscPrimitive(
+        const RayPacket< W >& rays,
+        const Primitive* object,
+        const PrimitiveTransform& transform,
+        SimdFloat< W >& t
+        )
+    {
+        RayPacket< W > lr = localRay( rays, transform );
+
+        // Plane intersection test
+        SimdMask< W > hit = isectLocalPlane( lr, t );
+
+        // Disc intersection test
+        SimdFloat< W > px = lr.OriginX + lr.DirectionX * t;
+        SimdFloat< W > pz = lr.OriginZ + lr.DirectionZ * t;
+        SimdFloat< W > d = px * px + pz * pz;
+        hit = hit & ( d < SimdFloat< W >( 0.5f ) );
+
+        return hit;
+    }
+
+    template< int W >
+    SimdMask< W > IsectAABBPrimitive(
+        const RayPacket< W >& rays,
+        const Primitive* object,
+        const PrimitiveTransform& transform,
+        SimdFloat< W >& t
+        )
+    {
+        RayPacket< W > lr = localRay( rays, transform );
+
+        SimdMask< W > hit = IsectAABB( lr, vec3( -0.5f ), vec3( 0.5f ), t );
+        hit = hit & ( t < lr.Distance ); // t < Distance
+
+        return hit;
+    }
+
+    template< int W >
+    SimdMask< W > IsectConvexPolyPrimitive(
+        const RayPacket< W >& rays,
+        const Primitive* object,
+        const PrimitiveTransform& transform,
+        SimdFloat< W >& t
+        )
+    {
+        RayPacket< W > lr = localRay( rays, transform );
+
+        // Plane intersection test
+        SimdMask< W > hit = isectLocalPlane( lr, t );
+
+        // Poly intersection test
+        SimdFloat< W > px = lr.OriginX + lr.DirectionX * t;
+        SimdFloat< W > pz = lr.OriginZ + lr.DirectionZ * t;
+
+        vec3 bv = vec3( 0.0f, 0.0f, 0.5f );
+        bv = normalize( angleAxis( glm::pi< float >() / object->Sides, vec3( 0.0f, 1.0f, 0.0f ) ) * bv );
+
+        for( int i = 0; i < int( object->Sides ); ++i )
+        {
+            vec3 v0 = bv;
+
+            bv = normalize( angleAxis( ( glm::pi< float >() * 2 ) / object->Sides, vec3( 0.0f, 1.0f, 0.0f ) ) * bv );
+            vec3 v1 = bv;
+
+            vec3 edge = normalize( v1 - v0 );
+
+            // Sign of dot( PLANE_NORMAL, cross( edge, pt - v0 ) ), the normalisations don't change it
+            SimdFloat< W > side = SimdFloat< W >( edge.z ) * ( px - SimdFloat< W >( v0.x ) ) - SimdFloat< W >( edge.x ) * ( pz - SimdFloat< W >( v0.z ) );
+            hit = hit & ( side <= SimdFloat< W >( 0.0f ) );
+        }
+
+        return hit;
+    }
+}
+
+#endif // COLLISIONSPACKET_H
@@ -10,9 +10,17 @@
 
 #include "ShaderProgram.h"
 #include "Primitive.h"
+#include "PrimitiveStore.h"
 #include "Camera.h"
+#include "CPUTracer.h"
 #include "accell/Grid.h"
 #include "accell/kdTree.h"
+#include "accell/BVH.h"
+#include "accell/WideBVH.h"
+#include "accell/CompressedBVH.h"
+#include "accell/TwoLevelGrid.h"
+#include "accell/HashedGrid.h"
+#include "accell/Octree.h"
 
 class GLTracer
 {
@@ -23,12 +31,14 @@ public:
     void Update();
     void Draw();
 
-    void BufferPrimitive( const Primitive* Primitive, const int idx );
+    void BufferPrimitive( const PrimitiveStore& primitives, PrimitiveHandle handle );
 
 private:
     //DEBUG
     void walkKDTree();
 
+    int intersectRays( const Ray* rays, int rayCount, RayHit* hits ) const;
+
     void initGL();
     void terminateGL();
     void setupRenderTexture();
@@ -37,13 +47,38 @@ private:
     void setupUniforms();
 
     void generateObjectInfoTex();
-    void bufferPrimitives( std::vector< Primitive* > primitives );
+    void bufferPrimitives( const PrimitiveStore& primitives );
+    void bufferUpdatedPrimitives( const PrimitiveStore& primitives );
+    void writePrimitivePacket( glm::vec4* p, const PrimitiveStore& primitives, PrimitiveHandle handle );
+
+    void generateUnboundedTex();
+    void bufferUnbounded();
 
     void generateGridTex();
     void bufferGrid();
+    void bufferGridRange( GLuint buffer, const void* values, int first, int last );
+    void setupGridUniforms();
 
     void generateKDTreeTex();
     void bufferKDTree();
+    void setupKDTreeUniforms();
+
+    void generateBVHTex();
+    void bufferBVH();
+    void bufferBVHNodes( int first, int last );
+    void setupBVHUniforms();
+
+    void generateTwoLevelGridTex();
+    void bufferTwoLevelGrid();
+    void setupTwoLevelGridUniforms();
+
+    void generateHashedGridTex();
+    void bufferHashedGrid();
+    void setupHashedGridUniforms();
+
+    void generateOctreeTex();
+    void bufferOctree();
+    void setupOctreeUniforms();
 
     static void callbackResizeWindow( GLFWwindow* window, int width, int height );
     static void callbackCloseWindow( GLFWwindow* window );
@@ -55,7 +90,15 @@ private:
     glm::vec2 m_viewportBounds = glm::vec2(0.0);
     glm::vec2 m_viewportPadding = glm::vec2(0.0);
     kdTree* m_kdTree = 0;
+    BVH* m_bvh = 0;
+    WideBVH< WIDE_BVH_WIDTH >* m_wideBVH = 0; // CPU queries
+    CompressedBVH* m_compressedBVH = 0; // As uploaded
     Grid* m_grid = 0;
+    TwoLevelGrid* m_twoLevelGrid = 0;
+    HashedGrid* m_hashedGrid = 0;
+    Octree* m_octree = 0;
+    CPUTracer* m_cpuTracer = 0;
+    TileScheduler m_scheduler; // Worker threads shared by the structures' builds and the CPU tracer, each keeping its own tile costs
 
     // GPU
     GLFWwindow* m_window = 0;
@@ -76,6 +119,13 @@ private:
     GLuint m_objectRefTex = 0;
     GLuint m_objectRefTBO = 0;
 
+    GLuint m_gridOccupancyTex = 0;
+    GLuint m_gridOccupancyTBO = 0;
+
+    GLuint m_unboundedTex = 0;
+    GLuint m_unboundedTBO = 0;
+    int m_unboundedCount = 0;
+
     ShaderProgram* m_basicVS = 0;
     ShaderProgram* m_basicFS = 0;
     ShaderProgram* m_raytracerFS = 0;
@@ -25,6 +25,14 @@ struct ObjectMaterial
     float PortalAngle = 0.0f;
 };
 
+// Cached matrices for a primitive, maintained by PrimitiveStore::UpdateTransforms
+struct PrimitiveTransform
+{
+    glm::mat4 World = glm::mat4( 1.0f ); // Translate * Rotate * Scale
+    glm::mat4 InverseWorld = glm::mat4( 1.0f );
+    glm::mat4 Normal = glm::mat4( 1.0f ); // inverseTranspose( World )
+};
+
 struct Primitive
 {
     enum ObjectType { None = -1, Plane, Sphere, Disc, AABB, ConvexPoly };
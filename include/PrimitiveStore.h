@@ -0,0 +1,94 @@
+#ifndef PRIMITIVESTORE_H
+#define PRIMITIVESTORE_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/ext.hpp>
+
+#include "Primitive.h"
+
+// Index of a primitive in a PrimitiveStore.
+// Primitives are only ever appended, so a handle stays valid for the store's lifetime
+// and equals both Primitive::ID and the primitive's info packet index on the GPU
+typedef int PrimitiveHandle;
+
+// Read-only window onto contiguous array data
+template< typename T >
+class ArrayView
+{
+public:
+    ArrayView() : m_data( 0 ), m_size( 0 ) {}
+    ArrayView( const T* data, int size ) : m_data( data ), m_size( size ) {}
+    ArrayView( const std::vector< T >& v ) : m_data( v.data() ), m_size( int( v.size() ) ) {}
+
+    const T& operator[]( int i ) const { return m_data[ i ]; }
+    const T* begin() const { return m_data; }
+    const T* end() const { return m_data + m_size; }
+    const T* Data() const { return m_data; }
+    int Size() const { return m_size; }
+    bool Empty() const { return m_size == 0; }
+
+private:
+    const T* m_data;
+    int m_size;
+};
+
+// Structure-of-arrays copy of a scene's primitives.
+// Each attribute lives in its own array so builders and GPU upload can stream
+// the fields they need instead of chasing a Primitive* per object.
+//
+// Add and Set mark a primitive as updated, which both queues its cached transform
+// for UpdateTransforms and lists it in GetUpdated until the next ClearUpdated
+class PrimitiveStore
+{
+public:
+    PrimitiveHandle Add( const Primitive& primitive );
+    void Set( PrimitiveHandle handle, const Primitive& primitive );
+    Primitive Get( PrimitiveHandle handle ) const;
+
+    // Recomputes the cached transforms of every primitive changed since the last call
+    void UpdateTransforms();
+    bool TransformsCurrent() const { return m_staleTransforms.empty(); }
+
+    ArrayView< PrimitiveHandle > GetUpdated() const { return m_updated; }
+    void ClearUpdated();
+
+    int Size() const { return int( m_types.size() ); }
+
+    ArrayView< Primitive::ObjectType > GetTypes() const { return m_types; }
+    ArrayView< glm::vec3 > GetPositions() const { return m_positions; }
+    ArrayView< glm::quat > GetOrientations() const { return m_orientations; }
+    ArrayView< glm::vec3 > GetScales() const { return m_scales; }
+    ArrayView< GLfloat > GetSides() const { return m_sides; }
+    ArrayView< int > GetMaterialIndices() const { return m_materialIndices; }
+    ArrayView< ObjectMaterial > GetMaterials() const { return m_materials; }
+
+    const ObjectMaterial& GetMaterial( PrimitiveHandle handle ) const { return m_materials[ m_materialIndices[ handle ] ]; }
+
+    // Only valid while TransformsCurrent()
+    ArrayView< PrimitiveTransform > GetTransforms() const { return m_transforms; }
+
+private:
+    void markUpdated( PrimitiveHandle handle );
+    void computeTransforms( const PrimitiveHandle* handles, int count );
+
+    std::vector< Primitive::ObjectType > m_types;
+    std::vector< glm::vec3 > m_positions;
+    std::vector< glm::quat > m_orientations;
+    std::vector< glm::vec3 > m_scales;
+    std::vector< GLfloat > m_sides;
+    std::vector< int > m_materialIndices;
+
+    // Materials are edited per primitive ( portal transforms, animated colours ),
+    // so each primitive currently owns one slot
+    std::vector< ObjectMaterial > m_materials;
+
+    std::vector< PrimitiveTransform > m_transforms;
+    std::vector< PrimitiveHandle > m_staleTransforms;
+    std::vector< bool > m_staleFlags; // Set while a handle is in m_staleTransforms
+    std::vector< PrimitiveHandle > m_updated;
+    std::vector< bool > m_updatedFlags; // Set while a handle is in m_updated
+};
+
+#endif // PRIMITIVESTORE_H
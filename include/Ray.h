@@ -27,6 +27,15 @@ struct IsectData
     glm::vec3 PortalOffset;
     glm::vec3 PortalAxis;
     float PortalAngle;
+    float Backface; // 1.0 = Ray originated inside the primitive
+};
+
+// Compact result of a batched ray query ( see Collisions::IntersectRays )
+struct RayHit
+{
+    float Distance; // t along the ray
+    int PrimitiveIndex; // -1 = No hit, >= 0 = Index into the queried primitive list
+    glm::vec3 Normal; // World space, only written for closest hit queries
 };
 
 #endif // RAY_H
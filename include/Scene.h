@@ -2,10 +2,10 @@
 #define SCENE_H
 
 #include <vector>
-#include <map>
 
 #include "GLTracer.h"
 #include "Primitive.h"
+#include "PrimitiveStore.h"
 
 class Scene
 {
@@ -14,8 +14,9 @@ public:
     virtual ~Scene();
 
     virtual void Update();
-    std::vector<Primitive*> GetObjects() const { return m_primitives; }
-    std::vector<Primitive*> GetUpdatedObjects() const { return m_primitives; }
+    void UpdateTransforms() { m_store.UpdateTransforms(); }
+    const std::vector<Primitive*>& GetObjects() const { return m_primitives; }
+    const PrimitiveStore& GetPrimitiveStore() const { return m_store; }
 
 protected:
     void addPrimitive( Primitive* Primitive );
@@ -24,7 +25,7 @@ protected:
 
     GLTracer* m_glTracer;
     std::vector<Primitive*> m_primitives;
-    std::map< int, Primitive* > m_updatedObjects;
+    PrimitiveStore m_store; // Kept in sync by addPrimitive / updatePrimitive
 };
 
 #endif // SCENE_H
@@ -0,0 +1,205 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cmath>
+
+#if defined( __SSE2__ ) || defined( _M_X64 )
+#include <emmintrin.h>
+#define SIMD_SSE
+#endif
+
+#if defined( __AVX__ )
+#include <immintrin.h>
+#define SIMD_AVX
+#endif
+
+// Widest lane count available to this build
+#if defined( SIMD_AVX )
+const int SIMD_WIDTH = 8;
+#elif defined( SIMD_SSE )
+const int SIMD_WIDTH = 4;
+#else
+const int SIMD_WIDTH = 1;
+#endif
+
+/*
+ * Portable fallback, one float per lane.
+ * Also serves as the scalar ( W = 1 ) implementation.
+ */
+template< int W >
+struct SimdMask
+{
+    bool m[ W ];
+
+    SimdMask() {}
+    explicit SimdMask( bool b ) { for( int i = 0; i < W; ++i ) m[ i ] = b; }
+
+    // Bit i is set if lane i is active
+    int Bits() const { int bits = 0; for( int i = 0; i < W; ++i ) bits |= int( m[ i ] ) << i; return bits; }
+    bool Any() const { return Bits() != 0; }
+    bool Lane( int i ) const { return m[ i ]; }
+
+    SimdMask operator&( const SimdMask& o ) const { SimdMask r; for( int i = 0; i < W; ++i ) r.m[ i ] = m[ i ] && o.m[ i ]; return r; }
+    SimdMask operator|( const SimdMask& o ) const { SimdMask r; for( int i = 0; i < W; ++i ) r.m[ i ] = m[ i ] || o.m[ i ]; return r; }
+    SimdMask operator~() const { SimdMask r; for( int i = 0; i < W; ++i ) r.m[ i ] = !m[ i ]; return r; }
+};
+
+template< int W >
+struct SimdFloat
+{
+    float v[ W ];
+
+    SimdFloat() {}
+    SimdFloat( float f ) { for( int i = 0; i < W; ++i ) v[ i ] = f; }
+
+    static SimdFloat Load( const float* p ) { SimdFloat r; for( int i = 0; i < W; ++i ) r.v[ i ] = p[ i ]; return r; }
+    void Store( float* p ) const { for( int i = 0; i < W; ++i ) p[ i ] = v[ i ]; }
+    float Lane( int i ) const { return v[ i ]; }
+
+#define SIMD_FALLBACK_OP( OP ) \
+    SimdFloat operator OP( const SimdFloat& o ) const { SimdFloat r; for( int i = 0; i < W; ++i ) r.v[ i ] = v[ i ] OP o.v[ i ]; return r; }
+    SIMD_FALLBACK_OP( + )
+    SIMD_FALLBACK_OP( - )
+    SIMD_FALLBACK_OP( * )
+    SIMD_FALLBACK_OP( / )
+#undef SIMD_FALLBACK_OP
+
+#define SIMD_FALLBACK_CMP( OP ) \
+    SimdMask< W > operator OP( const SimdFloat& o ) const { SimdMask< W > r; for( int i = 0; i < W; ++i ) r.m[ i ] = v[ i ] OP o.v[ i ]; return r; }
+    SIMD_FALLBACK_CMP( < )
+    SIMD_FALLBACK_CMP( <= )
+    SIMD_FALLBACK_CMP( > )
+    SIMD_FALLBACK_CMP( >= )
+    SIMD_FALLBACK_CMP( == )
+    SIMD_FALLBACK_CMP( != )
+#undef SIMD_FALLBACK_CMP
+
+    SimdFloat operator-() const { SimdFloat r; for( int i = 0; i < W; ++i ) r.v[ i ] = -v[ i ]; return r; }
+};
+
+template< int W > SimdFloat< W > min( const SimdFloat< W >& a, const SimdFloat< W >& b ) { SimdFloat< W > r; for( int i = 0; i < W; ++i ) r.v[ i ] = a.v[ i ] < b.v[ i ] ? a.v[ i ] : b.v[ i ]; return r; }
+template< int W > SimdFloat< W > max( const SimdFloat< W >& a, const SimdFloat< W >& b ) { SimdFloat< W > r; for( int i = 0; i < W; ++i ) r.v[ i ] = a.v[ i ] > b.v[ i ] ? a.v[ i ] : b.v[ i ]; return r; }
+template< int W > SimdFloat< W > sqrt( const SimdFloat< W >& a ) { SimdFloat< W > r; for( int i = 0; i < W; ++i ) r.v[ i ] = std::sqrt( a.v[ i ] ); return r; }
+template< int W > SimdFloat< W > abs( const SimdFloat< W >& a ) { SimdFloat< W > r; for( int i = 0; i < W; ++i ) r.v[ i ] = std::fabs( a.v[ i ] ); return r; }
+// Per lane, a where mask is set, otherwise b
+template< int W > SimdFloat< W > select( const SimdMask< W >& mask, const SimdFloat< W >& a, const SimdFloat< W >& b ) { SimdFloat< W > r; for( int i = 0; i < W; ++i ) r.v[ i ] = mask.m[ i ] ? a.v[ i ] : b.v[ i ]; return r; }
+
+/*
+ * SSE, 4 lanes
+ */
+#ifdef SIMD_SSE
+template<>
+struct SimdMask< 4 >
+{
+    __m128 m;
+
+    SimdMask() {}
+    SimdMask( __m128 mask ) : m( mask ) {}
+    explicit SimdMask( bool b ) : m( _mm_castsi128_ps( _mm_set1_epi32( b ? -1 : 0 ) ) ) {}
+
+    int Bits() const { return _mm_movemask_ps( m ); }
+    bool Any() const { return Bits() != 0; }
+    bool Lane( int i ) const { return ( Bits() >> i ) & 1; }
+
+    SimdMask operator&( const SimdMask& o ) const { return _mm_and_ps( m, o.m ); }
+    SimdMask operator|( const SimdMask& o ) const { return _mm_or_ps( m, o.m ); }
+    SimdMask operator~() const { return _mm_xor_ps( m, _mm_castsi128_ps( _mm_set1_epi32( -1 ) ) ); }
+};
+
+template<>
+struct SimdFloat< 4 >
+{
+    __m128 v;
+
+    SimdFloat() {}
+    SimdFloat( __m128 f ) : v( f ) {}
+    SimdFloat( float f ) : v( _mm_set1_ps( f ) ) {}
+
+    static SimdFloat Load( const float* p ) { return _mm_loadu_ps( p ); }
+    void Store( float* p ) const { _mm_storeu_ps( p, v ); }
+    float Lane( int i ) const { float lanes[ 4 ]; Store( lanes ); return lanes[ i ]; }
+
+    SimdFloat operator+( const SimdFloat& o ) const { return _mm_add_ps( v, o.v ); }
+    SimdFloat operator-( const SimdFloat& o ) const { return _mm_sub_ps( v, o.v ); }
+    SimdFloat operator*( const SimdFloat& o ) const { return _mm_mul_ps( v, o.v ); }
+    SimdFloat operator/( const SimdFloat& o ) const { return _mm_div_ps( v, o.v ); }
+    SimdFloat operator-() const { return _mm_xor_ps( v, _mm_set1_ps( -0.0f ) ); }
+
+    SimdMask< 4 > operator<( const SimdFloat& o ) const { return _mm_cmplt_ps( v, o.v ); }
+    SimdMask< 4 > operator<=( const SimdFloat& o ) const { return _mm_cmple_ps( v, o.v ); }
+    SimdMask< 4 > operator>( const SimdFloat& o ) const { return _mm_cmpgt_ps( v, o.v ); }
+    SimdMask< 4 > operator>=( const SimdFloat& o ) const { return _mm_cmpge_ps( v, o.v ); }
+    SimdMask< 4 > operator==( const SimdFloat& o ) const { return _mm_cmpeq_ps( v, o.v ); }
+    SimdMask< 4 > operator!=( const SimdFloat& o ) const { return _mm_cmpneq_ps( v, o.v ); }
+};
+
+inline SimdFloat< 4 > min( const SimdFloat< 4 >& a, const SimdFloat< 4 >& b ) { return _mm_min_ps( a.v, b.v ); }
+inline SimdFloat< 4 > max( const SimdFloat< 4 >& a, const SimdFloat< 4 >& b ) { return _mm_max_ps( a.v, b.v ); }
+inline SimdFloat< 4 > sqrt( const SimdFloat< 4 >& a ) { return _mm_sqrt_ps( a.v ); }
+inline SimdFloat< 4 > abs( const SimdFloat< 4 >& a ) { return _mm_andnot_ps( _mm_set1_ps( -0.0f ), a.v ); }
+inline SimdFloat< 4 > select( const SimdMask< 4 >& mask, const SimdFloat< 4 >& a, const SimdFloat< 4 >& b )
+{
+    return _mm_or_ps( _mm_and_ps( mask.m, a.v ), _mm_andnot_ps( mask.m, b.v ) );
+}
+#endif // SIMD_SSE
+
+/*
+ * AVX, 8 lanes
+ */
+#ifdef SIMD_AVX
+template<>
+struct SimdMask< 8 >
+{
+    __m256 m;
+
+    SimdMask() {}
+    SimdMask( __m256 mask ) : m( mask ) {}
+    explicit SimdMask( bool b ) : m( _mm256_castsi256_ps( _mm256_set1_epi32( b ? -1 : 0 ) ) ) {}
+
+    int Bits() const { return _mm256_movemask_ps( m ); }
+    bool Any() const { return Bits() != 0; }
+    bool Lane( int i ) const { return ( Bits() >> i ) & 1; }
+
+    SimdMask operator&( const SimdMask& o ) const { return _mm256_and_ps( m, o.m ); }
+    SimdMask operator|( const SimdMask& o ) const { return _mm256_or_ps( m, o.m ); }
+    SimdMask operator~() const { return _mm256_xor_ps( m, _mm256_castsi256_ps( _mm256_set1_epi32( -1 ) ) ); }
+};
+
+template<>
+struct SimdFloat< 8 >
+{
+    __m256 v;
+
+    SimdFloat() {}
+    SimdFloat( __m256 f ) : v( f ) {}
+    SimdFloat( float f ) : v( _mm256_set1_ps( f ) ) {}
+
+    static SimdFloat Load( const float* p ) { return _mm256_loadu_ps( p ); }
+    void Store( float* p ) const { _mm256_storeu_ps( p, v ); }
+    float Lane( int i ) const { float lanes[ 8 ]; Store( lanes ); return lanes[ i ]; }
+
+    SimdFloat operator+( const SimdFloat& o ) const { return _mm256_add_ps( v, o.v ); }
+    SimdFloat operator-( const SimdFloat& o ) const { return _mm256_sub_ps( v, o.v ); }
+    SimdFloat operator*( const SimdFloat& o ) const { return _mm256_mul_ps( v, o.v ); }
+    SimdFloat operator/( const SimdFloat& o ) const { return _mm256_div_ps( v, o.v ); }
+    SimdFloat operator-() const { return _mm256_xor_ps( v, _mm256_set1_ps( -0.0f ) ); }
+
+    SimdMask< 8 > operator<( const SimdFloat& o ) const { return _mm256_cmp_ps( v, o.v, _CMP_LT_OQ ); }
+    SimdMask< 8 > operator<=( const SimdFloat& o ) const { return _mm256_cmp_ps( v, o.v, _CMP_LE_OQ ); }
+    SimdMask< 8 > operator>( const SimdFloat& o ) const { return _mm256_cmp_ps( v, o.v, _CMP_GT_OQ ); }
+    SimdMask< 8 > operator>=( const SimdFloat& o ) const { return _mm256_cmp_ps( v, o.v, _CMP_GE_OQ ); }
+    SimdMask< 8 > operator==( const SimdFloat& o ) const { return _mm256_cmp_ps( v, o.v, _CMP_EQ_OQ ); }
+    SimdMask< 8 > operator!=( const SimdFloat& o ) const { return _mm256_cmp_ps( v, o.v, _CMP_NEQ_UQ ); }
+};
+
+inline SimdFloat< 8 > min( const SimdFloat< 8 >& a, const SimdFloat< 8 >& b ) { return _mm256_min_ps( a.v, b.v ); }
+inline SimdFloat< 8 > max( const SimdFloat< 8 >& a, const SimdFloat< 8 >& b ) { return _mm256_max_ps( a.v, b.v ); }
+inline SimdFloat< 8 > sqrt( const SimdFloat< 8 >& a ) { return _mm256_sqrt_ps( a.v ); }
+inline SimdFloat< 8 > abs( const SimdFloat< 8 >& a ) { return _mm256_andnot_ps( _mm256_set1_ps( -0.0f ), a.v ); }
+inline SimdFloat< 8 > select( const SimdMask< 8 >& mask, const SimdFloat< 8 >& a, const SimdFloat< 8 >& b )
+{
+    return _mm256_blendv_ps( b.v, a.v, mask.m );
+}
+#endif // SIMD_AVX
+
+#endif // SIMD_H
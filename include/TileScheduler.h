@@ -0,0 +1,71 @@
+#ifndef TILESCHEDULER_H
+#define TILESCHEDULER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct TileWorkerStats
+{
+    float BusySeconds = 0.0f;
+    float IdleSeconds = 0.0f;
+    int Tiles = 0;
+    int Steals = 0;
+};
+
+// Spreads tiles over a persistent pool of worker threads, each with its own deque.
+// Workers pop from the front of their own deque and steal from the back of others when empty.
+// Per-tile cost is measured every run into a caller-owned vector, which seeds the next run's deques
+// most expensive first. Each workload keeps its own vector so one workload's costs never seed another's.
+class TileScheduler
+{
+public:
+    TileScheduler( int threadCount = 0 );
+    ~TileScheduler();
+
+    // Calls work( tile, thread ) once for every tile in [0, tileCount) and returns when all have finished
+    void Run( int tileCount, const std::function< void( int tile, int thread ) >& work );
+    // As above, seeding the deques from tileCosts and replacing them with this run's costs
+    void Run( int tileCount, std::vector< float >& tileCosts, const std::function< void( int tile, int thread ) >& work );
+
+    int GetThreadCount() const { return m_threadCount; }
+    float GetRunSeconds() const { return m_runSeconds; }
+    const std::vector< TileWorkerStats >& GetWorkerStats() const { return m_workerStats; }
+
+private:
+    struct alignas( 64 ) WorkerQueue
+    {
+        std::mutex Mutex;
+        std::deque< int > Tiles;
+    };
+
+    void seedQueues( int tileCount );
+    bool popLocal( int thread, int& tile );
+    bool steal( int thread, int& tile );
+    void workerLoop( int thread );
+    void runWorker( int thread );
+
+    int m_threadCount;
+    std::vector< std::thread > m_threads;
+    std::vector< WorkerQueue > m_queues;
+
+    // Pool synchronisation
+    std::mutex m_poolMutex;
+    std::condition_variable m_startCondition;
+    std::condition_variable m_doneCondition;
+    int m_generation = 0;
+    int m_activeWorkers = 0;
+    bool m_shutdown = false;
+
+    // Current run
+    const std::function< void( int, int ) >* m_work = 0;
+    std::vector< float >* m_tileCosts = 0;
+    std::vector< float > m_scratchCosts; // Costs of runs without a history of their own
+    std::vector< TileWorkerStats > m_workerStats;
+    float m_runSeconds = 0.0f;
+};
+
+#endif // TILESCHEDULER_H
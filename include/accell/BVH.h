@@ -0,0 +1,228 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Primitive.h"
+#include "PrimitiveStore.h"
+#include "Bounds.h"
+#include "Collisions.h"
+#include "TileScheduler.h"
+#include "UnboundedList.h"
+
+class LBVH;
+
+// Flattened BVH node, stored depth first so a branch's first child directly follows it.
+// Uploaded as two vec4s: ( Min, Offset ), ( Max, Count )
+struct BVHNode
+{
+    glm::vec3 Min;
+    int Offset; // Branch: index of the second child. Leaf: first entry in the references vector
+    glm::vec3 Max;
+    int Count;  // Leaf: number of references. Branch: 0
+
+    bool IsLeaf() const { return Count > 0; }
+};
+
+// Deepest tree the builders produce, also the traversal stack size on the CPU and GPU
+const int BVH_MAX_DEPTH = 32;
+
+// SAH cost model shared by the builders, relative costs of one node visit and one primitive test
+const float BVH_TRAVERSAL_COST = 1.0f;
+const float BVH_INTERSECT_COST = 1.5f;
+// Leaves larger than this are split even when the SAH prefers a leaf
+const int BVH_MAX_LEAF_SIZE = 8;
+
+struct BVHStats
+{
+    int Nodes = 0;
+    int Leaves = 0;
+    int MaxDepth = 0;
+    float SAHCost = 0.0f; // Expected cost of a random ray through the root, in BVH_INTERSECT_COST units
+    int Duplicates = 0;   // References beyond one per primitive, from spatial splits
+    float BuildSeconds = 0.0f;
+};
+
+// Bounding volume hierarchy over primitive bounds. Like the kD tree, unbounded primitives are kept out of the
+// tree, in GetUnbounded().
+// BinnedSAH builds top down with the surface area heuristic over binned centroids. Moving primitives are handled by
+// refitting node bounds, until the refitted tree's SAH cost drifts far enough from the last build's to be worth rebuilding.
+// Linear builds a Morton ordered LBVH in parallel, LinearRestructured then optimises its treelets, see LBVH.
+// Fast enough for scenes that change wholesale every frame, so they rebuild whenever anything moved.
+// SpatialSAH also considers spatial splits, clipping the references that straddle a plane into both children, which
+// keeps large primitives ( walls, floors ) from inflating every node around them. References may then appear in several
+// leaves, their growth is capped. The clipped bounds can't be refitted, so it too rebuilds whenever anything moved.
+// Every method produces the same node layout for upload
+class BVH
+{
+public:
+    enum BuildMethod { BinnedSAH, Linear, LinearRestructured, SpatialSAH };
+
+    // Builds run on scheduler, which must outlive the tree
+    BVH( const PrimitiveStore& primitives, TileScheduler& scheduler, BuildMethod method = BinnedSAH );
+    ~BVH();
+
+    const std::vector< BVHNode >& GetNodes() const { return m_nodes; }
+    const std::vector< int >& GetReferences() const { return m_references; }
+    const Bounds& GetBounds() const { return m_bounds; }
+    const BVHStats& GetStats() const { return m_stats; }
+    const UnboundedList& GetUnbounded() const { return m_unbounded; }
+
+    void Build( const PrimitiveStore& primitives );
+
+    // Refits the leaves holding primitives updated since the last Scene::Update, and their ancestors.
+    // Rebuilds instead when primitives were added or the SAH cost has drifted too far.
+    // Returns true if the tree was rebuilt, otherwise only nodes [ GetDirtyFirst(), GetDirtyLast() ) changed
+    bool Update( const PrimitiveStore& primitives );
+    int GetDirtyFirst() const { return m_dirtyFirst; }
+    int GetDirtyLast() const { return m_dirtyLast; }
+
+    // Batched ray query, with the same hit semantics as Collisions::IntersectRays
+    int IntersectRays(
+        const Ray* rays,
+        int rayCount,
+        const std::vector< Primitive* >& primitives,
+        ArrayView< PrimitiveTransform > transforms,
+        RayHit* hits,
+        Collisions::RayQueryMode mode = Collisions::ClosestHit
+        ) const;
+
+    // Visits the references of every leaf the ray reaches within tMax, nearest node first.
+    // visit( primitiveIndex, tMax ) tests one primitive and may shorten tMax to a hit's distance,
+    // returning true to end the traversal
+    template< typename Visitor >
+    void Traverse( const Ray& ray, float tMax, Visitor visit ) const;
+
+private:
+    // A primitive's reference during a SpatialSAH build, with its bounds clipped to the node holding it
+    struct SplitReference
+    {
+        Bounds Box;
+        int Primitive;
+    };
+
+    int buildNode( int first, int last, int parent, int depth );
+    int buildSpatialNode( const PrimitiveStore& primitives, std::vector< SplitReference >& refs, int parent, int depth );
+    bool splitSpatial(
+        const PrimitiveStore& primitives,
+        const std::vector< SplitReference >& refs,
+        const Bounds& nodeBounds,
+        const Bounds& centroidBounds,
+        std::vector< SplitReference >& left,
+        std::vector< SplitReference >& right
+        );
+    int flattenLinearNode( int node, int parent, int depth );
+    void gatherLinearLeaves( int node );
+    int partitionSAH( int first, int last, const Bounds& nodeBounds, const Bounds& centroidBounds );
+    Bounds primitiveBounds( const PrimitiveStore& primitives, PrimitiveHandle handle ) const;
+    void refitNode( int index );
+    float computeSAHCost() const;
+
+    static bool isectNode( const BVHNode& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float tMax, float& tEntry );
+
+    BuildMethod m_method;
+    TileScheduler& m_scheduler;
+    Bounds m_bounds;
+    UnboundedList m_unbounded;
+    BVHStats m_stats;
+    float m_builtSAHCost = 0.0f;
+    int m_primitiveCount = 0;
+
+    std::vector< BVHNode > m_nodes;
+    std::vector< int > m_references;
+
+    // Per node and per primitive state kept for refitting
+    std::vector< int > m_parents;
+    std::vector< bool > m_dirtyNodes;
+    std::vector< int > m_primitiveLeaves; // -1 for primitives with empty bounds
+    std::vector< Bounds > m_primitiveBounds;
+    int m_dirtyFirst = 0;
+    int m_dirtyLast = 0;
+
+    // Build scratch, kept between builds
+    std::vector< glm::vec3 > m_centroids;
+    LBVH* m_linear = 0;
+    float m_rootArea = 0.0f;
+    int m_splitBudget = 0; // Duplicate references spatial splits may still add
+};
+
+// Slab test against a node's bounds, tEntry is where the ray enters them
+inline bool BVH::isectNode( const BVHNode& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float tMax, float& tEntry )
+{
+    glm::vec3 t0 = ( node.Min - origin ) * inverseDirection;
+    glm::vec3 t1 = ( node.Max - origin ) * inverseDirection;
+    glm::vec3 tNear = glm::min( t0, t1 );
+    glm::vec3 tFar = glm::max( t0, t1 );
+
+    tEntry = glm::max( glm::max( tNear.x, tNear.y ), glm::max( tNear.z, 0.0f ) );
+    float tExit = glm::min( glm::min( tFar.x, tFar.y ), glm::min( tFar.z, tMax ) );
+
+    return tEntry <= tExit;
+}
+
+template< typename Visitor >
+void BVH::Traverse( const Ray& ray, float tMax, Visitor visit ) const
+{
+    // A tree of only unbounded primitives has an empty branch for a root, with no children to read
+    if( m_nodes.empty() || m_bounds.Empty() ) return;
+
+    glm::vec3 inverseDirection = 1.0f / ray.Direction;
+
+    // Deferred far children and where the ray enters them
+    int stackNode[ BVH_MAX_DEPTH ];
+    float stackEntry[ BVH_MAX_DEPTH ];
+    int stackPointer = 0;
+
+    float tEntry;
+    if( !isectNode( m_nodes[ 0 ], ray.Origin, inverseDirection, tMax, tEntry ) ) return;
+
+    int index = 0;
+    while( true )
+    {
+        const BVHNode& node = m_nodes[ index ];
+
+        if( node.IsLeaf() )
+        {
+            for( int i = node.Offset; i < node.Offset + node.Count; ++i )
+            {
+                if( visit( m_references[ i ], tMax ) ) return;
+            }
+        }
+        else
+        {
+            // Descend into the nearer child, deferring the other
+            float tFirst, tSecond;
+            bool first = isectNode( m_nodes[ index + 1 ], ray.Origin, inverseDirection, tMax, tFirst );
+            bool second = isectNode( m_nodes[ node.Offset ], ray.Origin, inverseDirection, tMax, tSecond );
+
+            if( first && second )
+            {
+                bool firstNearer = tFirst <= tSecond;
+                stackNode[ stackPointer ] = firstNearer ? node.Offset : index + 1;
+                stackEntry[ stackPointer ] = firstNearer ? tSecond : tFirst;
+                stackPointer++;
+
+                index = firstNearer ? index + 1 : node.Offset;
+                continue;
+            }
+            if( first || second )
+            {
+                index = first ? index + 1 : node.Offset;
+                continue;
+            }
+        }
+
+        // Pop the next deferred child that still lies before the nearest hit
+        do
+        {
+            if( stackPointer == 0 ) return;
+            stackPointer--;
+        }
+        while( stackEntry[ stackPointer ] > tMax );
+
+        index = stackNode[ stackPointer ];
+    }
+}
+
+#endif // BVH_H
@@ -0,0 +1,85 @@
+#ifndef COMPRESSEDBVH_H
+#define COMPRESSEDBVH_H
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Primitive.h"
+#include "Bounds.h"
+#include "Collisions.h"
+#include "BVH.h"
+#include "UnboundedList.h"
+
+// Branch node of a CompressedBVH, uploaded as an RGBA32I texel.
+// Planes holds both children's bounds quantised to 8 bits within the node's own ( decoded ) bounds:
+// child 0 min x, y, z, max x, y, z, then child 1's. Leaves are not nodes, a leaf child is its -1 terminated reference list.
+// Link >= 0: both children are branches, child 0 is the next node and child 1 is node Link.
+// Link < 0: packed = -1 - Link, the references start at packed >> 1. If packed & 1 both children are leaves,
+// child 1's list following child 0's, otherwise child 0 is the next node and child 1 the leaf
+struct CompressedBVHNode
+{
+    uint8_t Planes[ 12 ];
+    int Link;
+};
+
+static_assert( sizeof( CompressedBVHNode ) == 16, "CompressedBVHNode is uploaded as an RGBA32I texel" );
+
+struct CompressedBVHStats
+{
+    int Nodes = 0;
+    int Bytes = 0;             // Nodes and references, as uploaded
+    int UncompressedBytes = 0; // The same tree as float BVHNodes and plain references
+};
+
+// BVH with quantised bounds, for the GPU. Encoded from a binary BVH in a single pass: each child's bounds are rounded
+// outwards to 8 bits within its parent's decoded bounds, so they always contain the exact ones and traversal only
+// visits a little more. Branches hold their children's bounds and leaves fold into their parent, a node is 16 bytes
+// against 32 for each BVHNode, and there are half as many. The root's bounds are kept exact, in GetBounds().
+// Encode again whenever the BVH is rebuilt, Refit after a refit
+class CompressedBVH
+{
+public:
+    void Encode( const BVH& bvh );
+
+    // Follows a refit of the BVH it was encoded from, same topology. A child's planes are requantised only once its
+    // bounds outgrow their decoded ones, along with everything below it, which decodes from them. Only nodes
+    // [ GetDirtyFirst(), GetDirtyLast() ) change, unless the root outgrows GetBounds(), which encodes everything
+    // again and returns true
+    bool Refit( const BVH& bvh );
+    int GetDirtyFirst() const { return m_dirtyFirst; }
+    int GetDirtyLast() const { return m_dirtyLast; }
+
+    const std::vector< CompressedBVHNode >& GetNodes() const { return m_nodes; }
+    const std::vector< int >& GetReferences() const { return m_references; }
+    const Bounds& GetBounds() const { return m_bounds; }
+    const CompressedBVHStats& GetStats() const { return m_stats; }
+    const UnboundedList& GetUnbounded() const { return m_unbounded; }
+
+    // Bounds of a node's child ( 0 or 1 ) within the node's bounds, matching decodeBVHChild in Raytracer.frag
+    static Bounds DecodeChild( const CompressedBVHNode& node, int child, const Bounds& parent );
+
+private:
+    int encodeNode( const BVH& bvh, int index, const Bounds& decoded );
+    void refitNode( const BVH& bvh, int node, int index, int end, const Bounds& decoded );
+    void requantiseNode( const BVH& bvh, int node, int index, const Bounds& decoded );
+    void markDirty( int node );
+    int appendLeaf( const BVH& bvh, const BVHNode& leaf );
+    void childLinks( int index, int& first, int& second ) const;
+
+    static void sourceChildren( const std::vector< BVHNode >& nodes, int index, int children[ 2 ] );
+    static void quantise( const Bounds& child, const Bounds& parent, uint8_t* planes );
+    static bool contains( const Bounds& outer, const Bounds& inner );
+
+    Bounds m_bounds;
+    UnboundedList m_unbounded;
+    CompressedBVHStats m_stats;
+    int m_dirtyFirst = 0;
+    int m_dirtyLast = 0;
+
+    std::vector< CompressedBVHNode > m_nodes;
+    std::vector< int > m_references;
+};
+
+#endif // COMPRESSEDBVH_H
@@ -1,40 +1,153 @@
 #ifndef GRID_H
 #define GRID_H
 
+#include <atomic>
+#include <cstdint>
 #include <vector>
 
 #include "Primitive.h"
+#include "PrimitiveStore.h"
 #include "Camera.h"
+#include "Collisions.h"
+#include "Bounds.h"
+#include "TileScheduler.h"
+#include "UnboundedList.h"
 
+// Cells per primitive a fitted grid aims for
+const float GRID_DEFAULT_DENSITY = 4.0f;
+// Upper limit on a fitted grid's cells along any axis
+const int GRID_MAX_RESOLUTION = 128;
+
+struct GridStats
+{
+    glm::ivec3 Resolution = glm::ivec3( 0 );
+    int Cells = 0;
+    int EmptyCells = 0;
+    int References = 0;
+    int MaxCellReferences = 0;
+    float ReferencesPerCell = 0.0f;
+    float Density = 0.0f; // Cells per primitive asked for, 0 for grids with fixed bounds
+};
+
+// Uniform grid, either fitted to the scene's finite primitives or over a fixed box.
+// Each cell's references are a -1 terminated list in the object ref vector,
+// allocated with spare slots so primitives can be removed and reinserted in place as they move.
+// One occupancy bit per cell lets traversal skip empty cells without reading their lists.
+// Unbounded primitives are kept out of the cells, in GetUnbounded()
 class Grid
 {
 public:
-    Grid( std::vector< Primitive* > primitives, glm::vec3 b0, glm::vec3 b1, int subdivisions );
-    ~Grid();
+    // Fits the bounds to the scene, with a per axis resolution of about density cells per primitive.
+    // Builds run on scheduler, which must outlive the grid
+    Grid( const PrimitiveStore& primitives, TileScheduler& scheduler, float density = GRID_DEFAULT_DENSITY );
+    Grid( const PrimitiveStore& primitives, TileScheduler& scheduler, glm::vec3 b0, glm::vec3 b1, glm::ivec3 subdivisions );
 
     int GetGridArrayLength() const { return m_arrayLength; }
-    int* GetGridArray() const { return m_grid; }
-    std::vector< int > GetObjectRefVector() const { return m_cellObjectRefs; }
-    int GetSubdivisions() const { return m_subdivisions; }
+    const int* GetGridArray() const { return m_grid.data(); }
+    const std::vector< int >& GetObjectRefVector() const { return m_cellObjectRefs; }
+    // Cell i is occupied if bit ( i & 31 ) of word ( i >> 5 ) is set
+    const std::vector< uint32_t >& GetOccupancy() const { return m_occupancy; }
+    bool IsOccupied( int cell ) const { return ( m_occupancy[ cell >> 5 ] >> ( cell & 31 ) ) & 1u; }
+    glm::ivec3 GetSubdivisions() const { return m_subdivisions; }
     glm::vec3 GetMinBound() const { return m_p0; }
     glm::vec3 GetMaxBound() const { return m_p1; }
     glm::vec3 GetCellSize() const { return m_cellSize; }
+    const UnboundedList& GetUnbounded() const { return m_unbounded; }
+    GridStats GetStats() const;
+
+    // Bounds of the scene's finite primitives with some padding, as used by fitted grids
+    static Bounds FitBounds( const PrimitiveStore& primitives );
+    // Cells along each axis for a grid over bounds holding about density cells per primitive
+    static glm::ivec3 ChooseResolution( const Bounds& bounds, int primitiveCount, float density );
+    void Fit( const PrimitiveStore& primitives );
+
+    // Re-bins the primitives added or updated since the last Scene::Update, touching only the cells
+    // under their old and new bounds. Fitted grids are refitted once a primitive leaves them.
+    // Returns true if the grid was refitted, or the object ref vector was repacked or grew,
+    // otherwise only cells [ GetDirtyCellFirst(), GetDirtyCellLast() ) and
+    // refs [ GetDirtyRefFirst(), GetDirtyRefLast() ) changed, along with the occupancy words holding those cells
+    bool Update( const std::vector< Primitive* >& primitives, const PrimitiveStore& store, const glm::vec3& camPos, const glm::vec3& camDir );
+    int GetDirtyCellFirst() const { return m_dirtyCellFirst; }
+    int GetDirtyCellLast() const { return m_dirtyCellLast; }
+    int GetDirtyRefFirst() const { return m_dirtyRefFirst; }
+    int GetDirtyRefLast() const { return m_dirtyRefLast; }
+
+    void Insert( const PrimitiveStore& primitives, PrimitiveHandle handle );
+    void Remove( PrimitiveHandle handle );
 
-    void Update( std::vector< Primitive* > primitives, const glm::vec3& camPos, const glm::vec3& camDir );
     void Draw();
 
+    // Batched ray query walking the grid cells, with the same hit semantics as Collisions::IntersectRays
+    int IntersectRays(
+        const Ray* rays,
+        int rayCount,
+        const std::vector< Primitive* >& primitives,
+        ArrayView< PrimitiveTransform > transforms,
+        RayHit* hits,
+        Collisions::RayQueryMode mode = Collisions::ClosestHit
+        ) const;
+
 private:
-    void buildGrid( std::vector< Primitive* > primitives );
-    void traverseGrid();
+    // Inclusive range of cells a primitive's bounds cover, empty if Min > Max
+    struct CellRange
+    {
+        glm::ivec3 Min = glm::ivec3( 0 );
+        glm::ivec3 Max = glm::ivec3( -1 );
+
+        bool Empty() const { return Min.x > Max.x || Min.y > Max.y || Min.z > Max.z; }
+    };
+
+    void setBounds( const glm::vec3& p0, const glm::vec3& p1, const glm::ivec3& subdivisions );
+    void buildGrid( const PrimitiveStore& primitives );
+    bool outsideGrid( const PrimitiveStore& primitives, PrimitiveHandle handle ) const;
+    int cellIndex( const glm::ivec3& cell ) const { return cell.x + m_subdivisions.x * ( cell.y + m_subdivisions.y * cell.z ); }
+    CellRange cellRange( const PrimitiveStore& primitives, PrimitiveHandle handle ) const;
+    template< typename Visitor >
+    void forEachCell( const PrimitiveStore& primitives, PrimitiveHandle handle, const CellRange& range, Visitor visit ) const;
+    bool primitiveInCell( const PrimitiveStore& primitives, PrimitiveHandle handle, const glm::ivec3& cell ) const;
+    void insertRef( int cell, PrimitiveHandle handle );
+    void removeRef( int cell, PrimitiveHandle handle );
+    void relocateCell( int cell );
+    void markDirtyCell( int cell );
+    void setOccupied( int cell, bool occupied );
+    void markDirtyRefs( int first, int last );
+
+    void traverseGrid( const std::vector< Primitive* >& primitives, ArrayView< PrimitiveTransform > transforms );
+    bool intersectRay( const Ray& ray, const std::vector< Primitive* >& primitives, ArrayView< PrimitiveTransform > transforms, RayHit& hit, Collisions::RayQueryMode mode, std::vector< glm::vec3 >* visitedCells ) const;
     void drawCube( const glm::vec3& p0, const glm::vec3& p1 );
 
-    int m_arrayLength;
-    int* m_grid;
+    float m_density = 0.0f;
+    int m_fitPrimitiveCount = 0;
+
+    int m_arrayLength = 0;
+    std::vector< int > m_grid;
     glm::vec3 m_p0;
     glm::vec3 m_p1;
-    int m_subdivisions;
+    glm::ivec3 m_subdivisions;
     glm::vec3 m_cellSize;
     std::vector< int > m_cellObjectRefs;
+
+    // Per cell reference counts and slot capacities, a cell always keeps a free slot for its terminator
+    std::vector< int > m_cellCounts;
+    std::vector< int > m_cellCapacities;
+    std::vector< uint32_t > m_occupancy;
+    int m_refsEnd = 0;  // Slots in use, relocated cells are appended here
+    int m_garbage = 0;  // Slots abandoned by relocated cells, reclaimed by the next repack
+    bool m_refsGrown = false;
+
+    UnboundedList m_unbounded;
+
+    // Cells covered by each primitive when it was last inserted
+    std::vector< CellRange > m_primitiveCells;
+
+    // Build threads, and per cell counters they share: reference counts, then fill cursors
+    TileScheduler& m_scheduler;
+    std::vector< std::atomic< int > > m_cellCursors;
+
+    int m_dirtyCellFirst = 0;
+    int m_dirtyCellLast = 0;
+    int m_dirtyRefFirst = 0;
+    int m_dirtyRefLast = 0;
 };
 
 #endif // GRID_H
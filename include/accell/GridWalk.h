@@ -0,0 +1,87 @@
+#ifndef GRIDWALK_H
+#define GRIDWALK_H
+
+#include <cfloat>
+
+#include <glm/glm.hpp>
+
+#include "Ray.h"
+
+// Primitives a ray's mailbox remembers, on the CPU and GPU
+const int MAILBOX_SIZE = 8;
+
+// 3D DDA state over a grid of resolution cells from gridMin, starting from where the ray is at tStart.
+// Mirrors setupGridWalk / advanceGridWalk in Raytracer.frag
+struct GridWalk
+{
+    glm::ivec3 Cell;
+    glm::ivec3 Step;
+    glm::vec3 TNext;  // t of the next cell boundary on each axis
+    glm::vec3 TDelta; // t between boundaries on each axis
+    float TEntry;     // t the ray entered the current cell
+
+    GridWalk( const Ray& ray, const glm::vec3& inverseDirection, const glm::vec3& gridMin, const glm::vec3& cellSize, const glm::ivec3& resolution, float tStart );
+
+    float Exit() const { return glm::min( TNext.x, glm::min( TNext.y, TNext.z ) ); }
+    // Steps into the next cell along the axis with the nearest boundary, returns false once that leaves the grid
+    bool Advance( const glm::ivec3& resolution );
+};
+
+// The primitives a ray tested most recently. Cells share references to the primitives spanning them,
+// so a primitive is only tested the first time the ray meets it, and its nearest hit is kept even if it lies in a later cell.
+// A small ring, older entries are overwritten, which at worst costs a repeated test.
+// Mirrors admitMailbox in Raytracer.frag
+struct Mailbox
+{
+    int Entries[ MAILBOX_SIZE ];
+    int Next = 0;
+
+    Mailbox() { for( int i = 0; i < MAILBOX_SIZE; ++i ) Entries[ i ] = -1; }
+
+    // Returns false if the primitive was tested recently, otherwise records it
+    bool Admit( int primitiveIndex );
+};
+
+inline GridWalk::GridWalk( const Ray& ray, const glm::vec3& inverseDirection, const glm::vec3& gridMin, const glm::vec3& cellSize, const glm::ivec3& resolution, float tStart )
+{
+    glm::vec3 p = ray.Origin + ray.Direction * tStart;
+    Cell = glm::clamp( glm::ivec3( glm::floor( ( p - gridMin ) / cellSize ) ), glm::ivec3( 0 ), resolution - 1 );
+    Step = glm::ivec3( glm::sign( ray.Direction ) );
+    TNext = glm::vec3( FLT_MAX );
+    TDelta = glm::vec3( FLT_MAX );
+    TEntry = tStart;
+
+    for( int axis = 0; axis < 3; ++axis )
+    {
+        if( Step[ axis ] == 0 ) continue;
+
+        float boundary = gridMin[ axis ] + float( Cell[ axis ] + ( Step[ axis ] > 0 ? 1 : 0 ) ) * cellSize[ axis ];
+        TNext[ axis ] = ( boundary - ray.Origin[ axis ] ) * inverseDirection[ axis ];
+        TDelta[ axis ] = cellSize[ axis ] * glm::abs( inverseDirection[ axis ] );
+    }
+}
+
+inline bool GridWalk::Advance( const glm::ivec3& resolution )
+{
+    int axis = TNext.x <= TNext.y && TNext.x <= TNext.z ? 0 : ( TNext.y <= TNext.z ? 1 : 2 );
+
+    TEntry = TNext[ axis ];
+    Cell[ axis ] += Step[ axis ];
+    TNext[ axis ] += TDelta[ axis ];
+
+    return Cell[ axis ] >= 0 && Cell[ axis ] < resolution[ axis ];
+}
+
+inline bool Mailbox::Admit( int primitiveIndex )
+{
+    for( int i = 0; i < MAILBOX_SIZE; ++i )
+    {
+        if( Entries[ i ] == primitiveIndex ) return false;
+    }
+
+    Entries[ Next ] = primitiveIndex;
+    Next = ( Next + 1 ) % MAILBOX_SIZE;
+    return true;
+}
+
+#endif // GRIDWALK_H
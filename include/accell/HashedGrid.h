@@ -0,0 +1,140 @@
+#ifndef HASHEDGRID_H
+#define HASHEDGRID_H
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Primitive.h"
+#include "PrimitiveStore.h"
+#include "Bounds.h"
+#include "Collisions.h"
+#include "GridWalk.h"
+#include "UnboundedList.h"
+
+// Slot of the open addressing table, uploaded as an ivec4.
+// ( cell x, y, z, first reference ) with the reference list -1 terminated, First is -1 for empty slots
+struct HashedGridSlot
+{
+    glm::ivec3 Cell;
+    int First;
+};
+
+static_assert( sizeof( HashedGridSlot ) == 16, "HashedGridSlot is uploaded as an RGBA32I texel" );
+
+struct HashedGridStats
+{
+    float CellSize = 0.0f;
+    int OccupiedCells = 0;
+    int TableSize = 0;
+    int References = 0;
+    int MaxProbeLength = 0;
+    int Bytes = 0; // Table and references, as uploaded
+};
+
+// Uniform grid of world aligned cells with no bounding box of its own. Only occupied cells are stored,
+// keyed by their integer coordinates in a power of two open addressing table with linear probing,
+// so memory follows the occupied cells rather than the volume they span.
+// Rays are walked over the extent of the occupied cells, looking each cell up as they enter it.
+// Rebuilt whenever primitives change. Unbounded primitives are kept out of the cells, in GetUnbounded()
+class HashedGrid
+{
+public:
+    HashedGrid( const PrimitiveStore& primitives, float density );
+
+    void Build( const PrimitiveStore& primitives );
+
+    const std::vector< HashedGridSlot >& GetTable() const { return m_table; }
+    const std::vector< int >& GetReferences() const { return m_references; }
+    float GetCellSize() const { return m_cellSize; }
+    const glm::ivec3& GetMinCell() const { return m_minCell; }
+    const glm::ivec3& GetResolution() const { return m_resolution; }
+    const Bounds& GetBounds() const { return m_bounds; }
+    const HashedGridStats& GetStats() const { return m_stats; }
+    const UnboundedList& GetUnbounded() const { return m_unbounded; }
+
+    // Hash of a cell's coordinates, matching hashCell in Raytracer.frag
+    static uint32_t Hash( const glm::ivec3& cell );
+    // First reference of an occupied cell, or -1
+    int FindCell( const glm::ivec3& cell ) const;
+
+    // Batched ray query, with the same hit semantics as Collisions::IntersectRays
+    int IntersectRays(
+        const Ray* rays,
+        int rayCount,
+        const std::vector< Primitive* >& primitives,
+        ArrayView< PrimitiveTransform > transforms,
+        RayHit* hits,
+        Collisions::RayQueryMode mode = Collisions::ClosestHit
+        ) const;
+
+    // Visits the primitives referenced by every occupied cell the ray passes through within tMax, in order along the ray,
+    // each once however many cells it spans.
+    // visit( primitiveIndex, tMax ) tests one primitive and may shorten tMax to a hit's distance,
+    // returning true to end the traversal
+    template< typename Visitor >
+    void Traverse( const Ray& ray, float tMax, Visitor visit ) const;
+
+private:
+    struct CellRef
+    {
+        glm::ivec3 Cell;
+        int Handle;
+    };
+
+    void insertCell( const glm::ivec3& cell, int first );
+
+    float m_density;
+    float m_cellSize = 1.0f;
+    glm::ivec3 m_minCell = glm::ivec3( 0 ); // Occupied cells span [ m_minCell, m_minCell + m_resolution )
+    glm::ivec3 m_resolution = glm::ivec3( 0 );
+    Bounds m_bounds;
+    HashedGridStats m_stats;
+    UnboundedList m_unbounded;
+
+    std::vector< HashedGridSlot > m_table;
+    std::vector< int > m_references;
+
+    // Build scratch, kept between builds
+    std::vector< CellRef > m_cellRefs;
+};
+
+template< typename Visitor >
+void HashedGrid::Traverse( const Ray& ray, float tMax, Visitor visit ) const
+{
+    if( m_bounds.Empty() ) return;
+
+    glm::vec3 inverseDirection = 1.0f / ray.Direction;
+
+    // Clip the ray to the occupied cells
+    glm::vec3 t0 = ( m_bounds.Min - ray.Origin ) * inverseDirection;
+    glm::vec3 t1 = ( m_bounds.Max - ray.Origin ) * inverseDirection;
+    glm::vec3 tNear = glm::min( t0, t1 );
+    glm::vec3 tFar = glm::max( t0, t1 );
+    float tEnter = glm::max( glm::max( tNear.x, tNear.y ), glm::max( tNear.z, 0.0f ) );
+    float tExit = glm::min( glm::min( tFar.x, tFar.y ), glm::min( tFar.z, tMax ) );
+    if( tEnter > tExit ) return;
+
+    GridWalk walk( ray, inverseDirection, m_bounds.Min, glm::vec3( m_cellSize ), m_resolution, tEnter );
+    Mailbox mailbox;
+
+    while( true )
+    {
+        int first = FindCell( m_minCell + walk.Cell );
+        if( first >= 0 )
+        {
+            for( int i = first; m_references[ i ] != -1; ++i )
+            {
+                if( mailbox.Admit( m_references[ i ] ) && visit( m_references[ i ], tMax ) ) return;
+            }
+        }
+
+        // Nothing in a later cell can be nearer than a hit inside this one
+        float tCellExit = walk.Exit();
+        if( tMax <= tCellExit || tCellExit >= tExit ) return;
+        if( !walk.Advance( m_resolution ) ) return;
+    }
+}
+
+#endif // HASHEDGRID_H
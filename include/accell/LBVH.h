@@ -0,0 +1,88 @@
+#ifndef LBVH_H
+#define LBVH_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Bounds.h"
+#include "TileScheduler.h"
+
+// Linear BVH builder for scenes rebuilt wholesale every frame.
+// Primitive centroids get 30 bit Morton codes, sorted with a parallel LSD radix sort, and the binary radix tree
+// over the sorted codes is emitted one internal node per thread ( Karras 2012 ). Bounds and SAH costs are then
+// propagated bottom up, optionally restructuring small treelets to their optimal topology on the way ( Karras and Aila 2013 ).
+// Every pass is linear in the primitives and spread over the scheduler's threads.
+// Nodes are indexed internal [ 0, n - 1 ) then leaves [ n - 1, 2n - 1 ), each leaf one primitive, the root is 0.
+// BVH flattens the result into its own layout
+class LBVH
+{
+public:
+    // Builds over every primitive with non-empty bounds, indexed by primitive handle.
+    // treeletRounds restructuring passes follow, 0 for none
+    void Build( TileScheduler& scheduler, const std::vector< Bounds >& primitiveBounds, int treeletRounds );
+
+    int GetPrimitiveCount() const { return m_leafCount; }
+    int GetRestructuredTreelets() const { return m_restructured; }
+
+    bool IsLeaf( int node ) const { return node >= m_leafCount - 1; }
+    int GetPrimitive( int leaf ) const { return m_handles[ leaf - ( m_leafCount - 1 ) ]; }
+    glm::ivec2 GetChildren( int node ) const { return m_children[ node ]; }
+    const Bounds& GetBounds( int node ) const { return m_bounds[ node ]; }
+    int GetCount( int node ) const { return m_counts[ node ]; }
+    // Whether the SAH prefers a node's primitives in a single leaf over its subtree
+    bool PrefersLeaf( int node ) const;
+
+    // Interleaves the bits of a point in [ 0, 1 ]^3 quantised to 10 bits per axis, x highest
+    static uint32_t MortonCode( const glm::vec3& unit );
+
+private:
+    // Scratch for restructuring one treelet, subsets of its leaves are bit masks
+    struct Treelet
+    {
+        static const int MaxLeaves = 7;
+
+        int Leaves[ MaxLeaves ];
+        int Internals[ MaxLeaves - 2 ]; // Nodes the treelet replaces, reused for its new topology
+        int LeafCount = 0;
+        int InternalCount = 0;
+        int NextInternal = 0;
+
+        Bounds SubsetBounds[ 1 << MaxLeaves ];
+        float SubsetCosts[ 1 << MaxLeaves ];
+        int SubsetCounts[ 1 << MaxLeaves ];
+        int SubsetSplits[ 1 << MaxLeaves ];
+    };
+
+    void sortCodes( TileScheduler& scheduler );
+    int prefixLength( int i, int j ) const;
+    void buildInternalNode( int i );
+    void propagate( TileScheduler& scheduler, const std::vector< Bounds >& primitiveBounds, bool restructure );
+    void updateNode( int node );
+    void restructureTreelet( int root );
+    int rebuildTreelet( Treelet& treelet, int subset, int node );
+
+    int m_leafCount = 0;
+    std::atomic< int > m_restructured{ 0 };
+
+    // Sorted codes and the primitive behind each, in leaf order
+    std::vector< uint32_t > m_codes;
+    std::vector< int > m_handles;
+
+    std::vector< glm::ivec2 > m_children; // Internal nodes only
+    std::vector< int > m_parents;         // -1 for the root
+    std::vector< Bounds > m_bounds;
+    std::vector< int > m_counts;          // Primitives under each node
+    std::vector< float > m_costs;         // SAH cost of each subtree, in surface area units
+
+    // Build scratch, kept between builds
+    std::vector< uint32_t > m_codesScratch;
+    std::vector< int > m_handlesScratch;
+    std::vector< int > m_histograms;
+    std::vector< Bounds > m_chunkBounds;
+    std::vector< std::atomic< int > > m_visits; // Children finished, per internal node
+};
+
+#endif // LBVH_H
@@ -0,0 +1,226 @@
+#ifndef OCTREE_H
+#define OCTREE_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Primitive.h"
+#include "PrimitiveStore.h"
+#include "Bounds.h"
+#include "Collisions.h"
+#include "GridWalk.h"
+#include "UnboundedList.h"
+
+// Deepest subdivision the builder makes, also the traversal stack size on the CPU and GPU
+const int OCTREE_MAX_DEPTH = 12;
+
+// Smallest direction component traversal works with, keeping the parametric midpoints finite
+const float OCTREE_MIN_DIRECTION = 1e-8f;
+
+// Node of a sparse octree, uploaded as an ivec2.
+// Octants are numbered with x 4, y 2, z 1 set for the upper halves. Only non-empty children are stored,
+// contiguously in octant order, so a child's index is Offset plus the number of lower octants in Mask
+struct OctreeNode
+{
+    int Mask;   // Branch: bit i set if octant i has a child. Leaf: 0
+    int Offset; // Branch: index of its first child. Leaf: first entry of its -1 terminated reference list
+
+    bool IsLeaf() const { return Mask == 0; }
+};
+
+static_assert( sizeof( OctreeNode ) == 8, "OctreeNode is uploaded as an RG32I texel" );
+
+struct OctreeStats
+{
+    int Nodes = 0;
+    int Leaves = 0;
+    int MaxDepth = 0;
+    int References = 0;
+    int Bytes = 0; // Nodes and references, as uploaded
+};
+
+// Sparse octree over a cube around the bounded primitives. Nodes holding more than OCTREE_LEAF_SIZE references
+// are split into octants, down to OCTREE_MAX_DEPTH, with each primitive going to the octants its surface reaches.
+// Empty octants aren't stored, so dense clusters get small cells while open space costs nothing, between the uniform
+// grid and the trees. Rays walk it with the parametric algorithm of Revelles et al., visiting children in order along the ray.
+// Rebuilt whenever primitives change. Unbounded primitives are kept out of the cells, in GetUnbounded()
+class Octree
+{
+public:
+    Octree( const PrimitiveStore& primitives );
+
+    void Build( const PrimitiveStore& primitives );
+
+    const std::vector< OctreeNode >& GetNodes() const { return m_nodes; }
+    const std::vector< int >& GetReferences() const { return m_references; }
+    const Bounds& GetBounds() const { return m_bounds; }
+    const OctreeStats& GetStats() const { return m_stats; }
+    const UnboundedList& GetUnbounded() const { return m_unbounded; }
+
+    // Index of a branch's child in an octant its Mask holds
+    static int ChildIndex( const OctreeNode& node, int octant );
+
+    // Batched ray query, with the same hit semantics as Collisions::IntersectRays
+    int IntersectRays(
+        const Ray* rays,
+        int rayCount,
+        const std::vector< Primitive* >& primitives,
+        ArrayView< PrimitiveTransform > transforms,
+        RayHit* hits,
+        Collisions::RayQueryMode mode = Collisions::ClosestHit
+        ) const;
+
+    // Visits the primitives referenced by every leaf the ray passes through within tMax, in order along the ray,
+    // each once however many leaves it spans.
+    // visit( primitiveIndex, tMax ) tests one primitive and may shorten tMax to a hit's distance,
+    // returning true to end the traversal
+    template< typename Visitor >
+    void Traverse( const Ray& ray, float tMax, Visitor visit ) const;
+
+private:
+    // A branch being walked, the ray's parametric span over it and the next octant to visit, 8 when done
+    struct StackEntry
+    {
+        int Node;
+        int Octant;
+        glm::vec3 T0;
+        glm::vec3 T1;
+    };
+
+    void buildNode( const PrimitiveStore& primitives, int index, const Bounds& box, std::vector< int >& refs, int depth );
+
+    static int firstOctant( const glm::vec3& t0, const glm::vec3& t1 );
+    static int nextOctant( int octant, const glm::vec3& t1 );
+
+    Bounds m_bounds;
+    OctreeStats m_stats;
+    UnboundedList m_unbounded;
+
+    std::vector< OctreeNode > m_nodes;
+    std::vector< int > m_references;
+
+    // Build scratch, kept between builds
+    std::vector< Bounds > m_primitiveBounds;
+};
+
+inline int Octree::ChildIndex( const OctreeNode& node, int octant )
+{
+    int rank = 0;
+    for( int below = node.Mask & ( ( 1 << octant ) - 1 ); below != 0; below &= below - 1 ) rank++;
+    return node.Offset + rank;
+}
+
+// Octant of a branch the ray enters first: the upper half along each axis whose midplane it crosses before entering
+inline int Octree::firstOctant( const glm::vec3& t0, const glm::vec3& t1 )
+{
+    glm::vec3 tMid = ( t0 + t1 ) * 0.5f;
+    float tEnter = glm::max( glm::max( t0.x, t0.y ), t0.z );
+
+    int octant = 0;
+    if( tMid.x < tEnter ) octant |= 4;
+    if( tMid.y < tEnter ) octant |= 2;
+    if( tMid.z < tEnter ) octant |= 1;
+    return octant;
+}
+
+// Octant the ray moves on to from one it leaves at t1, across the plane it exits first, 8 if that leaves the parent
+inline int Octree::nextOctant( int octant, const glm::vec3& t1 )
+{
+    int bit = 1;
+    if( t1.x <= t1.y && t1.x <= t1.z ) bit = 4;
+    else if( t1.y <= t1.z ) bit = 2;
+
+    return ( octant & bit ) ? 8 : octant | bit;
+}
+
+template< typename Visitor >
+void Octree::Traverse( const Ray& ray, float tMax, Visitor visit ) const
+{
+    if( m_bounds.Empty() ) return;
+
+    // Mirror the ray about the root's center into positive directions, remembering the octants that flips
+    glm::vec3 center = m_bounds.Center();
+    glm::vec3 origin = ray.Origin;
+    glm::vec3 direction = ray.Direction;
+    int flip = 0;
+    for( int axis = 0; axis < 3; ++axis )
+    {
+        if( direction[ axis ] < 0.0f )
+        {
+            origin[ axis ] = 2.0f * center[ axis ] - origin[ axis ];
+            direction[ axis ] = -direction[ axis ];
+            flip |= 4 >> axis;
+        }
+        direction[ axis ] = glm::max( direction[ axis ], OCTREE_MIN_DIRECTION );
+    }
+
+    glm::vec3 inverseDirection = 1.0f / direction;
+    glm::vec3 t0 = ( m_bounds.Min - origin ) * inverseDirection;
+    glm::vec3 t1 = ( m_bounds.Max - origin ) * inverseDirection;
+
+    float tEnter = glm::max( glm::max( t0.x, t0.y ), glm::max( t0.z, 0.0f ) );
+    float tExit = glm::min( glm::min( t1.x, t1.y ), glm::min( t1.z, tMax ) );
+    if( tEnter > tExit ) return;
+
+    Mailbox mailbox;
+
+    if( m_nodes[ 0 ].IsLeaf() )
+    {
+        for( int i = m_nodes[ 0 ].Offset; m_references[ i ] != -1; ++i )
+        {
+            if( mailbox.Admit( m_references[ i ] ) && visit( m_references[ i ], tMax ) ) return;
+        }
+        return;
+    }
+
+    StackEntry stack[ OCTREE_MAX_DEPTH + 1 ];
+    int stackPointer = 0;
+    stack[ stackPointer++ ] = { 0, firstOctant( t0, t1 ), t0, t1 };
+
+    while( stackPointer > 0 )
+    {
+        StackEntry& entry = stack[ stackPointer - 1 ];
+        if( entry.Octant > 7 )
+        {
+            stackPointer--;
+            continue;
+        }
+
+        // The octant spans the lower or upper half of its parent's span along each axis
+        int octant = entry.Octant;
+        glm::vec3 tMid = ( entry.T0 + entry.T1 ) * 0.5f;
+        glm::vec3 childT0 = glm::vec3( ( octant & 4 ) ? tMid.x : entry.T0.x, ( octant & 2 ) ? tMid.y : entry.T0.y, ( octant & 1 ) ? tMid.z : entry.T0.z );
+        glm::vec3 childT1 = glm::vec3( ( octant & 4 ) ? entry.T1.x : tMid.x, ( octant & 2 ) ? entry.T1.y : tMid.y, ( octant & 1 ) ? entry.T1.z : tMid.z );
+        entry.Octant = nextOctant( octant, childT1 );
+
+        float tChildExit = glm::min( glm::min( childT1.x, childT1.y ), childT1.z );
+        if( tChildExit < 0.0f ) continue;
+
+        // Octants come in order along the ray, nothing from here on can be nearer than the nearest hit
+        if( glm::max( glm::max( childT0.x, childT0.y ), childT0.z ) > tMax ) return;
+
+        const OctreeNode& node = m_nodes[ entry.Node ];
+        int real = octant ^ flip;
+        if( !( node.Mask & ( 1 << real ) ) ) continue;
+
+        int childIndex = ChildIndex( node, real );
+        const OctreeNode& child = m_nodes[ childIndex ];
+        if( child.IsLeaf() )
+        {
+            for( int i = child.Offset; m_references[ i ] != -1; ++i )
+            {
+                if( mailbox.Admit( m_references[ i ] ) && visit( m_references[ i ], tMax ) ) return;
+            }
+
+            // Nothing in a later leaf can be nearer than a hit inside this one
+            if( tMax <= tChildExit ) return;
+        }
+        else
+        {
+            stack[ stackPointer++ ] = { childIndex, firstOctant( childT0, childT1 ), childT0, childT1 };
+        }
+    }
+}
+
+#endif // OCTREE_H
@@ -0,0 +1,156 @@
+#ifndef TWOLEVELGRID_H
+#define TWOLEVELGRID_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Primitive.h"
+#include "PrimitiveStore.h"
+#include "Bounds.h"
+#include "Collisions.h"
+#include "GridWalk.h"
+#include "UnboundedList.h"
+
+// One cell of either level, uploaded as an ivec2.
+// Leaf: ( first reference, reference count ).
+// Subdivided top cell: ( first child cell, -1 - packed child resolution ), children laid out x fastest like the top level
+struct TwoLevelGridCell
+{
+    int Offset;
+    int Count;
+
+    bool IsLeaf() const { return Count >= 0; }
+    glm::ivec3 Resolution() const { int packed = -1 - Count; return glm::ivec3( packed & 0xFF, ( packed >> 8 ) & 0xFF, packed >> 16 ); }
+
+    void InitLeaf( int first, int count ) { Offset = first; Count = count; }
+    void InitSubdivided( int firstChild, const glm::ivec3& resolution ) { Offset = firstChild; Count = -1 - ( resolution.x | ( resolution.y << 8 ) | ( resolution.z << 16 ) ); }
+};
+
+static_assert( sizeof( TwoLevelGridCell ) == 8, "TwoLevelGridCell is uploaded as an RG32I texel" );
+
+struct TwoLevelGridStats
+{
+    glm::ivec3 Resolution = glm::ivec3( 0 );
+    int TopCells = 0;
+    int SubGrids = 0;
+    int SubCells = 0;
+    int EmptyLeaves = 0;
+    int References = 0;
+    int MaxLeafReferences = 0;
+};
+
+// Coarse uniform grid whose crowded cells hold a finer grid of their own, so dense clusters
+// get small cells without paying for them across the empty space around.
+// Top cells with more than TWO_LEVEL_LEAF_SIZE references are subdivided at a resolution fitted to them.
+// Built from scratch, in time linear in the references, whenever primitives change.
+// Unbounded primitives are kept out of the cells, in GetUnbounded()
+class TwoLevelGrid
+{
+public:
+    TwoLevelGrid( const PrimitiveStore& primitives );
+
+    void Build( const PrimitiveStore& primitives );
+
+    const std::vector< TwoLevelGridCell >& GetCells() const { return m_cells; }
+    const std::vector< int >& GetReferences() const { return m_references; }
+    const Bounds& GetBounds() const { return m_bounds; }
+    glm::ivec3 GetResolution() const { return m_resolution; }
+    glm::vec3 GetCellSize() const { return m_cellSize; }
+    const TwoLevelGridStats& GetStats() const { return m_stats; }
+    const UnboundedList& GetUnbounded() const { return m_unbounded; }
+
+    // Batched ray query, with the same hit semantics as Collisions::IntersectRays
+    int IntersectRays(
+        const Ray* rays,
+        int rayCount,
+        const std::vector< Primitive* >& primitives,
+        ArrayView< PrimitiveTransform > transforms,
+        RayHit* hits,
+        Collisions::RayQueryMode mode = Collisions::ClosestHit
+        ) const;
+
+    // Visits the primitives referenced by every leaf cell the ray passes through within tMax, in order along the ray,
+    // each once however many cells it spans.
+    // visit( primitiveIndex, tMax ) tests one primitive and may shorten tMax to a hit's distance,
+    // returning true to end the traversal
+    template< typename Visitor >
+    void Traverse( const Ray& ray, float tMax, Visitor visit ) const;
+
+private:
+    void subdivideCell( int cell, const Bounds& cellBounds );
+    void addLeafStats( const TwoLevelGridCell& leaf );
+
+    Bounds m_bounds;
+    glm::ivec3 m_resolution;
+    glm::vec3 m_cellSize;
+    TwoLevelGridStats m_stats;
+    UnboundedList m_unbounded;
+
+    std::vector< TwoLevelGridCell > m_cells; // Top level cells, then every sub grid's
+    std::vector< int > m_references;
+
+    // Build scratch, kept between builds
+    std::vector< Bounds > m_primitiveBounds;
+    std::vector< std::vector< int > > m_topLists;
+    std::vector< std::vector< int > > m_subLists;
+};
+
+template< typename Visitor >
+void TwoLevelGrid::Traverse( const Ray& ray, float tMax, Visitor visit ) const
+{
+    glm::vec3 inverseDirection = 1.0f / ray.Direction;
+
+    // Clip the ray to the grid bounds
+    glm::vec3 t0 = ( m_bounds.Min - ray.Origin ) * inverseDirection;
+    glm::vec3 t1 = ( m_bounds.Max - ray.Origin ) * inverseDirection;
+    glm::vec3 tNear = glm::min( t0, t1 );
+    glm::vec3 tFar = glm::max( t0, t1 );
+    float tEnter = glm::max( glm::max( tNear.x, tNear.y ), glm::max( tNear.z, 0.0f ) );
+    float tExit = glm::min( glm::min( tFar.x, tFar.y ), glm::min( tFar.z, tMax ) );
+    if( tEnter > tExit ) return;
+
+    GridWalk top( ray, inverseDirection, m_bounds.Min, m_cellSize, m_resolution, tEnter );
+    Mailbox mailbox;
+
+    while( true )
+    {
+        const TwoLevelGridCell& cell = m_cells[ top.Cell.x + m_resolution.x * ( top.Cell.y + m_resolution.y * top.Cell.z ) ];
+        float tCellExit = top.Exit();
+
+        if( cell.IsLeaf() )
+        {
+            for( int i = cell.Offset; i < cell.Offset + cell.Count; ++i )
+            {
+                if( mailbox.Admit( m_references[ i ] ) && visit( m_references[ i ], tMax ) ) return;
+            }
+        }
+        else
+        {
+            // Walk the cell's sub grid over the ray's span inside it
+            glm::ivec3 resolution = cell.Resolution();
+            glm::vec3 subCellSize = m_cellSize / glm::vec3( resolution );
+            glm::vec3 subMin = m_bounds.Min + glm::vec3( top.Cell ) * m_cellSize;
+
+            GridWalk sub( ray, inverseDirection, subMin, subCellSize, resolution, top.TEntry );
+
+            while( true )
+            {
+                const TwoLevelGridCell& leaf = m_cells[ cell.Offset + sub.Cell.x + resolution.x * ( sub.Cell.y + resolution.y * sub.Cell.z ) ];
+                for( int i = leaf.Offset; i < leaf.Offset + leaf.Count; ++i )
+                {
+                    if( mailbox.Admit( m_references[ i ] ) && visit( m_references[ i ], tMax ) ) return;
+                }
+
+                // Nothing in a later cell can be nearer than a hit inside this one
+                if( tMax <= sub.Exit() ) return;
+                if( !sub.Advance( resolution ) || sub.TEntry > tCellExit ) break;
+            }
+        }
+
+        if( tMax <= tCellExit || tCellExit >= tExit ) return;
+        if( !top.Advance( m_resolution ) ) return;
+    }
+}
+
+#endif // TWOLEVELGRID_H
@@ -0,0 +1,78 @@
+#ifndef UNBOUNDEDLIST_H
+#define UNBOUNDEDLIST_H
+
+#include <vector>
+
+#include "Primitive.h"
+#include "PrimitiveStore.h"
+#include "Collisions.h"
+
+// Primitives with no finite bounds ( planes ), which the acceleration structures leave out.
+// Clipped into a structure they would be referenced by every cell or node they cross and retested in each,
+// instead every ray tests this short list once before traversal and the nearest hit caps how far it traverses
+class UnboundedList
+{
+public:
+    void Build( const PrimitiveStore& primitives );
+
+    const std::vector< int >& GetPrimitives() const { return m_primitives; }
+    int Size() const { return int( m_primitives.size() ); }
+    bool Empty() const { return m_primitives.empty(); }
+
+    // Batched ray query over the list, with the same hit semantics as Collisions::IntersectRays
+    int IntersectRays(
+        const Ray* rays,
+        int rayCount,
+        const std::vector< Primitive* >& primitives,
+        ArrayView< PrimitiveTransform > transforms,
+        RayHit* hits,
+        Collisions::RayQueryMode mode = Collisions::ClosestHit
+        ) const;
+
+private:
+    std::vector< int > m_primitives;
+};
+
+// Batched ray query over a structure with GetUnbounded() and Traverse( ray, tMax, visit ), with the same hit semantics
+// as Collisions::IntersectRays. A hit on an unbounded primitive caps the traversal, so they are tested first
+template< typename Structure >
+int IntersectStructureRays(
+    const Structure& structure,
+    const Ray* rays,
+    int rayCount,
+    const std::vector< Primitive* >& primitives,
+    ArrayView< PrimitiveTransform > transforms,
+    RayHit* hits,
+    Collisions::RayQueryMode mode
+    )
+{
+    int hitCount = 0;
+
+    for( int r = 0; r < rayCount; ++r )
+    {
+        if( mode == Collisions::AnyHit && hits[ r ].PrimitiveIndex >= 0 ) continue;
+
+        bool rayHit = structure.GetUnbounded().IntersectRays( &rays[ r ], 1, primitives, transforms, &hits[ r ], mode ) > 0;
+        if( rayHit && mode == Collisions::AnyHit )
+        {
+            hitCount++;
+            continue;
+        }
+
+        structure.Traverse( rays[ r ], hits[ r ].Distance, [ & ]( int primitiveIndex, float& tMax )
+        {
+            if( Collisions::IntersectRays( &rays[ r ], 1, primitives, transforms, &primitiveIndex, 1, &hits[ r ], mode ) > 0 )
+            {
+                rayHit = true;
+                tMax = hits[ r ].Distance;
+            }
+            return rayHit && mode == Collisions::AnyHit;
+        } );
+
+        if( rayHit ) hitCount++;
+    }
+
+    return hitCount;
+}
+
+#endif // UNBOUNDEDLIST_H
@@ -0,0 +1,165 @@
+#ifndef WIDEBVH_H
+#define WIDEBVH_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Primitive.h"
+#include "Bounds.h"
+#include "Collisions.h"
+#include "Simd.h"
+#include "BVH.h"
+#include "UnboundedList.h"
+
+// Node width the CPU traverses, as many children as this build's SIMD lanes test at once
+const int WIDE_BVH_WIDTH = SIMD_WIDTH >= 8 ? 8 : 4;
+
+// Node of a WideBVH. Child bounds are stored per axis, a lane per child, so one SIMD slab test covers them all.
+// Lanes past ChildCount are unused
+template< int N >
+struct WideBVHNode
+{
+    float MinX[ N ], MinY[ N ], MinZ[ N ];
+    float MaxX[ N ], MaxY[ N ], MaxZ[ N ];
+    int Offset[ N ]; // Branch child: index of its node. Leaf child: first entry in the references vector
+    int Count[ N ];  // Leaf child: number of references. Branch child: 0
+    int ChildCount;
+};
+
+struct WideBVHStats
+{
+    int Nodes = 0;
+    int Leaves = 0;
+    float ChildrenPerNode = 0.0f;
+};
+
+// BVH with up to N children per node, for CPU queries. Collapsed from a binary BVH by repeatedly
+// opening the child with the largest surface area, and tested a node at a time with the slab test of
+// Collisions::IsectAABB vectorised over the children. Shares the binary tree's leaves and references.
+// Collapse again whenever the BVH is rebuilt or refitted
+template< int N >
+class WideBVH
+{
+public:
+    void Collapse( const BVH& bvh );
+
+    const std::vector< WideBVHNode< N > >& GetNodes() const { return m_nodes; }
+    const std::vector< int >& GetReferences() const { return m_references; }
+    const WideBVHStats& GetStats() const { return m_stats; }
+    const UnboundedList& GetUnbounded() const { return m_unbounded; }
+
+    // Batched ray query, with the same hit semantics as Collisions::IntersectRays
+    int IntersectRays(
+        const Ray* rays,
+        int rayCount,
+        const std::vector< Primitive* >& primitives,
+        ArrayView< PrimitiveTransform > transforms,
+        RayHit* hits,
+        Collisions::RayQueryMode mode = Collisions::ClosestHit
+        ) const;
+
+    // Visits the references of every leaf the ray reaches within tMax, nearest child first.
+    // visit( primitiveIndex, tMax ) tests one primitive and may shorten tMax to a hit's distance,
+    // returning true to end the traversal
+    template< typename Visitor >
+    void Traverse( const Ray& ray, float tMax, Visitor visit ) const;
+
+private:
+    // A child still to visit: a wide node, or a leaf's reference range, and where the ray enters it
+    struct StackEntry
+    {
+        int Offset;
+        int Count;
+        float Entry;
+    };
+
+    // Each node visited leaves at most N - 1 more entries on the stack than it took off
+    static const int StackSize = BVH_MAX_DEPTH * ( N - 1 ) + 1;
+
+    int collapseNode( const std::vector< BVHNode >& nodes, int index );
+
+    UnboundedList m_unbounded;
+    WideBVHStats m_stats;
+
+    std::vector< WideBVHNode< N > > m_nodes;
+    std::vector< int > m_references;
+};
+
+typedef WideBVH< 4 > BVH4;
+typedef WideBVH< 8 > BVH8;
+
+template< int N >
+template< typename Visitor >
+void WideBVH< N >::Traverse( const Ray& ray, float tMax, Visitor visit ) const
+{
+    if( m_nodes.empty() ) return;
+
+    typedef SimdFloat< N > Float;
+
+    glm::vec3 inverseDirection = 1.0f / ray.Direction;
+    Float originX( ray.Origin.x ), originY( ray.Origin.y ), originZ( ray.Origin.z );
+    Float inverseX( inverseDirection.x ), inverseY( inverseDirection.y ), inverseZ( inverseDirection.z );
+    Float zero( 0.0f );
+
+    StackEntry stack[ StackSize ];
+    int stackPointer = 0;
+    stack[ stackPointer++ ] = { 0, 0, 0.0f };
+
+    while( stackPointer > 0 )
+    {
+        // Skip children that start past the nearest hit so far
+        const StackEntry entry = stack[ --stackPointer ];
+        if( entry.Entry > tMax ) continue;
+
+        if( entry.Count > 0 )
+        {
+            for( int i = entry.Offset; i < entry.Offset + entry.Count; ++i )
+            {
+                if( visit( m_references[ i ], tMax ) ) return;
+            }
+            continue;
+        }
+
+        // Slab test against every child at once
+        const WideBVHNode< N >& node = m_nodes[ entry.Offset ];
+        Float t0x = ( Float::Load( node.MinX ) - originX ) * inverseX;
+        Float t1x = ( Float::Load( node.MaxX ) - originX ) * inverseX;
+        Float t0y = ( Float::Load( node.MinY ) - originY ) * inverseY;
+        Float t1y = ( Float::Load( node.MaxY ) - originY ) * inverseY;
+        Float t0z = ( Float::Load( node.MinZ ) - originZ ) * inverseZ;
+        Float t1z = ( Float::Load( node.MaxZ ) - originZ ) * inverseZ;
+
+        Float tEntry = max( max( min( t0x, t1x ), min( t0y, t1y ) ), max( min( t0z, t1z ), zero ) );
+        Float tExit = min( min( max( t0x, t1x ), max( t0y, t1y ) ), min( max( t0z, t1z ), Float( tMax ) ) );
+
+        int hits = ( tEntry <= tExit ).Bits() & ( ( 1 << node.ChildCount ) - 1 );
+        if( hits == 0 ) continue;
+
+        float entries[ N ];
+        tEntry.Store( entries );
+
+        // Sort the hit children farthest first, so the nearest is on top of the stack
+        int order[ N ];
+        int hitCount = 0;
+        for( int i = 0; i < N; ++i )
+        {
+            if( !( hits & ( 1 << i ) ) ) continue;
+
+            int j = hitCount++;
+            for( ; j > 0 && entries[ order[ j - 1 ] ] < entries[ i ]; --j )
+            {
+                order[ j ] = order[ j - 1 ];
+            }
+            order[ j ] = i;
+        }
+
+        for( int i = 0; i < hitCount; ++i )
+        {
+            int child = order[ i ];
+            stack[ stackPointer++ ] = { node.Offset[ child ], node.Count[ child ], entries[ child ] };
+        }
+    }
+}
+
+#endif // WIDEBVH_H
@@ -5,34 +5,102 @@
 #include <vector>
 
 #include "Primitive.h"
+#include "PrimitiveStore.h"
+#include "Bounds.h"
+#include "UnboundedList.h"
 
+// Compact kD tree node, stored depth first so a branch's left child directly follows it
 struct kdNode
 {
-    glm::vec4 Value;
-    kdNode* LeftChild;
-    kdNode* RightChild;
+    // Branch: split position. Leaf: index of its list in the leaf objects vector
+    union
+    {
+        float Split;
+        int LeafObjects;
+    };
+
+    // Low 2 bits: split axis, or 3 for a leaf.
+    // Remaining bits: index of the right child, or the leaf's reference count
+    unsigned int Flags;
+
+    bool IsLeaf() const { return ( Flags & 3u ) == 3u; }
+    int Axis() const { return int( Flags & 3u ); }
+    int RightChild() const { return int( Flags >> 2 ); }
+    int ReferenceCount() const { return int( Flags >> 2 ); }
+
+    void InitBranch( int axis, float split ) { Split = split; Flags = unsigned( axis ); }
+    void SetRightChild( int index ) { Flags = ( Flags & 3u ) | ( unsigned( index ) << 2 ); }
+    void InitLeaf( int leafObjects, int count ) { LeafObjects = leafObjects; Flags = 3u | ( unsigned( count ) << 2 ); }
+};
+
+static_assert( sizeof( kdNode ) == 8, "kdNode should pack into 8 bytes" );
+
+// Deepest tree the builder produces, also the GPU traversal stack size
+const int KD_MAX_DEPTH = 32;
+
+// Split planes are snapped to this many steps across the tree bounds per axis,
+// so the GPU layout can carry them as integers that convert to float exactly
+const int KD_SPLIT_STEPS = 1 << 24;
+
+struct kdTreeStats
+{
+    int Nodes = 0;
+    int Leaves = 0;
+    int EmptyLeaves = 0;
+    int MaxDepth = 0;
+    int LeafReferences = 0;
+    float SAHCost = 0.0f; // Expected cost of a random ray through the root, in KD_INTERSECT_COST units
 };
 
+// kD tree built with the surface area heuristic over binned split candidates.
+// Nodes and build scratch live in flat arrays that keep their capacity between builds,
+// so per frame rebuilds stop allocating once the arrays have grown to the scene.
+// Unbounded primitives are kept out of the tree, in GetUnbounded().
+// GPU node layout ( ivec2 per node, same order and flags as kdNode ):
+//   Branch: split step ( position = min + step * GetSplitQuantum() ), flags
+//   Leaf:   index of the leaf's -1 terminated list in the leaf objects vector, flags
 class kdTree
 {
 public:
-    kdTree( std::vector< Primitive* > primitives );
-    ~kdTree();
+    kdTree( const PrimitiveStore& primitives );
 
-    std::vector< glm::vec4 > GetTreeVector() const { return m_treeVector; }
-    std::vector< int > GetLeafObjectsVector() const { return m_leafObjectsVector; }
+    const std::vector< kdNode >& GetNodes() const { return m_nodes; }
+    const std::vector< glm::ivec2 >& GetTreeVector() const { return m_treeVector; }
+    const std::vector< int >& GetLeafObjectsVector() const { return m_leafObjectsVector; }
+    const Bounds& GetBounds() const { return m_bounds; }
+    const glm::vec3& GetSplitQuantum() const { return m_splitQuantum; }
+    const kdTreeStats& GetStats() const { return m_stats; }
+    const UnboundedList& GetUnbounded() const { return m_unbounded; }
 
-    void BuildTree( std::vector<Primitive*> primitives );
-    kdNode* BuildNode( std::vector<Primitive*> primitives, int depth );
+    void BuildTree( const PrimitiveStore& primitives );
 
 private:
-    kdNode* m_rootNode;
-    std::vector< glm::vec4 > m_treeVector;
-    std::vector< int > m_leafObjectsVector;
+    // A primitive reference, with its bounds clipped to the node holding it
+    struct BuildRef
+    {
+        PrimitiveHandle Handle;
+        Bounds Box;
+    };
 
-    kdNode* constructBranchNode( std::vector<Primitive*> primitives, int axis, float splitPos, int depth );
-    kdNode* constructLeafNode( std::vector<Primitive*> primitives );
+    // Nodes work on the range [ first, last ) of m_refs, and push each child's range above it while building that child
+    int buildNode( const PrimitiveStore& primitives, int first, int last, const Bounds& nodeBounds, int depth );
+    bool findSplit( int first, int last, const Bounds& nodeBounds, int& axis, float& splitPos, float& cost ) const;
+    int constructBranchNode( const PrimitiveStore& primitives, int first, int last, const Bounds& nodeBounds, int axis, float splitPos, int depth );
+    int constructLeafNode( int first, int last, const Bounds& nodeBounds, int depth );
+    float snapSplit( int axis, float splitPos ) const;
     void constructTreeVector();
+
+    Bounds m_bounds;
+    glm::vec3 m_splitQuantum = glm::vec3( 0.0f );
+    int m_maxDepth = 0;
+    kdTreeStats m_stats;
+    UnboundedList m_unbounded;
+
+    std::vector< kdNode > m_nodes;
+    std::vector< BuildRef > m_refs;
+
+    std::vector< glm::ivec2 > m_treeVector;
+    std::vector< int > m_leafObjectsVector;
 };
 
 #endif // KDTREE_H
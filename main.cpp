@@ -1,10 +1,24 @@
 #include <ctime>
+#include <string>
 
 #include "WorldClock.h"
 #include "GLTracer.h"
+#include "CPUReference.h"
 
-int main()
+// Matches GLTracer's window resolution at its CPU reference downscale
+const int CPU_REFERENCE_WIDTH = 640;
+const int CPU_REFERENCE_HEIGHT = 360;
+
+int main( int argc, char** argv )
 {
+    // --cpu-reference [structure] [path] renders a single frame on the CPU, without a window or GL context
+    if( argc > 1 && std::string( argv[ 1 ] ) == "--cpu-reference" )
+    {
+        std::string structure = argc > 2 ? argv[ 2 ] : "grid";
+        std::string path = argc > 3 ? argv[ 3 ] : "cpu_reference.ppm";
+        return CPUReference::Render( structure, path, CPU_REFERENCE_WIDTH, CPU_REFERENCE_HEIGHT ) ? 0 : 1;
+    }
+
     GLTracer glTracer;
 
     while( true )
@@ -3,6 +3,11 @@
 //const bool DISABLE_SHADOWS = false;
 //const bool DISABLE_LIGHTING = false;
 //const bool DRAW_DEPTH_BUFFER = false;
+//const int ACCELL_STRUCTURE = 1;
+//const int KD_STACK_SIZE = 32;
+//const int BVH_STACK_SIZE = 32;
+//const int MAILBOX_SIZE = 8;
+//const int OCTREE_STACK_SIZE = 13;
 
 // Useful Values
 const float PI = 3.14159265359;
@@ -25,6 +30,18 @@ const int OBJECT_TYPE_DISC = 2;
 const int OBJECT_TYPE_AABB = 3;
 const int OBJECT_TYPE_CONVEXPOLY = 4;
 
+// Acceleration Structure Enumerators
+const int ACC_NONE = 0;
+const int ACC_GRID = 1;
+const int ACC_OCTREE = 2;
+const int ACC_KDTREE = 3;
+const int ACC_BVH = 4;
+const int ACC_TWO_LEVEL_GRID = 5;
+const int ACC_HASHED_GRID = 6;
+
+// kD tree node flags, low 2 bits hold the split axis
+const int KD_LEAF = 3;
+
 // Material Type Enumerators
 const int MATERIAL_TYPE_NONE = -1;
 const int MATERIAL_TYPE_COLOR = 0;
@@ -46,15 +63,48 @@ uniform vec3 SkyLightDirection;
 
 uniform int ObjectCount;
 uniform int ObjectInfoSize;
+uniform int UnboundedCount;
 
-uniform int GridSubdivisions;
+uniform ivec3 GridSubdivisions;
 uniform vec3 GridMinBound;
 uniform vec3 GridMaxBound;
 uniform vec3 GridCellSize;
 
+uniform vec3 KDTreeMinBound;
+uniform vec3 KDTreeMaxBound;
+uniform vec3 KDTreeSplitQuantum;
+
+uniform vec3 BVHMinBound;
+uniform vec3 BVHMaxBound;
+
+uniform ivec3 TwoLevelGridResolution;
+uniform vec3 TwoLevelGridMinBound;
+uniform vec3 TwoLevelGridMaxBound;
+uniform vec3 TwoLevelGridCellSize;
+
+uniform float HashedGridCellSize;
+uniform int HashedGridTableMask;
+uniform ivec3 HashedGridMinCell;
+uniform ivec3 HashedGridResolution;
+uniform vec3 HashedGridMinBound;
+uniform vec3 HashedGridMaxBound;
+
+uniform vec3 OctreeMinBound;
+uniform vec3 OctreeMaxBound;
+
 uniform samplerBuffer PrimitiveSampler;
-uniform samplerBuffer AccellStructureSampler;
-uniform samplerBuffer ObjectRefSampler;
+uniform isamplerBuffer AccellStructureSampler;
+uniform isamplerBuffer ObjectRefSampler;
+uniform usamplerBuffer GridOccupancySampler;
+uniform isamplerBuffer KDTreeSampler;
+uniform isamplerBuffer KDTreeObjectRefSampler;
+uniform isamplerBuffer BVHSampler;
+uniform isamplerBuffer BVHObjectRefSampler;
+uniform isamplerBuffer TwoLevelGridSampler;
+uniform isamplerBuffer TwoLevelGridObjectRefSampler;
+uniform isamplerBuffer HashedGridSampler;
+uniform isamplerBuffer HashedGridObjectRefSampler;
+uniform isamplerBuffer UnboundedSampler;
 
 in vec2 ScreenCoord;
 out vec4 color;
@@ -824,154 +874,902 @@ bool checkRecast(
     return recast;
 }
 
-// Casts a ray, checks for any collisions and reiterates to the specified level
-void castRay(
+// Tests a primitive, storing the intersection in rayData if it's nearer than the current nearest
+bool isectNearest(
     in Ray ray,
-    in int iterations,
-    out RayData rayData
+    in int primitiveIndex,
+    in float maxLength,
+    inout float nearest,
+    inout RayData rayData
     )
 {
-    rayData = constructRayData();
-    rayData.Origin = ray.Origin;
+    // Prepare primitive to be tested, local-space ray and intersection data
+    Primitive primitive = extractPrimitive( ( primitiveIndex * ObjectInfoSize ) );
+    Ray lRay = localRay( ray, primitive );
+    lRay.Length = maxLength;
+    IsectData isectData = constructIsectData();
+
+    // Test for intersection
+    if( isectPrimitive( lRay, primitive, isectData ) == 1.0 )
+    {
+        isectData = worldIsectData( isectData, primitive );
 
-    int[ MAX_VIEW_ITERATIONS ] hitIDs;
-    ObjectMaterial[ MAX_VIEW_ITERATIONS ] hitMaterials;
+        // Calculate distance
+        vec3 diff = isectData.Position - ray.Origin;
+        float dist2 = dot( diff, diff );
 
-    for( int i = 0; i < MAX_VIEW_ITERATIONS; ++i )
-    {
-        hitIDs[ i ] = -1;
-        hitMaterials[ i ] = constructObjectMaterial();
+        // If closer than current nearest, update the output data
+        if( dist2 < nearest )
+        {
+            nearest = dist2;
+            primitiveIntersection( primitive, isectData, rayData );
+            return true;
+        }
     }
 
-    // Outer loop - Ray iterations (Recasts - Reflection, Refraction, Portals, Spacewarp)
-    for( int o = 0; o < iterations; ++o )
+    return false;
+}
+
+// Walks the kD tree front to back with a stack of deferred far children,
+// stopping once the nearest hit lies before the next node's ray segment
+bool traverseKDTree(
+    in Ray ray,
+    inout float nearest,
+    inout RayData rayData
+    )
+{
+    // Clip the ray to the tree bounds
+    vec3 t0 = ( KDTreeMinBound - ray.Origin ) * ray.InverseDirection;
+    vec3 t1 = ( KDTreeMaxBound - ray.Origin ) * ray.InverseDirection;
+    vec3 tNear = min( t0, t1 );
+    vec3 tFar = max( t0, t1 );
+    float tMin = max( max( tNear.x, tNear.y ), max( tNear.z, 0.0 ) );
+    float tMax = min( min( tFar.x, tFar.y ), tFar.z );
+
+    int stackNode[ KD_STACK_SIZE ];
+    float stackTMin[ KD_STACK_SIZE ];
+    float stackTMax[ KD_STACK_SIZE ];
+    int stackPointer = 0;
+
+    bool hit = false;
+    int index = 0;
+
+    while( tMin <= tMax )
     {
-        float nearest = FAR_PLANE * FAR_PLANE; // Using dist^2 to avoid sqrt
+        // Everything left is further away than the nearest hit
+        if( tMin * tMin > nearest ) break;
+
+        ivec2 node = texelFetch( KDTreeSampler, index ).xy;
+        int axis = node.y & 3;
 
-        // Grid Traversal Initialization
-        IsectData gridIsectData = constructIsectData();
-        // Test grid bounds to see if ray intersects, return if not
-        if( isectAABBWorld( ray, GridMinBound, GridMaxBound, gridIsectData ) == 0.0 )
+        // Branch: descend into the near child, deferring the far one if the ray crosses the split
+        if( axis != KD_LEAF )
         {
-            return;
+            float split = KDTreeMinBound[ axis ] + float( node.x ) * KDTreeSplitQuantum[ axis ];
+            float tSplit = ( split - ray.Origin[ axis ] ) * ray.InverseDirection[ axis ];
+            bool belowFirst = ray.Origin[ axis ] < split || ( ray.Origin[ axis ] == split && ray.Direction[ axis ] <= 0.0 );
+            int nearChild = belowFirst ? index + 1 : node.y >> 2;
+            int farChild = belowFirst ? node.y >> 2 : index + 1;
+
+            if( tSplit > tMax || tSplit <= 0.0 )
+            {
+                index = nearChild;
+            }
+            else if( tSplit < tMin )
+            {
+                index = farChild;
+            }
+            else
+            {
+                stackNode[ stackPointer ] = farChild;
+                stackTMin[ stackPointer ] = tSplit;
+                stackTMax[ stackPointer ] = tMax;
+                stackPointer++;
+
+                index = nearChild;
+                tMax = tSplit;
+            }
+            continue;
         }
-        else
+
+        // Leaf: test its objects
+        int refCount = node.y >> 2;
+        for( int i = 0; i < refCount; ++i )
         {
-            // If the ray isn't inside the scene, advance to boundary
-            if( aabbContains( ray.Origin, GridMinBound, GridMaxBound ) == 0.0 )
+            int primitiveIndex = texelFetch( KDTreeObjectRefSampler, node.x + i ).x;
+            if( isectNearest( ray, primitiveIndex, FAR_PLANE, nearest, rayData ) )
             {
-                ray.Origin = gridIsectData.Position;
+                hit = true;
             }
         }
 
-        vec3 step;
-        step = sign( ray.Direction );
+        // Stop traversing on first hit in low accuracy mode
+        if( LOW_ACCURACY_MODE && hit ) break;
+
+        if( stackPointer == 0 ) break;
+
+        stackPointer--;
+        index = stackNode[ stackPointer ];
+        tMin = stackTMin[ stackPointer ];
+        tMax = stackTMax[ stackPointer ];
+    }
+
+    return hit;
+}
+
+// Slab test against decoded BVH bounds, tEntry is where the ray enters them
+bool isectBVHBounds( in Ray ray, in vec3 boundsMin, in vec3 boundsMax, in float tMax, out float tEntry )
+{
+    vec3 t0 = ( boundsMin - ray.Origin ) * ray.InverseDirection;
+    vec3 t1 = ( boundsMax - ray.Origin ) * ray.InverseDirection;
+    vec3 tNear = min( t0, t1 );
+    vec3 tFar = max( t0, t1 );
+
+    tEntry = max( max( tNear.x, tNear.y ), max( tNear.z, 0.0 ) );
+    float tExit = min( min( tFar.x, tFar.y ), min( tFar.z, tMax ) );
+
+    return tEntry <= tExit;
+}
+
+// Byte i of a compressed node's quantised planes
+uint bvhPlane( in uvec3 planes, in int i )
+{
+    return ( planes[ i / 4 ] >> uint( ( i % 4 ) * 8 ) ) & 0xFFu;
+}
+
+// Decodes a compressed node's child ( 0 or 1 ) bounds within the node's own, matching CompressedBVH::DecodeChild
+void decodeBVHChild(
+    in uvec3 planes,
+    in int child,
+    in vec3 parentMin,
+    in vec3 parentMax,
+    out vec3 childMin,
+    out vec3 childMax
+    )
+{
+    int first = child * 6;
+    vec3 step = ( parentMax - parentMin ) * ( 1.0 / 255.0 );
+    vec3 low = vec3( bvhPlane( planes, first ), bvhPlane( planes, first + 1 ), bvhPlane( planes, first + 2 ) );
+    vec3 high = vec3( 255u - bvhPlane( planes, first + 3 ), 255u - bvhPlane( planes, first + 4 ), 255u - bvhPlane( planes, first + 5 ) );
+
+    childMin = parentMin + low * step;
+    childMax = parentMax - high * step;
+}
+
+// Empty children are encoded with inverted planes, which would decode to their whole parent, so traversal skips them.
+// Any other child's min planes are at most its max planes
+bool bvhChildEmpty( in uvec3 planes, in int child )
+{
+    return bvhPlane( planes, child * 6 ) > bvhPlane( planes, child * 6 + 3 );
+}
+
+// Where a compressed node's children are, each a node index or -1 - the start of a leaf's references.
+// See CompressedBVHNode for the Link encoding
+void bvhChildLinks( in int index, in int link, out int first, out int second )
+{
+    if( link >= 0 )
+    {
+        first = index + 1;
+        second = link;
+        return;
+    }
+
+    int packed = -1 - link;
+    int start = packed / 2;
+    if( packed % 2 == 1 )
+    {
+        // Both leaves, the second list follows the first's terminator
+        int end = start;
+        while( texelFetch( BVHObjectRefSampler, end ).x != -1 ) end++;
+
+        first = -1 - start;
+        second = -1 - ( end + 1 );
+    }
+    else
+    {
+        first = index + 1;
+        second = -1 - start;
+    }
+}
+
+// Walks the compressed BVH nearest child first with a stack of deferred children and their decoded bounds,
+// skipping any whose bounds start beyond the nearest hit
+bool traverseBVH(
+    in Ray ray,
+    inout float nearest,
+    inout RayData rayData
+    )
+{
+    int stackChild[ BVH_STACK_SIZE ];
+    vec3 stackMin[ BVH_STACK_SIZE ];
+    vec3 stackMax[ BVH_STACK_SIZE ];
+    float stackEntry[ BVH_STACK_SIZE ];
+    int stackPointer = 0;
+
+    bool hit = false;
+    float tMax = sqrt( nearest );
+    float tEntry = 0.0;
 
-        // Determine which cell the ray originated in
-        vec3 localPos = ray.Origin - GridMinBound;
-        ivec3 cell = ivec3( localPos / GridCellSize );
+    if( !isectBVHBounds( ray, BVHMinBound, BVHMaxBound, tMax, tEntry ) ) return false;
 
-        // Determine the shortest axis to a cell boundary
-        vec3 cellP0 = GridMinBound + ( vec3( cell ) * GridCellSize );
-        vec3 cellP1 = cellP0 + GridCellSize;
+    // A node index, or -1 - the start of a leaf's references
+    int current = 0;
+    vec3 boundsMin = BVHMinBound;
+    vec3 boundsMax = BVHMaxBound;
+
+    while( true )
+    {
+        if( current < 0 )
+        {
+            // Leaf: test its objects
+            for( int i = -1 - current; ; ++i )
+            {
+                int primitiveIndex = texelFetch( BVHObjectRefSampler, i ).x;
+                if( primitiveIndex == -1 ) break;
 
-        vec3 tMax = vec3( FAR_PLANE );
-        IsectData planeIsectData = constructIsectData();
+                if( isectNearest( ray, primitiveIndex, FAR_PLANE, nearest, rayData ) )
+                {
+                    hit = true;
+                    tMax = sqrt( nearest );
+                }
+            }
 
-        for( int axis = 0; axis < 3; ++axis )
+            // Stop traversing on first hit in low accuracy mode
+            if( LOW_ACCURACY_MODE && hit ) break;
+        }
+        else
         {
-            vec3 planePos = vec3( 0.0f );
-            planePos[ axis ] = mix( cellP0[ axis ], cellP1[ axis ], clamp( step[ axis ], 0.0, 1.0 ) );
+            // Branch: descend into the nearer child, deferring the other
+            ivec4 node = texelFetch( BVHSampler, current );
+            uvec3 planes = uvec3( node.xyz );
+
+            vec3 firstMin, firstMax, secondMin, secondMax;
+            decodeBVHChild( planes, 0, boundsMin, boundsMax, firstMin, firstMax );
+            decodeBVHChild( planes, 1, boundsMin, boundsMax, secondMin, secondMax );
+
+            float tFirst = 0.0;
+            float tSecond = 0.0;
+            bool first = !bvhChildEmpty( planes, 0 ) && isectBVHBounds( ray, firstMin, firstMax, tMax, tFirst );
+            bool second = !bvhChildEmpty( planes, 1 ) && isectBVHBounds( ray, secondMin, secondMax, tMax, tSecond );
+
+            if( first || second )
+            {
+                int firstChild = 0;
+                int secondChild = 0;
+                bvhChildLinks( current, node.w, firstChild, secondChild );
+
+                if( first && second )
+                {
+                    bool firstNearer = tFirst <= tSecond;
+                    stackChild[ stackPointer ] = firstNearer ? secondChild : firstChild;
+                    stackMin[ stackPointer ] = firstNearer ? secondMin : firstMin;
+                    stackMax[ stackPointer ] = firstNearer ? secondMax : firstMax;
+                    stackEntry[ stackPointer ] = firstNearer ? tSecond : tFirst;
+                    stackPointer++;
+
+                    first = firstNearer;
+                }
 
-            vec3 planeNormal = vec3( 0.0 );
-            planeNormal[ axis ] = -1.0;
+                current = first ? firstChild : secondChild;
+                boundsMin = first ? firstMin : secondMin;
+                boundsMax = first ? firstMax : secondMax;
+                continue;
+            }
+        }
 
-            if( isectPlaneWorld( ray, planePos, planeNormal, planeIsectData ) == 1.0 )
+        // Pop the next deferred child that still lies before the nearest hit
+        bool found = false;
+        while( stackPointer > 0 )
+        {
+            stackPointer--;
+            if( stackEntry[ stackPointer ] <= tMax )
             {
-                tMax[ axis ] = distance( ray.Origin, planeIsectData.Position );
+                found = true;
+                break;
             }
         }
+        if( !found ) break;
+
+        current = stackChild[ stackPointer ];
+        boundsMin = stackMin[ stackPointer ];
+        boundsMax = stackMax[ stackPointer ];
+    }
+
+    return hit;
+}
+
+// Sets up a 3D DDA over one grid level from where the ray is at tStart
+void setupGridWalk(
+    in Ray ray,
+    in vec3 gridMin,
+    in vec3 cellSize,
+    in ivec3 resolution,
+    in float tStart,
+    out ivec3 cell,
+    out ivec3 step,
+    out vec3 tNext,
+    out vec3 tDelta
+    )
+{
+    vec3 p = ray.Origin + ray.Direction * tStart;
+    cell = clamp( ivec3( floor( ( p - gridMin ) / cellSize ) ), ivec3( 0 ), resolution - 1 );
+    step = ivec3( sign( ray.Direction ) );
+    tNext = vec3( FAR_PLANE );
+    tDelta = vec3( FAR_PLANE );
+
+    for( int axis = 0; axis < 3; ++axis )
+    {
+        if( step[ axis ] == 0 ) continue;
+
+        float boundary = gridMin[ axis ] + float( cell[ axis ] + ( step[ axis ] > 0 ? 1 : 0 ) ) * cellSize[ axis ];
+        tNext[ axis ] = ( boundary - ray.Origin[ axis ] ) * ray.InverseDirection[ axis ];
+        tDelta[ axis ] = cellSize[ axis ] * abs( ray.InverseDirection[ axis ] );
+    }
+}
+
+// Steps into the next cell along the axis with the nearest boundary, returns false once that leaves the grid
+bool advanceGridWalk(
+    inout ivec3 cell,
+    in ivec3 step,
+    inout vec3 tNext,
+    in vec3 tDelta,
+    in ivec3 resolution,
+    out float tEntry
+    )
+{
+    int axis = tNext.x <= tNext.y && tNext.x <= tNext.z ? 0 : ( tNext.y <= tNext.z ? 1 : 2 );
+
+    tEntry = tNext[ axis ];
+    cell[ axis ] += step[ axis ];
+    tNext[ axis ] += tDelta[ axis ];
+
+    return cell[ axis ] >= 0 && cell[ axis ] < resolution[ axis ];
+}
+
+// Forgets every primitive in a ray's mailbox
+void clearMailbox(
+    out int mailbox[ MAILBOX_SIZE ],
+    out int mailboxNext
+    )
+{
+    for( int i = 0; i < MAILBOX_SIZE; ++i )
+    {
+        mailbox[ i ] = -1;
+    }
+    mailboxNext = 0;
+}
 
-        vec3 tDelta = GridCellSize * vec3( step ) * ( 1.0f / ray.Direction );
-        float minTMax = min( tMax.x, min( tMax.y, tMax.z ) );
+// Returns false if the ray tested the primitive recently, in an earlier cell it spans, otherwise records it.
+// A small ring, older entries are overwritten, which at worst costs a repeated test. Mirrors Mailbox::Admit
+bool admitMailbox(
+    inout int mailbox[ MAILBOX_SIZE ],
+    inout int mailboxNext,
+    in int primitiveIndex
+    )
+{
+    for( int i = 0; i < MAILBOX_SIZE; ++i )
+    {
+        if( mailbox[ i ] == primitiveIndex ) return false;
+    }
+
+    mailbox[ mailboxNext ] = primitiveIndex;
+    mailboxNext = ( mailboxNext + 1 ) % MAILBOX_SIZE;
+    return true;
+}
+
+// Tests the primitives kept out of the acceleration structures ( planes ), once per ray before traversal
+bool traverseUnbounded(
+    in Ray ray,
+    inout float nearest,
+    inout RayData rayData
+    )
+{
+    bool hit = false;
 
-        // Grid Traversal Incrementation
-        while( cell.x >= 0 && cell.x <= GridSubdivisions &&
-               cell.y >= 0 && cell.y <= GridSubdivisions &&
-               cell.z >= 0 && cell.z <= GridSubdivisions )
+    for( int i = 0; i < UnboundedCount; ++i )
+    {
+        int primitiveIndex = texelFetch( UnboundedSampler, i ).x;
+        if( isectNearest( ray, primitiveIndex, FAR_PLANE, nearest, rayData ) )
         {
-            int idx = cell.x + cell.y * GridSubdivisions + cell.z * GridSubdivisions * GridSubdivisions;
+            hit = true;
+        }
+    }
+
+    return hit;
+}
 
-            int objectRefCell = int( texelFetch( AccellStructureSampler, idx )[ 0 ] );
+// Walks the uniform grid's cells along the ray, skipping empty ones on their occupancy bit.
+// Each primitive is tested once for its nearest hit, the mailbox skipping it in later cells it spans,
+// and traversal ends at the first cell whose exit lies beyond the nearest hit
+bool traverseGrid(
+    in Ray ray,
+    inout float nearest,
+    inout RayData rayData
+    )
+{
+    // Clip the ray to the grid bounds
+    vec3 t0 = ( GridMinBound - ray.Origin ) * ray.InverseDirection;
+    vec3 t1 = ( GridMaxBound - ray.Origin ) * ray.InverseDirection;
+    vec3 tNear = min( t0, t1 );
+    vec3 tFar = max( t0, t1 );
+    float tEnter = max( max( tNear.x, tNear.y ), max( tNear.z, 0.0 ) );
+    float tExit = min( min( tFar.x, tFar.y ), tFar.z );
+    if( tEnter > tExit ) return false;
+
+    bool hit = false;
+
+    ivec3 cell;
+    ivec3 step;
+    vec3 tNext;
+    vec3 tDelta;
+    float tCellEntry = tEnter;
+    int mailbox[ MAILBOX_SIZE ];
+    int mailboxNext;
+    clearMailbox( mailbox, mailboxNext );
+    setupGridWalk( ray, GridMinBound, GridCellSize, GridSubdivisions, tEnter, cell, step, tNext, tDelta );
+
+    while( true )
+    {
+        int idx = cell.x + GridSubdivisions.x * ( cell.y + GridSubdivisions.y * cell.z );
+        float tCellExit = min( tNext.x, min( tNext.y, tNext.z ) );
 
-            // Iterate through cell objects ( if any ) and test
-            bool stop = false;
-            if( objectRefCell != -1 )
+        // One bit per cell, packed 32 to a texel, so empty cells cost no reads of the grid or object lists
+        uint occupancy = texelFetch( GridOccupancySampler, idx >> 5 ).x;
+        if( ( occupancy & ( 1u << uint( idx & 31 ) ) ) != 0u )
+        {
+            for( int i = texelFetch( AccellStructureSampler, idx ).x; ; ++i )
             {
-                int objectRefContents = int( texelFetch( ObjectRefSampler, objectRefCell )[ 0 ] );
+                // -1 indicates the end of a reference cell
+                int primitiveIndex = texelFetch( ObjectRefSampler, i ).x;
+                if( primitiveIndex == -1 ) break;
+                if( !admitMailbox( mailbox, mailboxNext, primitiveIndex ) ) continue;
 
-                while( true )
+                if( isectNearest( ray, primitiveIndex, FAR_PLANE, nearest, rayData ) )
                 {
-                    // -1 indicates the end of a reference cell
-                    if( objectRefContents == -1 ) break;
+                    hit = true;
+                }
+            }
+        }
+
+        // Stop traversing on first hit in low accuracy mode
+        if( LOW_ACCURACY_MODE && hit ) break;
+
+        // Nothing in a later cell can be nearer than a hit, or an unbounded primitive's hit, before this cell's exit
+        if( nearest <= tCellExit * tCellExit || tCellExit >= tExit ) break;
+        if( !advanceGridWalk( cell, step, tNext, tDelta, GridSubdivisions, tCellEntry ) ) break;
+    }
+
+    return hit;
+}
+
+// Walks the coarse top level cells along the ray, and through the sub grid of any crowded cell,
+// stopping once the nearest hit lies inside the cell being left
+bool traverseTwoLevelGrid(
+    in Ray ray,
+    inout float nearest,
+    inout RayData rayData
+    )
+{
+    // Clip the ray to the grid bounds
+    vec3 t0 = ( TwoLevelGridMinBound - ray.Origin ) * ray.InverseDirection;
+    vec3 t1 = ( TwoLevelGridMaxBound - ray.Origin ) * ray.InverseDirection;
+    vec3 tNear = min( t0, t1 );
+    vec3 tFar = max( t0, t1 );
+    float tEnter = max( max( tNear.x, tNear.y ), max( tNear.z, 0.0 ) );
+    float tExit = min( min( tFar.x, tFar.y ), tFar.z );
+    if( tEnter > tExit ) return false;
+
+    bool hit = false;
+    float tHit = sqrt( nearest );
+
+    ivec3 cell;
+    ivec3 step;
+    vec3 tNext;
+    vec3 tDelta;
+    float tCellEntry = tEnter;
+    int mailbox[ MAILBOX_SIZE ];
+    int mailboxNext;
+    clearMailbox( mailbox, mailboxNext );
+    setupGridWalk( ray, TwoLevelGridMinBound, TwoLevelGridCellSize, TwoLevelGridResolution, tEnter, cell, step, tNext, tDelta );
+
+    while( true )
+    {
+        // ( first reference, count ) for leaves, ( first child cell, -1 - packed resolution ) for sub grids
+        ivec2 topCell = texelFetch( TwoLevelGridSampler, cell.x + TwoLevelGridResolution.x * ( cell.y + TwoLevelGridResolution.y * cell.z ) ).xy;
+        float tCellExit = min( tNext.x, min( tNext.y, tNext.z ) );
+
+        if( topCell.y >= 0 )
+        {
+            for( int i = 0; i < topCell.y; ++i )
+            {
+                int primitiveIndex = texelFetch( TwoLevelGridObjectRefSampler, topCell.x + i ).x;
+                if( !admitMailbox( mailbox, mailboxNext, primitiveIndex ) ) continue;
 
-                    // Prepare primitive to be tested, local-space ray and intersection data
-                    Primitive primitive = extractPrimitive( ( objectRefContents * ObjectInfoSize ) );
-                    Ray lRay = localRay( ray, primitive );
-                    lRay.Length = minTMax;
-                    IsectData isectData = constructIsectData();
+                if( isectNearest( ray, primitiveIndex, FAR_PLANE, nearest, rayData ) )
+                {
+                    hit = true;
+                    tHit = sqrt( nearest );
+                }
+            }
+        }
+        else
+        {
+            // Walk the cell's sub grid over the ray's span inside it
+            int packed = -1 - topCell.y;
+            ivec3 subResolution = ivec3( packed & 255, ( packed >> 8 ) & 255, packed >> 16 );
+            vec3 subCellSize = TwoLevelGridCellSize / vec3( subResolution );
+            vec3 subMin = TwoLevelGridMinBound + vec3( cell ) * TwoLevelGridCellSize;
+
+            ivec3 subCell;
+            ivec3 subStep;
+            vec3 subTNext;
+            vec3 subTDelta;
+            float tSubEntry = tCellEntry;
+            setupGridWalk( ray, subMin, subCellSize, subResolution, tCellEntry, subCell, subStep, subTNext, subTDelta );
+
+            while( true )
+            {
+                ivec2 leaf = texelFetch( TwoLevelGridSampler, topCell.x + subCell.x + subResolution.x * ( subCell.y + subResolution.y * subCell.z ) ).xy;
+                for( int i = 0; i < leaf.y; ++i )
+                {
+                    int primitiveIndex = texelFetch( TwoLevelGridObjectRefSampler, leaf.x + i ).x;
+                    if( !admitMailbox( mailbox, mailboxNext, primitiveIndex ) ) continue;
 
-                    // Test for intersection
-                    if( isectPrimitive( lRay, primitive, isectData ) == 1.0 )
+                    if( isectNearest( ray, primitiveIndex, FAR_PLANE, nearest, rayData ) )
                     {
-                        isectData = worldIsectData( isectData, primitive );
-
-                        // Calculate distance
-                        vec3 diff = isectData.Position - ray.Origin;
-                        float dist2 = dot( diff, diff );
-
-                        // If closer than current nearest, update the output data
-                        if( dist2 < nearest )
-                        {
-                            nearest = dist2;
-                            primitiveIntersection( primitive, isectData, rayData );
-                            hitIDs[o] = rayData.HitID;
-                            hitMaterials[o] = rayData.HitMaterial;
-                            if( LOW_ACCURACY_MODE )
-                            {
-                                stop = true;
-                            }
-                        }
+                        hit = true;
+                        tHit = sqrt( nearest );
                     }
+                }
+
+                if( LOW_ACCURACY_MODE && hit ) break;
+
+                // Nothing in a later cell can be nearer than a hit inside this one
+                if( tHit <= min( subTNext.x, min( subTNext.y, subTNext.z ) ) ) break;
+                if( !advanceGridWalk( subCell, subStep, subTNext, subTDelta, subResolution, tSubEntry ) || tSubEntry > tCellExit ) break;
+            }
+        }
+
+        // Stop traversing on first hit in low accuracy mode
+        if( LOW_ACCURACY_MODE && hit ) break;
+
+        if( tHit <= tCellExit || tCellExit >= tExit ) break;
+        if( !advanceGridWalk( cell, step, tNext, tDelta, TwoLevelGridResolution, tCellEntry ) ) break;
+    }
+
+    return hit;
+}
+
+// Spatial hash of a cell's integer coordinates, matching HashedGrid::Hash
+uint hashCell( in ivec3 cell )
+{
+    return ( uint( cell.x ) * 73856093u ) ^ ( uint( cell.y ) * 19349663u ) ^ ( uint( cell.z ) * 83492791u );
+}
+
+// Probes the hashed grid's table for a cell, returning its first reference or -1 if it's empty
+int findHashedCell( in ivec3 cell )
+{
+    uint mask = uint( HashedGridTableMask );
+
+    for( uint slot = hashCell( cell ) & mask; ; slot = ( slot + 1u ) & mask )
+    {
+        // ( cell x, y, z, first reference ), first reference is -1 for empty slots
+        ivec4 entry = texelFetch( HashedGridSampler, int( slot ) );
+        if( entry.w == -1 ) return -1;
+        if( entry.xyz == cell ) return entry.w;
+    }
+
+    return -1;
+}
 
-                    objectRefCell++;
-                    objectRefContents = int( texelFetch( ObjectRefSampler, objectRefCell )[ 0 ] );
+// Walks the extent of the hashed grid's occupied cells along the ray, looking up each cell as it's entered,
+// stopping once the nearest hit lies inside the cell being left
+bool traverseHashedGrid(
+    in Ray ray,
+    inout float nearest,
+    inout RayData rayData
+    )
+{
+    if( HashedGridResolution.x == 0 ) return false;
+
+    // Clip the ray to the occupied cells
+    vec3 t0 = ( HashedGridMinBound - ray.Origin ) * ray.InverseDirection;
+    vec3 t1 = ( HashedGridMaxBound - ray.Origin ) * ray.InverseDirection;
+    vec3 tNear = min( t0, t1 );
+    vec3 tFar = max( t0, t1 );
+    float tEnter = max( max( tNear.x, tNear.y ), max( tNear.z, 0.0 ) );
+    float tExit = min( min( tFar.x, tFar.y ), tFar.z );
+    if( tEnter > tExit ) return false;
+
+    bool hit = false;
+    float tHit = sqrt( nearest );
+
+    ivec3 cell;
+    ivec3 step;
+    vec3 tNext;
+    vec3 tDelta;
+    float tCellEntry = tEnter;
+    int mailbox[ MAILBOX_SIZE ];
+    int mailboxNext;
+    clearMailbox( mailbox, mailboxNext );
+    setupGridWalk( ray, HashedGridMinBound, vec3( HashedGridCellSize ), HashedGridResolution, tEnter, cell, step, tNext, tDelta );
+
+    while( true )
+    {
+        int first = findHashedCell( HashedGridMinCell + cell );
+        if( first >= 0 )
+        {
+            for( int i = first; ; ++i )
+            {
+                int primitiveIndex = texelFetch( HashedGridObjectRefSampler, i ).x;
+                if( primitiveIndex == -1 ) break;
+                if( !admitMailbox( mailbox, mailboxNext, primitiveIndex ) ) continue;
+
+                if( isectNearest( ray, primitiveIndex, FAR_PLANE, nearest, rayData ) )
+                {
+                    hit = true;
+                    tHit = sqrt( nearest );
                 }
             }
+        }
 
-            // Stop traversing on first hit in low accuracy mode
-            if( LOW_ACCURACY_MODE )
+        // Stop traversing on first hit in low accuracy mode
+        if( LOW_ACCURACY_MODE && hit ) break;
+
+        float tCellExit = min( tNext.x, min( tNext.y, tNext.z ) );
+        if( tHit <= tCellExit || tCellExit >= tExit ) break;
+        if( !advanceGridWalk( cell, step, tNext, tDelta, HashedGridResolution, tCellEntry ) ) break;
+    }
+
+    return hit;
+}
+
+// Index of a branch's child in an octant its mask holds, matching Octree::ChildIndex
+int octreeChildIndex( in int mask, in int offset, in int octant )
+{
+    int rank = 0;
+    for( int i = 0; i < octant; ++i )
+    {
+        if( ( mask & ( 1 << i ) ) != 0 ) rank++;
+    }
+    return offset + rank;
+}
+
+// Octant of a branch the ray enters first: the upper half along each axis whose midplane it crosses before entering
+int octreeFirstOctant( in vec3 t0, in vec3 t1 )
+{
+    vec3 tMid = ( t0 + t1 ) * 0.5;
+    float tEnter = max( max( t0.x, t0.y ), t0.z );
+
+    int octant = 0;
+    if( tMid.x < tEnter ) octant |= 4;
+    if( tMid.y < tEnter ) octant |= 2;
+    if( tMid.z < tEnter ) octant |= 1;
+    return octant;
+}
+
+// Octant the ray moves on to from one it leaves at t1, across the plane it exits first, 8 if that leaves the parent
+int octreeNextOctant( in int octant, in vec3 t1 )
+{
+    int bit = 1;
+    if( t1.x <= t1.y && t1.x <= t1.z ) bit = 4;
+    else if( t1.y <= t1.z ) bit = 2;
+
+    return ( ( octant & bit ) != 0 ) ? 8 : ( octant | bit );
+}
+
+// Walks the octree with the parametric algorithm of Revelles et al., as Octree::Traverse. The ray is mirrored
+// about the root's center into positive directions, so children are always visited in order along it,
+// stopping once the nearest hit lies inside the leaf being left
+bool traverseOctree(
+    in Ray ray,
+    inout float nearest,
+    inout RayData rayData
+    )
+{
+    if( any( greaterThan( OctreeMinBound, OctreeMaxBound ) ) ) return false;
+
+    vec3 center = ( OctreeMinBound + OctreeMaxBound ) * 0.5;
+    vec3 origin = ray.Origin;
+    vec3 direction = ray.Direction;
+    int flip = 0;
+    for( int axis = 0; axis < 3; ++axis )
+    {
+        if( direction[ axis ] < 0.0 )
+        {
+            origin[ axis ] = 2.0 * center[ axis ] - origin[ axis ];
+            direction[ axis ] = -direction[ axis ];
+            flip |= 4 >> axis;
+        }
+    }
+    direction = max( direction, vec3( 1e-8 ) );
+
+    vec3 inverseDirection = vec3( 1.0 ) / direction;
+    vec3 t0 = ( OctreeMinBound - origin ) * inverseDirection;
+    vec3 t1 = ( OctreeMaxBound - origin ) * inverseDirection;
+
+    bool hit = false;
+    float tHit = sqrt( nearest );
+
+    float tEnter = max( max( t0.x, t0.y ), max( t0.z, 0.0 ) );
+    float tExit = min( min( t1.x, t1.y ), min( t1.z, tHit ) );
+    if( tEnter > tExit ) return false;
+
+    int mailbox[ MAILBOX_SIZE ];
+    int mailboxNext;
+    clearMailbox( mailbox, mailboxNext );
+
+    // A lone leaf root
+    ivec2 root = texelFetch( AccellStructureSampler, 0 ).xy;
+    if( root.x == 0 )
+    {
+        for( int i = root.y; ; ++i )
+        {
+            int primitiveIndex = texelFetch( ObjectRefSampler, i ).x;
+            if( primitiveIndex == -1 ) break;
+            if( !admitMailbox( mailbox, mailboxNext, primitiveIndex ) ) continue;
+
+            if( isectNearest( ray, primitiveIndex, FAR_PLANE, nearest, rayData ) )
+            {
+                hit = true;
+                if( LOW_ACCURACY_MODE ) break;
+            }
+        }
+        return hit;
+    }
+
+    // Branches being walked, the ray's span over each and the next octant to visit, 8 when done
+    int stackNode[ OCTREE_STACK_SIZE ];
+    int stackOctant[ OCTREE_STACK_SIZE ];
+    vec3 stackT0[ OCTREE_STACK_SIZE ];
+    vec3 stackT1[ OCTREE_STACK_SIZE ];
+    int stackPointer = 1;
+    stackNode[ 0 ] = 0;
+    stackOctant[ 0 ] = octreeFirstOctant( t0, t1 );
+    stackT0[ 0 ] = t0;
+    stackT1[ 0 ] = t1;
+
+    while( stackPointer > 0 )
+    {
+        int top = stackPointer - 1;
+        int octant = stackOctant[ top ];
+        if( octant > 7 )
+        {
+            stackPointer--;
+            continue;
+        }
+
+        // The octant spans the lower or upper half of its parent's span along each axis
+        vec3 upper = vec3( ( octant & 4 ) != 0, ( octant & 2 ) != 0, ( octant & 1 ) != 0 );
+        vec3 tMid = ( stackT0[ top ] + stackT1[ top ] ) * 0.5;
+        vec3 childT0 = mix( stackT0[ top ], tMid, upper );
+        vec3 childT1 = mix( tMid, stackT1[ top ], upper );
+        stackOctant[ top ] = octreeNextOctant( octant, childT1 );
+
+        float tChildExit = min( min( childT1.x, childT1.y ), childT1.z );
+        if( tChildExit < 0.0 ) continue;
+
+        // Octants come in order along the ray, nothing from here on can be nearer than the nearest hit
+        if( max( max( childT0.x, childT0.y ), childT0.z ) > tHit ) break;
+
+        ivec2 node = texelFetch( AccellStructureSampler, stackNode[ top ] ).xy;
+        int real = octant ^ flip;
+        if( ( node.x & ( 1 << real ) ) == 0 ) continue;
+
+        int childIndex = octreeChildIndex( node.x, node.y, real );
+        ivec2 child = texelFetch( AccellStructureSampler, childIndex ).xy;
+        if( child.x == 0 )
+        {
+            for( int i = child.y; ; ++i )
             {
-                if( stop ) break;
+                int primitiveIndex = texelFetch( ObjectRefSampler, i ).x;
+                if( primitiveIndex == -1 ) break;
+                if( !admitMailbox( mailbox, mailboxNext, primitiveIndex ) ) continue;
+
+                if( isectNearest( ray, primitiveIndex, FAR_PLANE, nearest, rayData ) )
+                {
+                    hit = true;
+                    tHit = sqrt( nearest );
+                }
             }
 
-            if( minTMax == tMax.x )
+            // Stop traversing on first hit in low accuracy mode
+            if( LOW_ACCURACY_MODE && hit ) break;
+
+            // Nothing in a later leaf can be nearer than a hit inside this one
+            if( tHit <= tChildExit ) break;
+        }
+        else
+        {
+            stackNode[ stackPointer ] = childIndex;
+            stackOctant[ stackPointer ] = octreeFirstOctant( childT0, childT1 );
+            stackT0[ stackPointer ] = childT0;
+            stackT1[ stackPointer ] = childT1;
+            stackPointer++;
+        }
+    }
+
+    return hit;
+}
+
+// Casts a ray, checks for any collisions and reiterates to the specified level
+void castRay(
+    in Ray ray,
+    in int iterations,
+    out RayData rayData
+    )
+{
+    rayData = constructRayData();
+    rayData.Origin = ray.Origin;
+
+    int[ MAX_VIEW_ITERATIONS ] hitIDs;
+    ObjectMaterial[ MAX_VIEW_ITERATIONS ] hitMaterials;
+
+    for( int i = 0; i < MAX_VIEW_ITERATIONS; ++i )
+    {
+        hitIDs[ i ] = -1;
+        hitMaterials[ i ] = constructObjectMaterial();
+    }
+
+    // Outer loop - Ray iterations (Recasts - Reflection, Refraction, Portals, Spacewarp)
+    for( int o = 0; o < iterations; ++o )
+    {
+        float nearest = FAR_PLANE * FAR_PLANE; // Using dist^2 to avoid sqrt
+
+        // Unbounded primitives are tested first, their nearest hit caps the traversal
+        if( traverseUnbounded( ray, nearest, rayData ) )
+        {
+            hitIDs[o] = rayData.HitID;
+            hitMaterials[o] = rayData.HitMaterial;
+        }
+
+        if( ACCELL_STRUCTURE == ACC_KDTREE )
+        {
+            if( traverseKDTree( ray, nearest, rayData ) )
             {
-                tMax.x = tMax.x + tDelta.x;
-                cell.x = cell.x + int( step.x );
+                hitIDs[o] = rayData.HitID;
+                hitMaterials[o] = rayData.HitMaterial;
             }
-            else if( minTMax == tMax.y )
+        }
+        else if( ACCELL_STRUCTURE == ACC_BVH )
+        {
+            if( traverseBVH( ray, nearest, rayData ) )
             {
-                tMax.y = tMax.y + tDelta.y;
-                cell.y = cell.y + int( step.y );
+                hitIDs[o] = rayData.HitID;
+                hitMaterials[o] = rayData.HitMaterial;
             }
-            else if( minTMax == tMax.z )
+        }
+        else if( ACCELL_STRUCTURE == ACC_TWO_LEVEL_GRID )
+        {
+            if( traverseTwoLevelGrid( ray, nearest, rayData ) )
             {
-                tMax.z = tMax.z + tDelta.z;
-                cell.z = cell.z + int( step.z );
+                hitIDs[o] = rayData.HitID;
+                hitMaterials[o] = rayData.HitMaterial;
+            }
+        }
+        else if( ACCELL_STRUCTURE == ACC_HASHED_GRID )
+        {
+            if( traverseHashedGrid( ray, nearest, rayData ) )
+            {
+                hitIDs[o] = rayData.HitID;
+                hitMaterials[o] = rayData.HitMaterial;
+            }
+        }
+        else if( ACCELL_STRUCTURE == ACC_OCTREE )
+        {
+            if( traverseOctree( ray, nearest, rayData ) )
+            {
+                hitIDs[o] = rayData.HitID;
+                hitMaterials[o] = rayData.HitMaterial;
+            }
+        }
+        else
+        {
+            if( traverseGrid( ray, nearest, rayData ) )
+            {
+                hitIDs[o] = rayData.HitID;
+                hitMaterials[o] = rayData.HitMaterial;
             }
-
-            minTMax = min( tMax.x, min( tMax.y, tMax.z ) );
         }
 
         if( !checkRecast( ray, rayData ) ) break;
@@ -0,0 +1,400 @@
+#include "Bounds.h"
+
+#include <algorithm>
+
+// Normals within this of a cardinal axis are treated as axis aligned
+const float AXIS_ALIGNED_EPSILON = 1e-5f;
+// Boxes are grown by this fraction of their extent for overlap tests, so surfaces lying on a face are kept
+const float OVERLAP_EPSILON = 1e-4f;
+// Shapes with a local to world determinant below this are degenerate, and overlap every box their bounds touch
+const float DEGENERATE_EPSILON = 1e-12f;
+// Polygons with more sides are overlap tested as the disc around them, keeping the clipped polygon on the stack
+const int OVERLAP_MAX_SIDES = 64;
+
+// Convex polygon in plane coordinates, clipping to each of a box's 6 planes adds at most one vertex
+struct ClipPolygon
+{
+    glm::vec2 Points[ OVERLAP_MAX_SIDES + 6 ];
+    int Count = 0;
+};
+
+float Bounds::SurfaceArea() const
+{
+    if( Empty() ) return 0.0f;
+
+    glm::vec3 e = Extent();
+    return 2.0f * ( e.x * e.y + e.y * e.z + e.z * e.x );
+}
+
+int Bounds::LongestAxis() const
+{
+    glm::vec3 e = Extent();
+    if( e.x >= e.y && e.x >= e.z ) return 0;
+    return e.y >= e.z ? 1 : 2;
+}
+
+bool IsBounded( Primitive::ObjectType type )
+{
+    return type != Primitive::Plane;
+}
+
+// Each shape is described in unit local space, the world half extent on axis i is then
+// sum_j | R_ij * s_j | * h_j for a box of local half extents h, and
+// r * length( R_i * s ) over the shape's axes for round shapes of radius r
+Bounds ComputePrimitiveBounds( Primitive::ObjectType type, const glm::vec3& position, const glm::quat& orientation, const glm::vec3& scale )
+{
+    glm::mat3 r = glm::mat3_cast( orientation );
+
+    // Local axes scaled into world space ( columns of R * S )
+    glm::vec3 ax = r[ 0 ] * scale.x;
+    glm::vec3 ay = r[ 1 ] * scale.y;
+    glm::vec3 az = r[ 2 ] * scale.z;
+
+    glm::vec3 half( 0.0f );
+
+    switch( type )
+    {
+        case Primitive::Plane:
+        {
+            // Infinite, except along the normal when that is axis aligned
+            glm::vec3 n = glm::normalize( r[ 1 ] );
+            Bounds bounds( glm::vec3( -FLT_MAX ), glm::vec3( FLT_MAX ) );
+            for( int i = 0; i < 3; ++i )
+            {
+                if( glm::abs( n[ i ] ) > 1.0f - AXIS_ALIGNED_EPSILON )
+                {
+                    bounds.Min[ i ] = position[ i ];
+                    bounds.Max[ i ] = position[ i ];
+                }
+            }
+            return bounds;
+        }
+        case Primitive::Sphere:
+        {
+            // Unit sphere
+            for( int i = 0; i < 3; ++i )
+            {
+                half[ i ] = glm::sqrt( ax[ i ] * ax[ i ] + ay[ i ] * ay[ i ] + az[ i ] * az[ i ] );
+            }
+            break;
+        }
+        case Primitive::Disc:
+        case Primitive::ConvexPoly:
+        {
+            // Flat in local XZ, discs have radius^2 0.5 and polygon vertices lie at radius 0.5
+            float radius = type == Primitive::Disc ? glm::sqrt( 0.5f ) : 0.5f;
+            for( int i = 0; i < 3; ++i )
+            {
+                half[ i ] = radius * glm::sqrt( ax[ i ] * ax[ i ] + az[ i ] * az[ i ] );
+            }
+            break;
+        }
+        case Primitive::AABB:
+        {
+            // Unit cube, [ -0.5, 0.5 ]
+            for( int i = 0; i < 3; ++i )
+            {
+                half[ i ] = 0.5f * ( glm::abs( ax[ i ] ) + glm::abs( ay[ i ] ) + glm::abs( az[ i ] ) );
+            }
+            break;
+        }
+        default:
+            return Bounds();
+    }
+
+    return Bounds( position - half, position + half );
+}
+
+Bounds ComputePrimitiveBounds( const PrimitiveStore& primitives, PrimitiveHandle handle )
+{
+    return ComputePrimitiveBounds( primitives.GetTypes()[ handle ],
+                                   primitives.GetPositions()[ handle ],
+                                   primitives.GetOrientations()[ handle ],
+                                   primitives.GetScales()[ handle ] );
+}
+
+// Solves the n x n system in the first n columns of m, n <= 3, for the right hand side in column 3,
+// leaving the solution there. Gaussian elimination with partial pivoting, false if singular
+static bool solveSystem( float m[ 3 ][ 4 ], int n )
+{
+    for( int col = 0; col < n; ++col )
+    {
+        int pivot = col;
+        for( int row = col + 1; row < n; ++row )
+        {
+            if( glm::abs( m[ row ][ col ] ) > glm::abs( m[ pivot ][ col ] ) ) pivot = row;
+        }
+        if( glm::abs( m[ pivot ][ col ] ) < DEGENERATE_EPSILON ) return false;
+
+        for( int k = 0; k < 4; ++k ) std::swap( m[ col ][ k ], m[ pivot ][ k ] );
+
+        for( int row = 0; row < n; ++row )
+        {
+            if( row == col ) continue;
+
+            float f = m[ row ][ col ] / m[ col ][ col ];
+            for( int k = col; k < 4; ++k ) m[ row ][ k ] -= f * m[ col ][ k ];
+        }
+    }
+
+    for( int row = 0; row < n; ++row ) m[ row ][ 3 ] /= m[ row ][ row ];
+    return true;
+}
+
+// Minimum over a box of the convex quadratic ( p - c )^T A ( p - c ).
+// The minimum lies inside some face of the box ( the box itself, a face, an edge or a corner ), where it is the
+// unconstrained minimum over that face's span, so each of the 27 faces' is solved for and those inside the box kept
+static float minQuadraticOverBox( const glm::mat3& a, const glm::vec3& c, const Bounds& box )
+{
+    float best = FLT_MAX;
+
+    for( int pattern = 0; pattern < 27; ++pattern )
+    {
+        // Per axis, 0 leaves it free, 1 and 2 fix it to the box's min or max
+        int fixes[ 3 ] = { pattern % 3, ( pattern / 3 ) % 3, pattern / 9 };
+        int freeAxes[ 3 ];
+        int freeCount = 0;
+        glm::vec3 d( 0.0f );
+
+        for( int axis = 0; axis < 3; ++axis )
+        {
+            if( fixes[ axis ] == 0 ) freeAxes[ freeCount++ ] = axis;
+            else d[ axis ] = ( fixes[ axis ] == 1 ? box.Min[ axis ] : box.Max[ axis ] ) - c[ axis ];
+        }
+
+        // Zero gradient along the free axes, A_FF d_F = -A_FX d_X
+        float m[ 3 ][ 4 ];
+        for( int row = 0; row < freeCount; ++row )
+        {
+            float rhs = 0.0f;
+            for( int axis = 0; axis < 3; ++axis )
+            {
+                if( fixes[ axis ] != 0 ) rhs -= a[ axis ][ freeAxes[ row ] ] * d[ axis ];
+            }
+
+            for( int col = 0; col < freeCount; ++col ) m[ row ][ col ] = a[ freeAxes[ col ] ][ freeAxes[ row ] ];
+            m[ row ][ 3 ] = rhs;
+        }
+        if( !solveSystem( m, freeCount ) ) continue;
+
+        bool inside = true;
+        for( int row = 0; row < freeCount; ++row )
+        {
+            int axis = freeAxes[ row ];
+            d[ axis ] = m[ row ][ 3 ];
+            inside = inside && c[ axis ] + d[ axis ] >= box.Min[ axis ] && c[ axis ] + d[ axis ] <= box.Max[ axis ];
+        }
+        if( !inside ) continue;
+
+        best = glm::min( best, glm::dot( d, a * d ) );
+    }
+
+    return best;
+}
+
+// Clips a convex polygon in the plane to the half plane dot( n, p ) <= limit ( Sutherland-Hodgman ), into clipped
+static void clipPolygon( const ClipPolygon& polygon, const glm::vec2& n, float limit, ClipPolygon& clipped )
+{
+    clipped.Count = 0;
+
+    for( int i = 0; i < polygon.Count; ++i )
+    {
+        const glm::vec2& p0 = polygon.Points[ i ];
+        const glm::vec2& p1 = polygon.Points[ ( i + 1 ) % polygon.Count ];
+        float d0 = glm::dot( n, p0 ) - limit;
+        float d1 = glm::dot( n, p1 ) - limit;
+
+        if( d0 <= 0.0f ) clipped.Points[ clipped.Count++ ] = p0;
+        if( ( d0 < 0.0f && d1 > 0.0f ) || ( d0 > 0.0f && d1 < 0.0f ) )
+        {
+            clipped.Points[ clipped.Count++ ] = p0 + ( p1 - p0 ) * ( d0 / ( d0 - d1 ) );
+        }
+    }
+}
+
+// Clips a polygon given in the coordinates ( u, v ) of the plane position + u * axisU + v * axisV to a box.
+// Clips alternate between polygon and a scratch polygon, an even number of them, so the result ends up in polygon
+static void clipPolygonToBox( ClipPolygon& polygon, const glm::vec3& position, const glm::vec3& axisU, const glm::vec3& axisV, const Bounds& box )
+{
+    ClipPolygon scratch;
+
+    for( int axis = 0; axis < 3 && polygon.Count > 0; ++axis )
+    {
+        glm::vec2 n( axisU[ axis ], axisV[ axis ] );
+        clipPolygon( polygon, n, box.Max[ axis ] - position[ axis ], scratch );
+        clipPolygon( scratch, -n, position[ axis ] - box.Min[ axis ], polygon );
+    }
+}
+
+// Distance from the origin to a convex polygon, 0 if it contains the origin
+static float polygonDistanceToOrigin( const ClipPolygon& polygon )
+{
+    float nearest = FLT_MAX;
+    bool anyPositive = false;
+    bool anyNegative = false;
+
+    for( int i = 0; i < polygon.Count; ++i )
+    {
+        glm::vec2 p0 = polygon.Points[ i ];
+        glm::vec2 edge = polygon.Points[ ( i + 1 ) % polygon.Count ] - p0;
+
+        // Side of the edge the origin lies on
+        float side = edge.x * -p0.y - edge.y * -p0.x;
+        anyPositive = anyPositive || side > 0.0f;
+        anyNegative = anyNegative || side < 0.0f;
+
+        float lengthSq = glm::dot( edge, edge );
+        float t = lengthSq > 0.0f ? glm::clamp( -glm::dot( p0, edge ) / lengthSq, 0.0f, 1.0f ) : 0.0f;
+        nearest = glm::min( nearest, glm::length( p0 + edge * t ) );
+    }
+
+    return anyPositive && anyNegative ? nearest : 0.0f;
+}
+
+// Each shape is tested in its own terms against the box, with M = R * S taking unit local space to world space.
+// Spheres: the surface |M^-1 ( p - c )| = 1 crosses the box iff the quadratic's minimum over it is <= 1 and its
+// maximum, at a corner, is >= 1. Boxes: separating axis test, minus boxes whose corners all lie inside.
+// Discs and polygons: the box is a convex region of their plane, clipped against the shape in plane coordinates
+bool PrimitiveOverlapsBox( Primitive::ObjectType type, const glm::vec3& position, const glm::quat& orientation, const glm::vec3& scale, float sides, const Bounds& box )
+{
+    if( box.Empty() ) return false;
+
+    glm::vec3 pad = box.Extent() * OVERLAP_EPSILON;
+    Bounds b( box.Min - pad, box.Max + pad );
+
+    glm::mat3 r = glm::mat3_cast( orientation );
+    glm::mat3 m( r[ 0 ] * scale.x, r[ 1 ] * scale.y, r[ 2 ] * scale.z );
+    bool degenerate = glm::abs( glm::determinant( m ) ) < DEGENERATE_EPSILON;
+
+    switch( type )
+    {
+        case Primitive::Sphere:
+        {
+            if( degenerate ) return true;
+
+            glm::mat3 a = glm::inverse( m * glm::transpose( m ) );
+
+            float farthest = 0.0f;
+            for( int corner = 0; corner < 8; ++corner )
+            {
+                glm::vec3 d = glm::vec3( corner & 1 ? b.Max.x : b.Min.x, corner & 2 ? b.Max.y : b.Min.y, corner & 4 ? b.Max.z : b.Min.z ) - position;
+                farthest = glm::max( farthest, glm::dot( d, a * d ) );
+            }
+
+            return farthest >= 1.0f && minQuadraticOverBox( a, position, b ) <= 1.0f;
+        }
+        case Primitive::AABB:
+        {
+            // Unit cube, [ -0.5, 0.5 ], with half extents along the columns of M
+            glm::vec3 half[ 3 ] = { m[ 0 ] * 0.5f, m[ 1 ] * 0.5f, m[ 2 ] * 0.5f };
+            glm::vec3 boxHalf = b.Extent() * 0.5f;
+            glm::vec3 offset = position - b.Center();
+
+            // The box's axes, the cube's, and the cross products of each pair
+            glm::vec3 axes[ 15 ];
+            for( int i = 0; i < 3; ++i )
+            {
+                axes[ i ] = glm::vec3( 0.0f );
+                axes[ i ][ i ] = 1.0f;
+                axes[ 3 + i ] = r[ i ];
+            }
+            for( int i = 0; i < 3; ++i )
+            {
+                for( int j = 0; j < 3; ++j )
+                {
+                    axes[ 6 + i * 3 + j ] = glm::cross( axes[ i ], r[ j ] );
+                }
+            }
+
+            for( int i = 0; i < 15; ++i )
+            {
+                const glm::vec3& l = axes[ i ];
+                if( glm::dot( l, l ) < DEGENERATE_EPSILON ) continue;
+
+                float radius = glm::dot( glm::abs( l ), boxHalf ) +
+                               glm::abs( glm::dot( l, half[ 0 ] ) ) + glm::abs( glm::dot( l, half[ 1 ] ) ) + glm::abs( glm::dot( l, half[ 2 ] ) );
+                if( glm::abs( glm::dot( l, offset ) ) > radius ) return false;
+            }
+
+            // Convex, so a box whose corners are all inside holds none of the surface
+            if( degenerate ) return true;
+
+            glm::mat3 toLocal = glm::inverse( m );
+            for( int corner = 0; corner < 8; ++corner )
+            {
+                glm::vec3 p = glm::vec3( corner & 1 ? b.Max.x : b.Min.x, corner & 2 ? b.Max.y : b.Min.y, corner & 4 ? b.Max.z : b.Min.z );
+                glm::vec3 local = glm::abs( toLocal * ( p - position ) );
+                if( local.x > 0.5f || local.y > 0.5f || local.z > 0.5f ) return true;
+            }
+            return false;
+        }
+        case Primitive::Disc:
+        case Primitive::ConvexPoly:
+        {
+            // Flat in local XZ, plane coordinates ( u, v ) along the scaled local X and Z axes
+            ClipPolygon polygon;
+            int sideCount = int( sides );
+            if( type == Primitive::ConvexPoly && sideCount < 3 ) return true;
+
+            if( type == Primitive::Disc || sideCount > OVERLAP_MAX_SIDES )
+            {
+                // Radius^2 0.5 for discs, polygons' vertices lie at radius 0.5.
+                // Clipped from its bounding square then checked for a point within the radius
+                float radius = type == Primitive::Disc ? glm::sqrt( 0.5f ) : 0.5f;
+                polygon.Points[ 0 ] = glm::vec2( -radius, -radius );
+                polygon.Points[ 1 ] = glm::vec2( radius, -radius );
+                polygon.Points[ 2 ] = glm::vec2( radius, radius );
+                polygon.Points[ 3 ] = glm::vec2( -radius, radius );
+                polygon.Count = 4;
+                clipPolygonToBox( polygon, position, m[ 0 ], m[ 2 ], b );
+                return polygon.Count > 0 && polygonDistanceToOrigin( polygon ) <= radius;
+            }
+
+            // Vertices at radius 0.5, the first a half step around Y from +Z, as in the intersection test
+            for( int i = 0; i < sideCount; ++i )
+            {
+                float angle = glm::pi< float >() * ( 2.0f * i + 1.0f ) / sides;
+                polygon.Points[ i ] = glm::vec2( glm::sin( angle ), glm::cos( angle ) ) * 0.5f;
+            }
+            polygon.Count = sideCount;
+            clipPolygonToBox( polygon, position, m[ 0 ], m[ 2 ], b );
+            return polygon.Count > 0;
+        }
+        default:
+            return false;
+    }
+}
+
+bool PrimitiveOverlapsBox( const PrimitiveStore& primitives, PrimitiveHandle handle, const Bounds& box )
+{
+    return PrimitiveOverlapsBox( primitives.GetTypes()[ handle ],
+                                 primitives.GetPositions()[ handle ],
+                                 primitives.GetOrientations()[ handle ],
+                                 primitives.GetScales()[ handle ],
+                                 primitives.GetSides()[ handle ],
+                                 box );
+}
+
+Bounds ComputeSceneBounds( const PrimitiveStore& primitives )
+{
+    Bounds scene;
+
+    for( int i = 0; i < primitives.Size(); ++i )
+    {
+        if( !IsBounded( primitives.GetTypes()[ i ] ) ) continue;
+
+        Bounds b = ComputePrimitiveBounds( primitives, i );
+        if( !b.Empty() ) scene.Extend( b );
+    }
+
+    for( int axis = 0; axis < 3; ++axis )
+    {
+        if( scene.Min[ axis ] > scene.Max[ axis ] )
+        {
+            scene.Min[ axis ] = -1.0f;
+            scene.Max[ axis ] = 1.0f;
+        }
+    }
+
+    return scene;
+}
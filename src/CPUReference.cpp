@@ -0,0 +1,67 @@
+#include "CPUReference.h"
+
+#include <iostream>
+
+#include "TestScene.h"
+#include "CPUTracer.h"
+#include "TileScheduler.h"
+
+// Matches the defaults in GLTracer and Camera's starting position
+const float FOV = 90.0f;
+const float AMBIENT_INTENSITY = 0.2f;
+const glm::vec3 CAMERA_POSITION = glm::vec3( 10.0f, 0.0f, 15.0f );
+
+bool CPUReference::Render( const std::string& structure, const std::string& path, int width, int height )
+{
+    // The scene only talks to the GL tracer through its primitive store, so none is needed
+    TestScene scene( 0 );
+    scene.UpdateTransforms();
+
+    const PrimitiveStore& store = scene.GetPrimitiveStore();
+    TileScheduler scheduler;
+    CPUTracer tracer( width, height, scheduler );
+
+    CPUTracerView view;
+    view.CameraPos = CAMERA_POSITION;
+    view.FOV = glm::radians( FOV );
+    view.AmbientIntensity = AMBIENT_INTENSITY;
+
+    if( structure == "grid" )
+    {
+        Grid grid( store, scheduler );
+        tracer.Render( scene.GetObjects(), store, &grid, view );
+    }
+    else if( structure == "bvh" )
+    {
+        BVH bvh( store, scheduler );
+        WideBVH< WIDE_BVH_WIDTH > wideBVH;
+        wideBVH.Collapse( bvh );
+        tracer.Render( scene.GetObjects(), store, &wideBVH, view );
+    }
+    else if( structure == "two-level-grid" )
+    {
+        TwoLevelGrid twoLevelGrid( store );
+        tracer.Render( scene.GetObjects(), store, &twoLevelGrid, view );
+    }
+    else if( structure == "hashed-grid" )
+    {
+        HashedGrid hashedGrid( store, GRID_DEFAULT_DENSITY );
+        tracer.Render( scene.GetObjects(), store, &hashedGrid, view );
+    }
+    else if( structure == "octree" )
+    {
+        Octree octree( store );
+        tracer.Render( scene.GetObjects(), store, &octree, view );
+    }
+    else
+    {
+        std::cerr << "Unknown CPU reference structure: " << structure << std::endl;
+        return false;
+    }
+
+    const CPUTracerStats& stats = tracer.GetStats();
+    std::cout << "CPU Reference: " << stats.RaysPerSecond / 1000000.0f << " MRays/s over " << stats.Threads << " threads";
+    std::cout << " | Efficiency: " << stats.Efficiency * 100.0f << "%" << std::endl;
+
+    return tracer.SaveImage( path );
+}
@@ -0,0 +1,498 @@
+#include "CPUTracer.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+#include "Collisions.h"
+
+// Mirrors the constants in Raytracer.frag
+const float SMALL_VALUE = 0.01f;
+const float RAY_NEAR_PLANE = 0.0f;
+const float RAY_FAR_PLANE = 1000.0f;
+const int MAX_VIEW_ITERATIONS = 8;
+const int MAX_SHADOW_ITERATIONS = 4;
+
+// Matches the framebuffer clear color in GLTracer::initGL, shown where the shader discards
+const glm::vec4 CLEAR_COLOR = glm::vec4( 1.0f, 0.0f, 0.0f, 1.0f );
+
+const int TILE_SIZE = 16;
+
+// Equivalent of constructObjectMaterial() in Raytracer.frag
+static ObjectMaterial emptyMaterial()
+{
+    ObjectMaterial material;
+    material.Color = glm::vec4( 0.0f );
+    material.Diffuse = 0.0f;
+    material.Specular = 0.0f;
+    material.SpecularFactor = 0.0f;
+    material.Emissive = 0.0f;
+    material.RefractiveIndex = 0.0f;
+    material.CastShadow = 0.0f;
+    return material;
+}
+
+// Creates a 4x4 rotation matrix from axis/angle, laid out as rotationMatrix() in Raytracer.frag
+static glm::mat4 rotationMatrix( const glm::vec3& axis, float angle )
+{
+    glm::vec3 nAxis = glm::normalize( axis );
+    float s = glm::sin( angle );
+    float c = glm::cos( angle );
+    float oc = 1.0f - c;
+
+    return glm::mat4( oc * nAxis.x * nAxis.x + c,           oc * nAxis.x * nAxis.y - nAxis.z * s, oc * nAxis.z * nAxis.x + nAxis.y * s, 0.0f,
+                      oc * nAxis.x * nAxis.y + nAxis.z * s, oc * nAxis.y * nAxis.y + c,           oc * nAxis.y * nAxis.z - nAxis.x * s, 0.0f,
+                      oc * nAxis.z * nAxis.x - nAxis.y * s, oc * nAxis.y * nAxis.z + nAxis.x * s, oc * nAxis.z * nAxis.z + c,           0.0f,
+                      0.0f,                                 0.0f,                                 0.0f,                                 1.0f );
+}
+
+CPUTracer::CPUTracer( int width, int height, TileScheduler& scheduler )
+    : m_scheduler( scheduler )
+{
+    Resize( width, height );
+}
+
+void CPUTracer::Resize( int width, int height )
+{
+    m_width = width;
+    m_height = height;
+    m_colorBuffer.assign( m_width * m_height, CLEAR_COLOR );
+    m_depthBuffer.assign( m_width * m_height, 1.0f );
+}
+
+// Renders a frame into the color and depth buffers,
+// letting the scheduler balance screen tiles across the worker threads
+void CPUTracer::Render( const std::vector< Primitive* >& primitives, const PrimitiveStore& store, const Grid* grid, const CPUTracerView& view )
+{
+    m_grid = grid;
+    m_bvh = 0;
+    m_twoLevelGrid = 0;
+    m_hashedGrid = 0;
+    m_octree = 0;
+
+    renderFrame( primitives, store, view );
+}
+
+// As above, traversing a BVH collapsed to SIMD wide nodes instead of the grid
+void CPUTracer::Render( const std::vector< Primitive* >& primitives, const PrimitiveStore& store, const WideBVH< WIDE_BVH_WIDTH >* bvh, const CPUTracerView& view )
+{
+    m_grid = 0;
+    m_bvh = bvh;
+    m_twoLevelGrid = 0;
+    m_hashedGrid = 0;
+    m_octree = 0;
+
+    renderFrame( primitives, store, view );
+}
+
+// As above, traversing a two level grid
+void CPUTracer::Render( const std::vector< Primitive* >& primitives, const PrimitiveStore& store, const TwoLevelGrid* twoLevelGrid, const CPUTracerView& view )
+{
+    m_grid = 0;
+    m_bvh = 0;
+    m_twoLevelGrid = twoLevelGrid;
+    m_hashedGrid = 0;
+    m_octree = 0;
+
+    renderFrame( primitives, store, view );
+}
+
+// As above, traversing a hashed grid
+void CPUTracer::Render( const std::vector< Primitive* >& primitives, const PrimitiveStore& store, const HashedGrid* hashedGrid, const CPUTracerView& view )
+{
+    m_grid = 0;
+    m_bvh = 0;
+    m_twoLevelGrid = 0;
+    m_hashedGrid = hashedGrid;
+    m_octree = 0;
+
+    renderFrame( primitives, store, view );
+}
+
+// As above, traversing a sparse octree
+void CPUTracer::Render( const std::vector< Primitive* >& primitives, const PrimitiveStore& store, const Octree* octree, const CPUTracerView& view )
+{
+    m_grid = 0;
+    m_bvh = 0;
+    m_twoLevelGrid = 0;
+    m_hashedGrid = 0;
+    m_octree = octree;
+
+    renderFrame( primitives, store, view );
+}
+
+void CPUTracer::renderFrame( const std::vector< Primitive* >& primitives, const PrimitiveStore& store, const CPUTracerView& view )
+{
+    m_primitives = &primitives;
+    m_transforms = store.GetTransforms();
+    m_view = view;
+
+    int tilesX = ( m_width + TILE_SIZE - 1 ) / TILE_SIZE;
+    int tilesY = ( m_height + TILE_SIZE - 1 ) / TILE_SIZE;
+    int threadCount = m_scheduler.GetThreadCount();
+
+    // One padded counter per thread to keep workers off each other's cache lines
+    const int COUNTER_STRIDE = 8;
+    std::vector< long long > rayCounts( threadCount * COUNTER_STRIDE, 0 );
+
+    m_scheduler.Run( tilesX * tilesY, m_tileCosts, [ this, &rayCounts, COUNTER_STRIDE ]( int tile, int thread )
+    {
+        renderTile( tile, rayCounts[ thread * COUNTER_STRIDE ] );
+    } );
+
+    m_stats.Threads = threadCount;
+    m_stats.Rays = 0;
+    float busySeconds = 0.0f;
+    for( int t = 0; t < threadCount; ++t )
+    {
+        m_stats.Rays += rayCounts[ t * COUNTER_STRIDE ];
+        busySeconds += m_scheduler.GetWorkerStats()[ t ].BusySeconds;
+    }
+    m_stats.Seconds = m_scheduler.GetRunSeconds();
+    m_stats.RaysPerSecond = m_stats.Seconds > 0.0f ? m_stats.Rays / m_stats.Seconds : 0.0f;
+    m_stats.Efficiency = m_stats.Seconds > 0.0f ? busySeconds / ( threadCount * m_stats.Seconds ) : 0.0f;
+}
+
+// Writes the color buffer out as a binary PPM, top row first
+bool CPUTracer::SaveImage( const std::string& path ) const
+{
+    std::ofstream file( path.c_str(), std::ios::binary );
+    if( !file )
+    {
+        std::cerr << "Could not open file: " << path << std::endl;
+        return false;
+    }
+
+    file << "P6\n" << m_width << " " << m_height << "\n255\n";
+
+    for( int y = m_height - 1; y >= 0; --y )
+    {
+        for( int x = 0; x < m_width; ++x )
+        {
+            glm::vec4 c = glm::clamp( m_colorBuffer[ x + y * m_width ], 0.0f, 1.0f );
+            char rgb[ 3 ] = { char( c.r * 255.0f ), char( c.g * 255.0f ), char( c.b * 255.0f ) };
+            file.write( rgb, 3 );
+        }
+    }
+
+    return true;
+}
+
+void CPUTracer::renderTile( int tile, long long& rayCount )
+{
+    int tilesX = ( m_width + TILE_SIZE - 1 ) / TILE_SIZE;
+    int x0 = ( tile % tilesX ) * TILE_SIZE;
+    int y0 = ( tile / tilesX ) * TILE_SIZE;
+    int x1 = std::min( x0 + TILE_SIZE, m_width );
+    int y1 = std::min( y0 + TILE_SIZE, m_height );
+
+    for( int y = y0; y < y1; ++y )
+    {
+        for( int x = x0; x < x1; ++x )
+        {
+            float depth = 1.0f;
+            m_colorBuffer[ x + y * m_width ] = renderPixel( x, y, depth, rayCount );
+            m_depthBuffer[ x + y * m_width ] = depth;
+        }
+    }
+}
+
+// Equivalent of main() in Raytracer.frag for the pixel at x, y ( origin bottom-left )
+glm::vec4 CPUTracer::renderPixel( int x, int y, float& depth, long long& rayCount ) const
+{
+    // Calculate ray direction from fragment position
+    glm::vec2 screenCoord( ( x + 0.5f ) / m_width, ( y + 0.5f ) / m_height );
+    glm::vec2 screenPos = screenCoord * 2.0f - 1.0f;
+    float ar = float( m_width ) / float( m_height );
+    screenPos.x *= ar;
+
+    float xMag = screenPos.x * glm::tan( m_view.FOV * 0.5f );
+    float yMag = screenPos.y * glm::tan( m_view.FOV * 0.5f );
+
+    glm::vec3 rayDirection = glm::normalize( glm::vec3( xMag, yMag, -1.0f ) );
+    rayDirection = glm::vec3( m_view.CameraRot * glm::vec4( rayDirection, 0.0f ) );
+
+    // Primary ray intersection
+    Ray primaryRay( m_view.CameraPos, rayDirection );
+    RayData primaryRayData;
+
+    checkWarp( primaryRay );
+    castRay( primaryRay, MAX_VIEW_ITERATIONS, primaryRayData, rayCount );
+
+    // No need to continue if there was no hit
+    if( primaryRayData.HitID == -1 )
+    {
+        depth = 1.0f;
+        return CLEAR_COLOR;
+    }
+
+    // Shadow ray intersection
+    glm::vec3 shadowRayDirection = glm::normalize( m_view.SkyLightDirection );
+    Ray secondaryRay( primaryRayData.Position + ( primaryRayData.Normal * SMALL_VALUE ), shadowRayDirection );
+    RayData shadowRayData;
+
+    if( !m_view.DisableShadows )
+    {
+        castRay( secondaryRay, MAX_SHADOW_ITERATIONS, shadowRayData, rayCount );
+    }
+
+    // Lighting calculations
+    float brightness = 1.0f;
+
+    if( !m_view.DisableLighting )
+    {
+        // Diffuse
+        float df = glm::max( 0.0f, glm::dot( primaryRayData.Normal, m_view.SkyLightDirection ) );
+        df *= primaryRayData.HitMaterial.Diffuse;
+
+        // Specular
+        glm::vec3 hitToEye = glm::normalize( primaryRayData.Position - primaryRayData.Origin );
+        glm::vec3 lightReflect = glm::reflect( m_view.SkyLightDirection, primaryRayData.Normal );
+        float sf = glm::clamp( glm::dot( hitToEye, lightReflect ), 0.0f, 1.0f );
+        sf = glm::pow( sf, primaryRayData.HitMaterial.SpecularFactor );
+        sf *= primaryRayData.HitMaterial.Specular;
+
+        brightness = sf + df;
+    }
+
+    // Ambient/Emissive
+    float ambientEmissive = m_view.AmbientIntensity + primaryRayData.HitMaterial.Emissive;
+
+    // Check shadowing
+    bool shadowed = shadowRayData.HitID > -1 && shadowRayData.HitMaterial.CastShadow == 1.0f;
+    brightness = shadowed ? ambientEmissive : brightness + ambientEmissive;
+
+    // Multiply Color
+    glm::vec4 color = primaryRayData.HitMaterial.Color;
+    color.x *= m_view.SkyLightColor.x * brightness;
+    color.y *= m_view.SkyLightColor.y * brightness;
+    color.z *= m_view.SkyLightColor.z * brightness;
+
+    // Clamp color values to 1.0 to prevent wrapping
+    color = glm::min( color, 1.0f );
+
+    // Calculate fragment depth in camera space
+    glm::vec3 transPos = glm::vec3( glm::inverse( m_view.CameraRot ) * glm::vec4( primaryRayData.Position, 1.0f ) );
+    transPos -= m_view.CameraPos;
+    depth = -transPos.z / ( RAY_FAR_PLANE - RAY_NEAR_PLANE );
+
+    if( m_view.DrawDepthBuffer )
+    {
+        return glm::vec4( depth );
+    }
+
+    return color;
+}
+
+// Casts a ray through the grid or BVH, checks for any collisions and reiterates to the specified level
+void CPUTracer::castRay( Ray ray, int iterations, RayData& rayData, long long& rayCount ) const
+{
+    rayData = RayData();
+    rayData.HitMaterial = emptyMaterial();
+    rayData.Origin = ray.Origin;
+
+    int hitIDs[ MAX_VIEW_ITERATIONS ];
+    ObjectMaterial hitMaterials[ MAX_VIEW_ITERATIONS ];
+
+    for( int i = 0; i < MAX_VIEW_ITERATIONS; ++i )
+    {
+        hitIDs[ i ] = -1;
+        hitMaterials[ i ] = emptyMaterial();
+    }
+
+    // Outer loop - Ray iterations (Recasts - Reflection, Refraction, Portals, Spacewarp)
+    for( int o = 0; o < iterations; ++o )
+    {
+        rayCount++;
+
+        RayHit hit;
+        if( intersectRay( ray, hit ) && loadHit( ray, hit, rayData ) )
+        {
+            hitIDs[ o ] = rayData.HitID;
+            hitMaterials[ o ] = rayData.HitMaterial;
+        }
+
+        if( !checkRecast( ray, rayData ) ) break;
+    }
+
+    // Iterate through hit materials and sum color
+    glm::vec4 outColor = glm::vec4( 0.0f );
+
+    for( int i = 0; i < MAX_VIEW_ITERATIONS; i++ )
+    {
+        if( hitIDs[ i ] == -1 ) break;
+
+        if( hitMaterials[ i ].Type <= ObjectMaterial::Texture && outColor.w < 1.0f )
+        {
+            float alpha = hitMaterials[ i ].Color.w;
+            outColor.x += hitMaterials[ i ].Color.x * alpha;
+            outColor.y += hitMaterials[ i ].Color.y * alpha;
+            outColor.z += hitMaterials[ i ].Color.z * alpha;
+            outColor.w += alpha;
+        }
+    }
+    rayData.HitMaterial.Color = outColor;
+}
+
+// Finds the ray's nearest hit with the frame's structure, which tests its unbounded primitives first and
+// walks the rest as the matching traversal in Raytracer.frag. Low accuracy mode takes the first hit found,
+// as the shader stops traversing on it
+bool CPUTracer::intersectRay( const Ray& ray, RayHit& hit ) const
+{
+    Collisions::RayQueryMode mode = m_view.LowAccuracyMode ? Collisions::AnyHit : Collisions::ClosestHit;
+    Collisions::InitRayHits( &hit, 1, RAY_FAR_PLANE );
+
+    if( m_bvh ) return m_bvh->IntersectRays( &ray, 1, *m_primitives, m_transforms, &hit, mode ) > 0;
+    if( m_twoLevelGrid ) return m_twoLevelGrid->IntersectRays( &ray, 1, *m_primitives, m_transforms, &hit, mode ) > 0;
+    if( m_hashedGrid ) return m_hashedGrid->IntersectRays( &ray, 1, *m_primitives, m_transforms, &hit, mode ) > 0;
+    if( m_octree ) return m_octree->IntersectRays( &ray, 1, *m_primitives, m_transforms, &hit, mode ) > 0;
+    return m_grid->IntersectRays( &ray, 1, *m_primitives, m_transforms, &hit, mode ) > 0;
+}
+
+// Intersects the hit primitive again for the full intersection data and loads it into rayData
+bool CPUTracer::loadHit( const Ray& ray, const RayHit& hit, RayData& rayData ) const
+{
+    const Primitive* primitive = ( *m_primitives )[ hit.PrimitiveIndex ];
+
+    IsectData isectData = IsectData();
+    isectData.Distance = RAY_FAR_PLANE;
+
+    if( !Collisions::IsectPrimitive( ray, primitive, m_transforms[ hit.PrimitiveIndex ], isectData ) ) return false;
+
+    primitiveIntersection( primitive, isectData, rayData );
+    return true;
+}
+
+// Check if the camera is inside a warp primitive, if so apply the correct warp offset
+void CPUTracer::checkWarp( Ray& ray ) const
+{
+    const std::vector< Primitive* >& primitives = *m_primitives;
+    glm::vec3 warpFactor = glm::vec3( 1.0f );
+
+    for( int i = 0; i < int( primitives.size() ); ++i )
+    {
+        const Primitive* primitive = primitives[ i ];
+
+        if( primitive->Material.Type != ObjectMaterial::Spacewarp ) continue;
+
+        switch( primitive->Type )
+        {
+            case Primitive::Sphere:
+            {
+                if( Collisions::SphereContainsPoint( m_view.CameraPos, primitive->Position, primitive->Orientation, primitive->Scale ) )
+                {
+                    warpFactor = primitive->Material.PortalOffset;
+                }
+                break;
+            }
+            case Primitive::AABB:
+            {
+                glm::vec3 localPt = glm::conjugate( primitive->Orientation ) * ( m_view.CameraPos - primitive->Position );
+                localPt /= primitive->Scale;
+                if( Collisions::AABBContainsPoint( localPt, glm::vec3( -0.5f ), glm::vec3( 0.5f ) ) )
+                {
+                    warpFactor = primitive->Material.PortalOffset;
+                }
+                break;
+            }
+            default:
+            {
+                break;
+            }
+        }
+    }
+
+    ray.Direction = glm::normalize( ray.Direction * warpFactor );
+}
+
+// Check if the ray has intersected a primitive, if so setup it's new origin and direction based on the hit material
+bool CPUTracer::checkRecast( Ray& ray, RayData& rayData ) const
+{
+    bool recast = false;
+
+    if( rayData.HitID > -1 )
+    {
+        const ObjectMaterial& material = rayData.HitMaterial;
+
+        // Transparency ( Limited to the recursion depth, but hey-ho )
+        if( material.Type <= ObjectMaterial::Texture && material.Color.w < 1.0f )
+        {
+            // Nudge the ray through the primitive by a small amount to prevent re-collision
+            ray.Origin = rayData.Position - rayData.Normal * SMALL_VALUE;
+            recast = true;
+        }
+
+        // Reflection
+        if( material.Type <= ObjectMaterial::Texture && material.Reflection > 0.0f )
+        {
+            ray.Origin = rayData.Position + rayData.Normal * SMALL_VALUE;
+            ray.Direction = glm::reflect( ray.Direction, rayData.Normal );
+            recast = true;
+        }
+
+        // Refraction
+        if( material.Type <= ObjectMaterial::Texture && material.RefractiveIndex != 1.0f )
+        {
+            ray.Origin = rayData.Position - rayData.Normal * SMALL_VALUE;
+            ray.Direction = glm::refract( -ray.Direction, rayData.Normal, material.RefractiveIndex );
+            recast = true;
+        }
+
+        // Portal
+        if( material.Type == ObjectMaterial::Portal )
+        {
+            glm::mat4 portalRotation = glm::mat4( 1.0f );
+            if( material.PortalAngle != 0.0f )
+            {
+                portalRotation = rotationMatrix( material.PortalAxis, material.PortalAngle );
+            }
+            glm::vec3 outNormal = glm::vec3( portalRotation * glm::vec4( rayData.Normal, 1.0f ) );
+            glm::vec3 inOriginRelative = rayData.Position - rayData.PortalPosition;
+            glm::vec3 inOriginRelativeRotated = glm::vec3( portalRotation * glm::vec4( inOriginRelative, 1.0f ) );
+
+            ray.Origin = inOriginRelativeRotated + ( rayData.PortalPosition + material.PortalOffset ) - outNormal * SMALL_VALUE;
+            ray.Direction = glm::normalize( glm::vec3( portalRotation * glm::vec4( ray.Direction, 1.0f ) ) );
+            recast = true;
+        }
+
+        // Spacewarp
+        if( material.Type == ObjectMaterial::Spacewarp )
+        {
+            ray.Origin = rayData.Position - rayData.Normal * SMALL_VALUE;
+            if( rayData.Backface == 0.0f )
+            {
+                ray.Direction = glm::normalize( ray.Direction * material.PortalOffset );
+            }
+            else
+            {
+                ray.Direction = glm::normalize( ray.Direction * ( glm::vec3( 1.0f ) / material.PortalOffset ) );
+            }
+            recast = true;
+        }
+    }
+
+    // Update new ray origin
+    rayData.Origin = ray.Origin;
+
+    return recast;
+}
+
+// Loads intersection data into a ray data structure upon successful collision
+void CPUTracer::primitiveIntersection( const Primitive* primitive, const IsectData& isectData, RayData& rayData ) const
+{
+    rayData.HitID = int( primitive->ID );
+    rayData.HitMaterial = primitive->Material;
+    rayData.Position = isectData.Position;
+    rayData.Normal = isectData.Normal;
+    rayData.Backface = isectData.Backface;
+
+    if( primitive->Material.Type == ObjectMaterial::Texture )
+    {
+        rayData.HitMaterial.Color = glm::vec4( glm::clamp( glm::tan( rayData.Position ) * 0.8f, 0.0f, 1.0f ), 1.0f ) * primitive->Material.Color;
+    }
+
+    if( primitive->Material.Type == ObjectMaterial::Portal )
+    {
+        rayData.PortalPosition = primitive->Position;
+    }
+}
@@ -1,6 +1,7 @@
 #include "Camera.h"
 
 #include <GLFW/glfw3.h>
+#include <algorithm>
 #include <time.h>
 
 #include "WorldClock.h"
@@ -8,6 +9,8 @@
 #include "Controls.h"
 
 const float TRANSLATE_PER_SEC = 20.0f;
+// How far past a hit the next portal query along the movement starts
+const float PORTAL_QUERY_STEP = 0.01f;
 int previousWorldClock;
 
 Camera::Camera()
@@ -15,7 +18,7 @@ Camera::Camera()
     Controls::SetMouseLock( true );
 }
 
-void Camera::Update( const std::vector<Primitive*>& primitives )
+void Camera::Update( const std::vector<Primitive*>& primitives, const PrimitiveStore& store, const SceneRayQuery& intersectRays )
 {
     float deltaTime = WorldClock::Instance()->DeltaTime();
 
@@ -66,81 +69,83 @@ void Camera::Update( const std::vector<Primitive*>& primitives )
     if( m_position != m_prevPosition )
     {
         Ray movementVector( m_prevPosition, normalize( m_position - m_prevPosition ) );
+        float distance = glm::distance( m_position, m_prevPosition );
 
-        for( int i = 0; i < primitives.size(); ++i )
+        // Passes through every sphere, disc or polygon portal the movement crosses, each once, in order along it.
+        // Every query finds the nearest primitive ahead and the next one resumes just past it
+        std::vector< int > crossed;
+        float travelled = 0.0f;
+        while( travelled < distance )
         {
-            IsectData isectData;
-            isectData.Distance = glm::distance( m_position, m_prevPosition );
-            if( primitives[ i ]->Material.Type == ObjectMaterial::Portal )
+            Ray remaining( movementVector.Origin + movementVector.Direction * travelled, movementVector.Direction );
+            RayHit hit;
+            Collisions::InitRayHits( &hit, 1, distance - travelled );
+            if( intersectRays( &remaining, 1, &hit ) == 0 ) break;
+
+            int i = hit.PrimitiveIndex;
+            Primitive::ObjectType type = store.GetTypes()[ i ];
+            bool portal = store.GetMaterial( i ).Type == ObjectMaterial::Portal &&
+                          ( type == Primitive::Sphere || type == Primitive::Disc || type == Primitive::ConvexPoly );
+
+            if( portal && std::find( crossed.begin(), crossed.end(), i ) == crossed.end() )
             {
-                switch( primitives[ i ]->Type )
-                {
-                case Primitive::Sphere:
-                    if( Collisions::IsectSpherePrimitive( movementVector, primitives[ i ], isectData ) )
-                    {
-                        portalTransport( primitives[ i ], isectData );
-                    }
-                    break;
-                case Primitive::Disc:
-                    if( Collisions::IsectDiscPrimitive( movementVector, primitives[ i ], isectData ) )
-                    {
-                        portalTransport( primitives[ i ], isectData );
-                    }
-                    break;
-                case Primitive::ConvexPoly:
-                    if( Collisions::IsectConvexPolyPrimitive( movementVector, primitives[ i ], isectData ) )
-                    {
-                        portalTransport( primitives[ i ], isectData );
-                    }
-                    break;
-                }
+                portalTransport( primitives[ i ], remaining, hit );
+                crossed.push_back( i );
             }
+
+            travelled += hit.Distance + PORTAL_QUERY_STEP;
         }
     }
 
-    updateWarpFactor( primitives );
+    updateWarpFactor( store );
 }
 
-void Camera::portalTransport( const Primitive* portal, const IsectData& isectData )
+void Camera::portalTransport( const Primitive* portal, const Ray& ray, const RayHit& hit )
 {
     mat4 portalRotation = mat4( 1.0f );
     if( portal->Material.PortalAngle != 0.0f )
     {
         portalRotation = rotate( portalRotation, -portal->Material.PortalAngle, portal->Material.PortalAxis );
     }
-    vec3 outNormal = vec3( portalRotation * vec4( isectData.Normal, 1.0f ) );
-    vec3 inOriginRelative = isectData.Position - portal->Position;
+    vec3 outNormal = vec3( portalRotation * vec4( hit.Normal, 1.0f ) );
+    vec3 inOriginRelative = ( ray.Origin + ray.Direction * hit.Distance ) - portal->Position;
     vec3 inOriginRelativeRotated = vec3( portalRotation * vec4( inOriginRelative, 1.0f ) );
     m_position = inOriginRelativeRotated + ( portal->Position + portal->Material.PortalOffset ) - outNormal * 0.1f;
     m_cameraRotX *= portalRotation;
     //m_cameraRotY *= portalRotation;
 }
 
-void Camera::updateWarpFactor( const std::vector<Primitive*>& primitives )
+void Camera::updateWarpFactor( const PrimitiveStore& store )
 {
     m_warpFactor = vec3( 1.0f );
 
-    for( uint16_t i = 0; i < primitives.size(); ++i )
+    ArrayView< Primitive::ObjectType > types = store.GetTypes();
+    ArrayView< glm::vec3 > positions = store.GetPositions();
+    ArrayView< glm::quat > orientations = store.GetOrientations();
+    ArrayView< glm::vec3 > scales = store.GetScales();
+
+    for( int i = 0; i < store.Size(); ++i )
     {
-        if( primitives[ i ]->Material.Type == ObjectMaterial::Spacewarp )
+        const ObjectMaterial& material = store.GetMaterial( i );
+        if( material.Type == ObjectMaterial::Spacewarp )
         {
-            switch( primitives[ i ]->Type )
+            switch( types[ i ] )
             {
                 case Primitive::Sphere:
                 {
-                    if( Collisions::SphereContainsPoint( m_position, primitives[ i ]->Position, primitives[ i ]->Orientation, primitives[ i ]->Scale ) )
+                    if( Collisions::SphereContainsPoint( m_position, positions[ i ], orientations[ i ], scales[ i ] ) )
                     {
-                        m_warpFactor = primitives[ i ]->Material.PortalOffset;
+                        m_warpFactor = material.PortalOffset;
                     }
                     break;
                 }
                 case Primitive::AABB:
                 {
-                    glm::vec3 b0 = primitives[ i ]->Position - primitives[ i ]->Scale * 0.5f;
-                    glm::vec3 b1 = primitives[ i ]->Position + primitives[ i ]->Scale * 0.5f;
+                    glm::vec3 b0 = positions[ i ] - scales[ i ] * 0.5f;
+                    glm::vec3 b1 = positions[ i ] + scales[ i ] * 0.5f;
                     if( Collisions::AABBContainsPoint( m_position, b0, b1 ) )
                     {
-                        m_warpFactor = primitives[ i ]->Material.PortalOffset;
+                        m_warpFactor = material.PortalOffset;
                     }
                     break;
                 }
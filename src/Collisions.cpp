@@ -1,5 +1,9 @@
 #include "Collisions.h"
 
+#include <algorithm>
+
+#include "CollisionsPacket.h"
+
 namespace Collisions
 {
     float NEAR_PLANE = 0.0f;
@@ -163,14 +167,14 @@ namespace Collisions
     }
 
     // Ray Intersection (Object)
-    bool IsectPlanePrimitive(
-        const Ray& ray,
+    // Local space kernels, lr is the ray in the primitive's unit space and the
+    // resulting position / normal are left in that space
+    static bool isectPlaneLocal(
+        const Ray& lr,
         const Primitive* object,
         IsectData& isectData
         )
     {
-        Ray lr = localRay( ray, object->Position, object->Orientation, object->Scale );
-
         float hit = 1.0f;
 
         vec3 pn = PLANE_NORMAL;
@@ -185,24 +189,25 @@ namespace Collisions
 
         isectData.Position = mix( isectData.Position, lr.Origin + ( lr.Direction * t ), hit );
         isectData.Normal = mix( isectData.Normal, pn * -sign( ndr ), hit );
-        isectData = worldIsectData( isectData, object->Position, object->Orientation, object->Scale );
 
         return hit == 1.0f;
     }
 
-    bool IsectSpherePrimitive(
-        const Ray& ray,
+    static bool isectSphereLocal(
+        const Ray& lr,
         const Primitive* object,
         IsectData& isectData
         )
     {
-        Ray lr = localRay( ray, object->Position, object->Orientation, object->Scale );
+        // The geometric solution needs a unit direction, scale t back into ray space afterwards
+        float dirLength = length( lr.Direction );
+        vec3 ld = lr.Direction / dirLength;
 
         float hit = 1.0f;
-        float backface = SphereContainsPoint( ray.Origin, vec3( 0 ), quat(), vec3( 1 ) );
+        float backface = SphereContainsPoint( lr.Origin, vec3( 0 ), quat(), vec3( 1 ) );
 
         vec3 l = -lr.Origin;
-        float tca = dot( l, lr.Direction );
+        float tca = dot( l, ld );
 
         float ds = dot( l, l ) - tca * tca;
         hit = step( ds, 1.0f );
@@ -212,26 +217,25 @@ namespace Collisions
         float t0 = tca - thc; // Entry t
         float t1 = tca + thc; // Exit t
 
-        float t = mix( t0, t1, backface );
+        float tl = mix( t0, t1, backface );
+        float t = tl / dirLength;
 
         hit = mix( 0.0f, hit, step( NEAR_PLANE, t ) );
         hit = mix( hit, 0.0f, step( isectData.Distance, t ) ); // t < isectData.Distance
 
-        isectData.Position = mix( isectData.Position, lr.Origin + ( lr.Direction * t ), hit );
+        isectData.Position = mix( isectData.Position, lr.Origin + ( ld * tl ), hit );
         isectData.Normal = mix( isectData.Normal, normalize( isectData.Position ) * mix( 1.0f, -1.0f, backface ), hit );
-        isectData = worldIsectData( isectData, object->Position, object->Orientation, object->Scale );
+        isectData.Backface = backface;
 
         return hit == 1.0f;
     }
 
-    bool IsectDiscPrimitive(
-        const Ray& ray,
+    static bool isectDiscLocal(
+        const Ray& lr,
         const Primitive* object,
         IsectData& isectData
-    )
+        )
     {
-        Ray lr = localRay( ray, object->Position, object->Orientation, object->Scale );
-
         float hit = 1.0f;
 
         vec3 dn = PLANE_NORMAL;
@@ -252,19 +256,50 @@ namespace Collisions
 
         isectData.Position = mix( isectData.Position, lr.Origin + ( lr.Direction * t ), hit );
         isectData.Normal = mix( isectData.Normal, dn * -sign( ndr ), hit );
-        isectData = worldIsectData( isectData, object->Position, object->Orientation, object->Scale );
 
         return hit == 1.0f;
     }
 
-    bool IsectConvexPolyPrimitive(
-        const Ray& ray,
+    static bool isectAABBLocal(
+        const Ray& lr,
         const Primitive* object,
         IsectData& isectData
         )
     {
-        Ray lr = localRay( ray, object->Position, object->Orientation, object->Scale );
+        float hit = 1.0f;
+        float backface = AABBContainsPoint( lr.Origin, vec3( -0.5f ), vec3( 0.5f ) );
+
+        // Calculate intersection using the slab method ( clip ray against box per-axis )
+        vec3 t0 = ( vec3( 0.5f ) - lr.Origin ) * vec3( 1.0f ) / lr.Direction;
+        vec3 t1 = ( vec3(-0.5f ) - lr.Origin ) * vec3( 1.0f ) / lr.Direction;
+        float tmin = min( t0.x, t1.x );
+        float tmax = max( t0.x, t1.x );
+        tmin = max( tmin, min( t0.y, t1.y ) );
+        tmax = min( tmax, max( t0.y, t1.y ) );
+        tmin = max( tmin, min( t0.z, t1.z ) );
+        tmax = min( tmax, max( t0.z, t1.z ) );
+        hit = step( tmin, tmax );
+
+        // Check hit against ray limits
+        float t = mix( tmin, tmax, backface );
+        hit = mix( 0.0f, hit, step( NEAR_PLANE, t ) );
+        hit = mix( hit, 0.0f, step( isectData.Distance, t ) ); // t < isectData.Distance
+
+        vec3 pt = lr.Origin + ( lr.Direction * t );
+
+        isectData.Position = mix( isectData.Position, pt, hit );
+        isectData.Normal = mix( isectData.Normal, cardinalDirection( pt ) * mix( 1.0f, -1.0f, backface ), hit );
+        isectData.Backface = backface;
 
+        return hit == 1.0f;
+    }
+
+    static bool isectConvexPolyLocal(
+        const Ray& lr,
+        const Primitive* object,
+        IsectData& isectData
+        )
+    {
         float hit = 1.0f;
 
         vec3 pn = PLANE_NORMAL;
@@ -299,9 +334,218 @@ namespace Collisions
 
         isectData.Position = mix( isectData.Position, lr.Origin + ( lr.Direction * t ), hit );
         isectData.Normal = mix( isectData.Normal, pn * -sign( ndr ), hit );
-        isectData = worldIsectData( isectData, object->Position, object->Orientation, object->Scale );
 
         return hit == 1.0f;
     }
 
+    static bool isectPrimitiveLocal(
+        const Ray& lr,
+        const Primitive* object,
+        IsectData& isectData
+        )
+    {
+        switch( object->Type )
+        {
+            case Primitive::Plane:
+                return isectPlaneLocal( lr, object, isectData );
+            case Primitive::Sphere:
+                return isectSphereLocal( lr, object, isectData );
+            case Primitive::Disc:
+                return isectDiscLocal( lr, object, isectData );
+            case Primitive::AABB:
+                return isectAABBLocal( lr, object, isectData );
+            case Primitive::ConvexPoly:
+                return isectConvexPolyLocal( lr, object, isectData );
+            default:
+                return false;
+        }
+    }
+
+    // World space kernels, transforming by the primitive's position, orientation and scale
+    bool IsectPlanePrimitive( const Ray& ray, const Primitive* object, IsectData& isectData )
+    {
+        bool hit = isectPlaneLocal( localRay( ray, object->Position, object->Orientation, object->Scale ), object, isectData );
+        isectData = worldIsectData( isectData, object->Position, object->Orientation, object->Scale );
+        return hit;
+    }
+
+    bool IsectSpherePrimitive( const Ray& ray, const Primitive* object, IsectData& isectData )
+    {
+        bool hit = isectSphereLocal( localRay( ray, object->Position, object->Orientation, object->Scale ), object, isectData );
+        isectData = worldIsectData( isectData, object->Position, object->Orientation, object->Scale );
+        return hit;
+    }
+
+    bool IsectDiscPrimitive( const Ray& ray, const Primitive* object, IsectData& isectData )
+    {
+        bool hit = isectDiscLocal( localRay( ray, object->Position, object->Orientation, object->Scale ), object, isectData );
+        isectData = worldIsectData( isectData, object->Position, object->Orientation, object->Scale );
+        return hit;
+    }
+
+    bool IsectAABBPrimitive( const Ray& ray, const Primitive* object, IsectData& isectData )
+    {
+        bool hit = isectAABBLocal( localRay( ray, object->Position, object->Orientation, object->Scale ), object, isectData );
+        isectData = worldIsectData( isectData, object->Position, object->Orientation, object->Scale );
+        return hit;
+    }
+
+    bool IsectConvexPolyPrimitive( const Ray& ray, const Primitive* object, IsectData& isectData )
+    {
+        bool hit = isectConvexPolyLocal( localRay( ray, object->Position, object->Orientation, object->Scale ), object, isectData );
+        isectData = worldIsectData( isectData, object->Position, object->Orientation, object->Scale );
+        return hit;
+    }
+
+    bool IsectPrimitive(
+        const Ray& ray,
+        const Primitive* object,
+        IsectData& isectData
+        )
+    {
+        bool hit = isectPrimitiveLocal( localRay( ray, object->Position, object->Orientation, object->Scale ), object, isectData );
+        isectData = worldIsectData( isectData, object->Position, object->Orientation, object->Scale );
+        return hit;
+    }
+
+    // As above, reusing the primitive's cached matrices instead of rebuilding the transform
+    bool IsectPrimitive(
+        const Ray& ray,
+        const Primitive* object,
+        const PrimitiveTransform& transform,
+        IsectData& isectData
+        )
+    {
+        bool hit = isectPrimitiveLocal( localRay( ray, transform ), object, isectData );
+        isectData = worldIsectData( isectData, transform );
+        return hit;
+    }
+
+    // Batched Ray Queries
+    void InitRayHits( RayHit* hits, int count, float maxDistance )
+    {
+        for( int i = 0; i < count; ++i )
+        {
+            hits[ i ].Distance = maxDistance;
+            hits[ i ].PrimitiveIndex = -1;
+            hits[ i ].Normal = vec3( 0.0f );
+        }
+    }
+
+    static SimdMask< SIMD_WIDTH > isectPrimitivePacket(
+        const RayPacket< SIMD_WIDTH >& rays,
+        const Primitive* object,
+        const PrimitiveTransform& transform,
+        SimdFloat< SIMD_WIDTH >& t
+        )
+    {
+        switch( object->Type )
+        {
+            case Primitive::Plane:
+                return IsectPlanePrimitive( rays, object, transform, t );
+            case Primitive::Sphere:
+                return IsectSpherePrimitive( rays, object, transform, t );
+            case Primitive::Disc:
+                return IsectDiscPrimitive( rays, object, transform, t );
+            case Primitive::AABB:
+                return IsectAABBPrimitive( rays, object, transform, t );
+            case Primitive::ConvexPoly:
+                return IsectConvexPolyPrimitive( rays, object, transform, t );
+            default:
+                return SimdMask< SIMD_WIDTH >( false );
+        }
+    }
+
+    int IntersectRays(
+        const Ray* rays,
+        int rayCount,
+        const std::vector< Primitive* >& primitives,
+        ArrayView< PrimitiveTransform > transforms,
+        RayHit* hits,
+        RayQueryMode mode
+        )
+    {
+        return IntersectRays( rays, rayCount, primitives, transforms, 0, int( primitives.size() ), hits, mode );
+    }
+
+    // Rays are processed SIMD_WIDTH at a time with the packet kernels, which only produce t.
+    // Normals are computed afterwards with the scalar kernel, once per ray that hit
+    int IntersectRays(
+        const Ray* rays,
+        int rayCount,
+        const std::vector< Primitive* >& primitives,
+        ArrayView< PrimitiveTransform > transforms,
+        const int* indices,
+        int indexCount,
+        RayHit* hits,
+        RayQueryMode mode
+        )
+    {
+        int hitCount = 0;
+
+        for( int first = 0; first < rayCount; first += SIMD_WIDTH )
+        {
+            int count = std::min( SIMD_WIDTH, rayCount - first );
+            RayPacket< SIMD_WIDTH > packet( rays + first, count );
+
+            // Inactive lanes ( padding and finished any-hit rays ) get a limit of NEAR_PLANE,
+            // which no t can pass
+            float distance[ SIMD_WIDTH ];
+            int active = 0;
+            for( int lane = 0; lane < SIMD_WIDTH; ++lane )
+            {
+                distance[ lane ] = NEAR_PLANE;
+                if( lane >= count ) continue;
+                if( mode == AnyHit && hits[ first + lane ].PrimitiveIndex >= 0 ) continue;
+
+                distance[ lane ] = hits[ first + lane ].Distance;
+                active |= 1 << lane;
+            }
+            packet.Distance = SimdFloat< SIMD_WIDTH >::Load( distance );
+
+            int hitLanes = 0;
+            for( int i = 0; i < indexCount && active != 0; ++i )
+            {
+                int index = indices ? indices[ i ] : i;
+
+                SimdFloat< SIMD_WIDTH > t;
+                int bits = isectPrimitivePacket( packet, primitives[ index ], transforms[ index ], t ).Bits() & active;
+                if( bits == 0 ) continue;
+
+                float tLanes[ SIMD_WIDTH ];
+                t.Store( tLanes );
+
+                for( int lane = 0; lane < count; ++lane )
+                {
+                    if( !( ( bits >> lane ) & 1 ) ) continue;
+
+                    hits[ first + lane ].Distance = tLanes[ lane ];
+                    hits[ first + lane ].PrimitiveIndex = index;
+                    distance[ lane ] = mode == AnyHit ? NEAR_PLANE : tLanes[ lane ];
+                }
+
+                hitLanes |= bits;
+                if( mode == AnyHit ) active &= ~bits;
+                packet.Distance = SimdFloat< SIMD_WIDTH >::Load( distance );
+            }
+
+            for( int lane = 0; lane < count; ++lane )
+            {
+                if( !( ( hitLanes >> lane ) & 1 ) ) continue;
+
+                hitCount++;
+
+                if( mode == ClosestHit )
+                {
+                    RayHit& hit = hits[ first + lane ];
+                    IsectData isectData = IsectData();
+                    isectData.Distance = FAR_PLANE;
+                    IsectPrimitive( rays[ first + lane ], primitives[ hit.PrimitiveIndex ], transforms[ hit.PrimitiveIndex ], isectData );
+                    hit.Normal = isectData.Normal;
+                }
+            }
+        }
+
+        return hitCount;
+    }
 }
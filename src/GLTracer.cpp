@@ -11,18 +11,30 @@
 
 #define ACC_NONE 0
 #define ACC_GRID 1
-//#define ACC_OCTREE 2
+#define ACC_OCTREE 2
 #define ACC_KDTREE 3
+#define ACC_BVH 4
+#define ACC_TWO_LEVEL_GRID 5
+#define ACC_HASHED_GRID 6
 
 #define ACCELL_STRUCTURE ACC_GRID
 #define RENDER_DEBUG
 #define RENDER_CROSSHAIR
+//#define RENDER_CPU_REFERENCE
+
+// The CPU reference renderer mirrors the grid, BVH, two level grid, hashed grid and octree traversals in Raytracer.frag
+#if ACCELL_STRUCTURE != ACC_GRID && ACCELL_STRUCTURE != ACC_BVH && ACCELL_STRUCTURE != ACC_TWO_LEVEL_GRID && ACCELL_STRUCTURE != ACC_HASHED_GRID && ACCELL_STRUCTURE != ACC_OCTREE
+#undef RENDER_CPU_REFERENCE
+#endif
 
 const float FOV = 90.0f;
 const float SKYLIGHT_ROTATE_PER_SEC = 0.01f;
 const int INFO_PACKET_SIZE = 24;
 const float AMBIENT_INTENSITY = 0.2f;
-const int GRID_RESOLUTION = 20;
+const float GRID_DENSITY = 4.0f;
+// SpatialSAH rebuilds on every change, so it only suits static scenes
+const BVH::BuildMethod BVH_BUILD_METHOD = BVH::BinnedSAH;
+const int CPU_REFERENCE_DOWNSCALE = 4;
 
 int prevWorldClock;
 
@@ -57,17 +69,76 @@ GLTracer::GLTracer()
 
     // Send primitives into the info texture
     scene = new TestScene( this );
+    scene->UpdateTransforms();
 #if ACCELL_STRUCTURE == ACC_GRID
-    m_grid = new Grid( scene->GetObjects(), glm::vec3( -100, -100, -100 ), glm::vec3( 100, 100, 100 ), GRID_RESOLUTION );
+    m_grid = new Grid( scene->GetPrimitiveStore(), m_scheduler, GRID_DENSITY );
+
+    GridStats gridStats = m_grid->GetStats();
+    std::cout << "Grid: " << gridStats.Resolution.x << "x" << gridStats.Resolution.y << "x" << gridStats.Resolution.z << " cells ( "
+              << gridStats.EmptyCells << " empty ), " << gridStats.References << " references, "
+              << gridStats.ReferencesPerCell << " per cell, at most " << gridStats.MaxCellReferences << std::endl;
 #endif
 #if ACCELL_STRUCTURE == ACC_KDTREE
-    m_kdTree = new kdTree( scene->GetObjects() );
+    m_kdTree = new kdTree( scene->GetPrimitiveStore() );
+
+    const kdTreeStats& kdStats = m_kdTree->GetStats();
+    std::cout << "kD tree: " << kdStats.Nodes << " nodes, " << kdStats.Leaves << " leaves ( " << kdStats.EmptyLeaves << " empty ), "
+              << "depth " << kdStats.MaxDepth << ", SAH cost " << kdStats.SAHCost << std::endl;
+#endif
+#if ACCELL_STRUCTURE == ACC_BVH
+    m_bvh = new BVH( scene->GetPrimitiveStore(), m_scheduler, BVH_BUILD_METHOD );
+
+    const BVHStats& bvhStats = m_bvh->GetStats();
+    std::cout << "BVH: " << bvhStats.Nodes << " nodes, " << bvhStats.Leaves << " leaves, depth " << bvhStats.MaxDepth
+              << ", SAH cost " << bvhStats.SAHCost << ", " << bvhStats.Duplicates << " duplicate references, built in " << bvhStats.BuildSeconds * 1000.0f << " ms" << std::endl;
+
+#ifdef RENDER_CPU_REFERENCE
+    m_wideBVH = new WideBVH< WIDE_BVH_WIDTH >();
+    m_wideBVH->Collapse( *m_bvh );
+
+    const WideBVHStats& wideStats = m_wideBVH->GetStats();
+    std::cout << "BVH" << WIDE_BVH_WIDTH << ": " << wideStats.Nodes << " nodes, " << wideStats.Leaves << " leaves, "
+              << wideStats.ChildrenPerNode << " children per node" << std::endl;
+#endif
+
+    m_compressedBVH = new CompressedBVH();
+    m_compressedBVH->Encode( *m_bvh );
+
+    const CompressedBVHStats& compressedStats = m_compressedBVH->GetStats();
+    std::cout << "Compressed BVH: " << compressedStats.Nodes << " nodes, " << compressedStats.Bytes / 1024 << " KB against "
+              << compressedStats.UncompressedBytes / 1024 << " KB uncompressed" << std::endl;
+#endif
+#if ACCELL_STRUCTURE == ACC_TWO_LEVEL_GRID
+    m_twoLevelGrid = new TwoLevelGrid( scene->GetPrimitiveStore() );
+
+    const TwoLevelGridStats& twoLevelStats = m_twoLevelGrid->GetStats();
+    std::cout << "Two level grid: " << twoLevelStats.Resolution.x << "x" << twoLevelStats.Resolution.y << "x" << twoLevelStats.Resolution.z << " top cells, "
+              << twoLevelStats.SubGrids << " sub grids of " << twoLevelStats.SubCells << " cells, " << twoLevelStats.References << " references, "
+              << "at most " << twoLevelStats.MaxLeafReferences << " per cell" << std::endl;
+#endif
+#if ACCELL_STRUCTURE == ACC_HASHED_GRID
+    m_hashedGrid = new HashedGrid( scene->GetPrimitiveStore(), GRID_DENSITY );
+
+    const HashedGridStats& hashedStats = m_hashedGrid->GetStats();
+    std::cout << "Hashed grid: " << hashedStats.OccupiedCells << " occupied cells of size " << hashedStats.CellSize << " in " << hashedStats.TableSize << " slots, "
+              << hashedStats.References << " references, longest probe " << hashedStats.MaxProbeLength << ", " << hashedStats.Bytes << " bytes" << std::endl;
+#endif
+#if ACCELL_STRUCTURE == ACC_OCTREE
+    m_octree = new Octree( scene->GetPrimitiveStore() );
+
+    const OctreeStats& octreeStats = m_octree->GetStats();
+    std::cout << "Octree: " << octreeStats.Nodes << " nodes, " << octreeStats.Leaves << " leaves, depth " << octreeStats.MaxDepth << ", "
+              << octreeStats.References << " references, " << octreeStats.Bytes << " bytes" << std::endl;
+#endif
+
+#ifdef RENDER_CPU_REFERENCE
+    m_cpuTracer = new CPUTracer( windowBounds.x / CPU_REFERENCE_DOWNSCALE, windowBounds.y / CPU_REFERENCE_DOWNSCALE, m_scheduler );
 #endif
 
     compileShaders();
 
     generateObjectInfoTex();
-    bufferPrimitives( scene->GetObjects() );
+    bufferPrimitives( scene->GetPrimitiveStore() );
 
 #if ACCELL_STRUCTURE == ACC_GRID
     generateGridTex();
@@ -79,6 +150,29 @@ GLTracer::GLTracer()
     bufferKDTree();
 #endif
 
+#if ACCELL_STRUCTURE == ACC_BVH
+    generateBVHTex();
+    bufferBVH();
+#endif
+
+#if ACCELL_STRUCTURE == ACC_TWO_LEVEL_GRID
+    generateTwoLevelGridTex();
+    bufferTwoLevelGrid();
+#endif
+
+#if ACCELL_STRUCTURE == ACC_HASHED_GRID
+    generateHashedGridTex();
+    bufferHashedGrid();
+#endif
+
+#if ACCELL_STRUCTURE == ACC_OCTREE
+    generateOctreeTex();
+    bufferOctree();
+#endif
+
+    generateUnboundedTex();
+    bufferUnbounded();
+
     compileShaders();
 
     callbackResizeWindow( 0, windowBounds.x, windowBounds.y );
@@ -90,6 +184,7 @@ GLTracer::~GLTracer()
     delete scene;
 
     delete m_camera;
+    delete m_cpuTracer;
 
     delete m_basicVS;
     delete m_basicFS;
@@ -124,6 +219,12 @@ void GLTracer::terminateGL()
     GL(glDeleteTextures( 1, &m_objectRefTex ));
     GL(glDeleteBuffers( 1, &m_objectRefTBO ));
 
+    GL(glDeleteTextures( 1, &m_gridOccupancyTex ));
+    GL(glDeleteBuffers( 1, &m_gridOccupancyTBO ));
+
+    GL(glDeleteTextures( 1, &m_unboundedTex ));
+    GL(glDeleteBuffers( 1, &m_unboundedTBO ));
+
     GL(glDeleteTextures( 1, &m_screenColorTexture ));
     GL(glDeleteTextures( 1, &m_screenDepthTexture ));
     GL(glDeleteFramebuffers( 1, &m_framebuffer ));
@@ -140,7 +241,10 @@ void GLTracer::Update()
     glUseProgram( m_raytracerProgram );
 
     // Camera
-    m_camera->Update( scene->GetObjects() );
+    m_camera->Update( scene->GetObjects(), scene->GetPrimitiveStore(), [ this ]( const Ray* rays, int rayCount, RayHit* hits )
+    {
+        return intersectRays( rays, rayCount, hits );
+    } );
 
     // Sky light direction
     float deltaSkyLightAngle = SKYLIGHT_ROTATE_PER_SEC * WorldClock::Instance()->DeltaTime();
@@ -148,9 +252,7 @@ void GLTracer::Update()
 
     glm::vec4 skyColor = glm::mix( dayColor, nightColor, ( -skyLightDirection.y + 1 ) / 2 );
     scene->Update( skyColor );
-#if ACCELL_STRUCTURE == ACC_GRID
-    m_grid->Update( scene->GetObjects(), m_camera->GetPosition(), glm::vec3( m_camera->GetRotation() * glm::vec4( 0, 0, -1, 0 ) ) );
-#endif
+    scene->UpdateTransforms();
 
     // Window title info readout
     static float acc = 0;
@@ -166,6 +268,11 @@ void GLTracer::Update()
         ss << " | Window Resolution: " << windowBounds.x << "x" << windowBounds.y;
         glfwSetWindowTitle( m_window, ss.str().c_str() );
         std::cout << "FPS: " << frames << std::endl;
+#ifdef RENDER_CPU_REFERENCE
+        const CPUTracerStats& stats = m_cpuTracer->GetStats();
+        std::cout << "CPU Reference: " << stats.RaysPerSecond / 1000000.0f << " MRays/s over " << stats.Threads << " threads";
+        std::cout << " | Efficiency: " << stats.Efficiency * 100.0f << "%" << std::endl;
+#endif
         acc = 0.0;
         frames = 0;
     }
@@ -200,109 +307,114 @@ void GLTracer::Update()
     prevLeftClick = Controls::LeftClick();
 }
 
-// DEBUG: kD Tree Walking
-void GLTracer::walkKDTree()
+// Closest hit query through the active structure, which matches the primitives as of the last Draw.
+// The BVH is queried directly, its wide collapse only serves the CPU reference
+int GLTracer::intersectRays( const Ray* rays, int rayCount, RayHit* hits ) const
 {
-    std::vector< int > objectsToCheck;
+#if ACCELL_STRUCTURE == ACC_GRID
+    return m_grid->IntersectRays( rays, rayCount, scene->GetObjects(), scene->GetPrimitiveStore().GetTransforms(), hits );
+#elif ACCELL_STRUCTURE == ACC_BVH
+    return m_bvh->IntersectRays( rays, rayCount, scene->GetObjects(), scene->GetPrimitiveStore().GetTransforms(), hits );
+#elif ACCELL_STRUCTURE == ACC_TWO_LEVEL_GRID
+    return m_twoLevelGrid->IntersectRays( rays, rayCount, scene->GetObjects(), scene->GetPrimitiveStore().GetTransforms(), hits );
+#elif ACCELL_STRUCTURE == ACC_HASHED_GRID
+    return m_hashedGrid->IntersectRays( rays, rayCount, scene->GetObjects(), scene->GetPrimitiveStore().GetTransforms(), hits );
+#elif ACCELL_STRUCTURE == ACC_OCTREE
+    return m_octree->IntersectRays( rays, rayCount, scene->GetObjects(), scene->GetPrimitiveStore().GetTransforms(), hits );
+#else
+    return Collisions::IntersectRays( rays, rayCount, scene->GetObjects(), scene->GetPrimitiveStore().GetTransforms(), hits );
+#endif
+}
 
+// DEBUG: kD Tree Walking, mirrors traverseKDTree in Raytracer.frag
+void GLTracer::walkKDTree()
+{
     // GLSL samplers
-    std::vector< glm::vec4 > treeVector = m_kdTree->GetTreeVector();
-    std::vector< int > leafObjectsVector = m_kdTree->GetLeafObjectsVector();
+    const std::vector< glm::ivec2 >& treeVector = m_kdTree->GetTreeVector();
+    const std::vector< int >& leafObjectsVector = m_kdTree->GetLeafObjectsVector();
+
+    // GLSL uniforms
+    const Bounds& treeBounds = m_kdTree->GetBounds();
+    glm::vec3 splitQuantum = m_kdTree->GetSplitQuantum();
 
     // GLSL arguments
     Ray viewRay(
                 m_camera->GetPosition(),
                 glm::normalize( glm::vec3( m_camera->GetRotation() * glm::vec4( 0, 0, -1, 0 ) ) )
                 );
-    IsectData isectData;
-
-    // Tree traversal
-#define leftChild( i ) ( 2 * i + 1 )
-#define rightChild( i ) ( 2 * i + 2 )
-#define parent( i ) ( ( i - 1 ) / 2 )
-    const int MAX_STACK_SIZE = 500;
-
-    // Current position in the kD Tree array
-    int index = 0;
-
-    // Stack
-    int traversalStack[ MAX_STACK_SIZE ];
-    for( int i = 0; i < MAX_STACK_SIZE; ++i ) traversalStack[ i ] = -1;
+    glm::vec3 inverseDirection = 1.0f / viewRay.Direction;
+
+    // Clip the ray to the tree bounds
+    glm::vec3 t0 = ( treeBounds.Min - viewRay.Origin ) * inverseDirection;
+    glm::vec3 t1 = ( treeBounds.Max - viewRay.Origin ) * inverseDirection;
+    glm::vec3 tNear = glm::min( t0, t1 );
+    glm::vec3 tFar = glm::max( t0, t1 );
+    float tMin = glm::max( glm::max( tNear.x, tNear.y ), glm::max( tNear.z, 0.0f ) );
+    float tMax = glm::min( glm::min( tFar.x, tFar.y ), tFar.z );
+
+    // Stack of deferred far children and their ray segments
+    int stackNode[ KD_MAX_DEPTH ];
+    float stackTMin[ KD_MAX_DEPTH ];
+    float stackTMax[ KD_MAX_DEPTH ];
     int stackPointer = 0;
-    traversalStack[ stackPointer ] = 0; // Root node
-
-    // Vector of objects to traverse
-    int leafObjects[ MAX_STACK_SIZE ];
-    int leafObjectIndex = 0;
 
-    // Current node
-    glm::vec4 node;
+    std::vector< int > leafObjects;
+    int steps = 0;
+    int index = 0;
 
-    for( int i = 0; i < MAX_STACK_SIZE; ++i )
+    while( tMin <= tMax )
     {
-        if( stackPointer < 0 ) break;
-
-        // Pop off the top stack element
-        index = traversalStack[ stackPointer ];
-        node = treeVector[ index ];
-        stackPointer--;
+        steps++;
+        glm::ivec2 node = treeVector[ index ];
+        int axis = node.y & 3;
 
-        // branch node stores 0.0, axis, splitPosition
-        bool leaf = node[ 0 ] == 1;
-        int axis = int( node[ 1 ] );
-        float splitPosition = node[ 2 ];
-
-        // When encountering a leaf node, check it's objects
-        if( leaf )
+        // Branch: descend into the near child, deferring the far one if the ray crosses the split
+        if( axis != 3 )
         {
-            // leaf node stores 1.0, object vector index pointer, -1.0
-            int index = int( node[ 1 ] );
-            while( leafObjectsVector[ index ] != -1 )
+            float split = treeBounds.Min[ axis ] + float( node.x ) * splitQuantum[ axis ];
+            float tSplit = ( split - viewRay.Origin[ axis ] ) * inverseDirection[ axis ];
+            bool belowFirst = viewRay.Origin[ axis ] < split || ( viewRay.Origin[ axis ] == split && viewRay.Direction[ axis ] <= 0.0f );
+            int nearChild = belowFirst ? index + 1 : node.y >> 2;
+            int farChild = belowFirst ? node.y >> 2 : index + 1;
+
+            if( tSplit > tMax || tSplit <= 0.0f )
             {
-                leafObjects[ leafObjectIndex ] = leafObjectsVector[ index ];
-                leafObjectIndex++;
-                index++;
+                index = nearChild;
+            }
+            else if( tSplit < tMin )
+            {
+                index = farChild;
+            }
+            else
+            {
+                stackNode[ stackPointer ] = farChild;
+                stackTMin[ stackPointer ] = tSplit;
+                stackTMax[ stackPointer ] = tMax;
+                stackPointer++;
+
+                index = nearChild;
+                tMax = tSplit;
             }
             continue;
         }
 
-        // Otherwise, check the ray against the splitting plane
-        // and add the intersected child nodes to the stack
-        bool tl = false;
-        bool tr = false;
-        if( viewRay.Origin[ axis ] < splitPosition )
-        {
-            tl = true;
-            if( viewRay.Direction[ axis ] > 0 ) tr = true;
-
-        }
-        else
+        // Leaf: gather its objects
+        for( int i = node.x; leafObjectsVector[ i ] != -1; ++i )
         {
-            tr = true;
-            if( viewRay.Direction[ axis ] < 0 ) tl = true;
+            leafObjects.push_back( leafObjectsVector[ i ] );
         }
 
-        int leftChildIndex = leftChild( index );
-        bool leftChildValid = leftChildIndex < treeVector.size();
-        if( tl && leftChildValid )
-        {
-            // Push left child onto stack
-            stackPointer++;
-            traversalStack[ stackPointer ] = leftChildIndex;
-        }
+        if( stackPointer == 0 ) break;
 
-        int rightChildIndex = rightChild( index );
-        bool rightChildValid = rightChildIndex < treeVector.size();
-        if( tr && rightChildValid )
-        {
-            // Push right child onto stack
-            stackPointer++;
-            traversalStack[ stackPointer ] = rightChildIndex;
-        }
+        stackPointer--;
+        index = stackNode[ stackPointer ];
+        tMin = stackTMin[ stackPointer ];
+        tMax = stackTMax[ stackPointer ];
     }
 
+    std::cout << "Nodes visited: " << steps << std::endl;
     std::cout << "Leaf node objects:" << std::endl;
-    for( int i = 0; i < leafObjectIndex; ++i )
+    for( int i = 0; i < int( leafObjects.size() ); ++i )
     {
         std::cout << leafObjects[ i ] << ", ";
     }
@@ -314,16 +426,114 @@ void GLTracer::Draw()
 {
     setupRenderTexture();
 
-    // Update world objects and prepare kD tree
-    bufferPrimitives( scene->GetUpdatedObjects() );
+    // Upload world objects changed this frame and prepare kD tree
+    bufferUpdatedPrimitives( scene->GetPrimitiveStore() );
 #if ACCELL_STRUCTURE == ACC_GRID
-    bufferGrid();
+    if( m_grid->Update( scene->GetObjects(), scene->GetPrimitiveStore(), m_camera->GetPosition(), glm::vec3( m_camera->GetRotation() * glm::vec4( 0, 0, -1, 0 ) ) ) )
+    {
+        bufferGrid();
+        setupGridUniforms();
+    }
+    else
+    {
+        bufferGridRange( m_accellStructureTBO, m_grid->GetGridArray(), m_grid->GetDirtyCellFirst(), m_grid->GetDirtyCellLast() );
+        bufferGridRange( m_objectRefTBO, m_grid->GetObjectRefVector().data(), m_grid->GetDirtyRefFirst(), m_grid->GetDirtyRefLast() );
+        bufferGridRange( m_gridOccupancyTBO, m_grid->GetOccupancy().data(), m_grid->GetDirtyCellFirst() / 32, ( m_grid->GetDirtyCellLast() + 31 ) / 32 );
+    }
 #endif
 
 #if ACCELL_STRUCTURE == ACC_KDTREE
-    m_kdTree->BuildTree( scene->GetObjects() );
+    if( !scene->GetPrimitiveStore().GetUpdated().Empty() )
+    {
+        m_kdTree->BuildTree( scene->GetPrimitiveStore() );
+        bufferKDTree();
+        setupKDTreeUniforms();
+    }
+#ifdef DEBUG
     walkKDTree();
-    bufferKDTree();
+#endif
+#endif
+
+#if ACCELL_STRUCTURE == ACC_BVH
+    if( m_bvh->Update( scene->GetPrimitiveStore() ) )
+    {
+        m_compressedBVH->Encode( *m_bvh );
+        bufferBVH();
+        setupBVHUniforms();
+    }
+    else if( m_bvh->GetDirtyFirst() < m_bvh->GetDirtyLast() )
+    {
+        if( m_compressedBVH->Refit( *m_bvh ) )
+        {
+            bufferBVH();
+            setupBVHUniforms();
+        }
+        else
+        {
+            bufferBVHNodes( m_compressedBVH->GetDirtyFirst(), m_compressedBVH->GetDirtyLast() );
+        }
+    }
+#endif
+
+#if ACCELL_STRUCTURE == ACC_TWO_LEVEL_GRID
+    if( !scene->GetPrimitiveStore().GetUpdated().Empty() )
+    {
+        m_twoLevelGrid->Build( scene->GetPrimitiveStore() );
+        bufferTwoLevelGrid();
+        setupTwoLevelGridUniforms();
+    }
+#endif
+
+#if ACCELL_STRUCTURE == ACC_HASHED_GRID
+    if( !scene->GetPrimitiveStore().GetUpdated().Empty() )
+    {
+        m_hashedGrid->Build( scene->GetPrimitiveStore() );
+        bufferHashedGrid();
+        setupHashedGridUniforms();
+    }
+#endif
+
+#if ACCELL_STRUCTURE == ACC_OCTREE
+    if( !scene->GetPrimitiveStore().GetUpdated().Empty() )
+    {
+        m_octree->Build( scene->GetPrimitiveStore() );
+        bufferOctree();
+        setupOctreeUniforms();
+    }
+#endif
+
+    // The structures rebuild their unbounded lists along with any change to the primitives
+    if( !scene->GetPrimitiveStore().GetUpdated().Empty() )
+    {
+        bufferUnbounded();
+    }
+
+#ifdef RENDER_CPU_REFERENCE
+#if ACCELL_STRUCTURE == ACC_BVH
+    // Only the CPU reference reads the wide BVH, so it is collapsed here rather than with every update
+    if( m_bvh->GetDirtyFirst() < m_bvh->GetDirtyLast() )
+    {
+        m_wideBVH->Collapse( *m_bvh );
+    }
+#endif
+
+    CPUTracerView view;
+    view.CameraPos = m_camera->GetPosition();
+    view.CameraRot = m_camera->GetRotation();
+    view.FOV = glm::radians( FOV );
+    view.AmbientIntensity = AMBIENT_INTENSITY;
+    view.SkyLightDirection = skyLightDirection;
+#if ACCELL_STRUCTURE == ACC_BVH
+    m_cpuTracer->Render( scene->GetObjects(), scene->GetPrimitiveStore(), m_wideBVH, view );
+#elif ACCELL_STRUCTURE == ACC_TWO_LEVEL_GRID
+    m_cpuTracer->Render( scene->GetObjects(), scene->GetPrimitiveStore(), m_twoLevelGrid, view );
+#elif ACCELL_STRUCTURE == ACC_HASHED_GRID
+    m_cpuTracer->Render( scene->GetObjects(), scene->GetPrimitiveStore(), m_hashedGrid, view );
+#elif ACCELL_STRUCTURE == ACC_OCTREE
+    m_cpuTracer->Render( scene->GetObjects(), scene->GetPrimitiveStore(), m_octree, view );
+#else
+    m_cpuTracer->Render( scene->GetObjects(), scene->GetPrimitiveStore(), m_grid, view );
+#endif
 #endif
 
     // Update uniforms
@@ -407,86 +617,90 @@ void GLTracer::Draw()
     }
 }
 
-// Buffers the entire contents of m_primitives to the info texture
-void GLTracer::BufferPrimitive( const Primitive* Primitive, const int idx )
+// Buffers a single primitive to its packet in the info texture
+void GLTracer::BufferPrimitive( const PrimitiveStore& primitives, PrimitiveHandle handle )
 {
-    // Set buffer data
+    GLintptr offset = handle * INFO_PACKET_SIZE * sizeof( glm::vec4 );
+    GLsizeiptr length = INFO_PACKET_SIZE * sizeof( glm::vec4 );
+
     GL(glBindBuffer( GL_TEXTURE_BUFFER, m_objectInfoTBO ));
-    glm::vec4* p = ( glm::vec4* ) glMapBuffer( GL_TEXTURE_BUFFER, GL_WRITE_ONLY );
+    glm::vec4* p = ( glm::vec4* ) glMapBufferRange( GL_TEXTURE_BUFFER, offset, length, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT );
+
+    writePrimitivePacket( p, primitives, handle );
+
+    GL(glUnmapBuffer( GL_TEXTURE_BUFFER ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
+}
+
+// Writes a primitive's info packet ( INFO_PACKET_SIZE texels ) to mapped memory at p
+void GLTracer::writePrimitivePacket( glm::vec4* p, const PrimitiveStore& primitives, PrimitiveHandle handle )
+{
+    Primitive::ObjectType type = primitives.GetTypes()[ handle ];
+    const PrimitiveTransform& transform = primitives.GetTransforms()[ handle ];
+    const ObjectMaterial& material = primitives.GetMaterial( handle );
 
     // Shared parameters
     // Info Cell
-    p[ ( idx * INFO_PACKET_SIZE ) + 0 ] = glm::vec4( Primitive->ID, // ID
-                                                  ( GLfloat )Primitive->Type,
-                                                  -1.0f,
-                                                  -1.0f );
+    p[ 0 ] = glm::vec4( handle, // ID
+                        ( GLfloat )type,
+                        -1.0f,
+                        -1.0f );
 
     // World Matrix
-    glm::mat4 transMatrix = glm::translate( glm::mat4(1.0), Primitive->Position );
-    glm::mat4 rotMatrix = glm::mat4_cast( Primitive->Orientation );
-    glm::mat4 scaleMatrix = glm::scale( glm::mat4(1.0), Primitive->Scale );
-
-
-    glm::mat4 worldMatrix = transMatrix * rotMatrix * scaleMatrix;
     for( uint16_t o = 0; o < 4; o++ )
     {
-        p[ ( idx * INFO_PACKET_SIZE ) + 1 + o ] = worldMatrix[ o ];
+        p[ 1 + o ] = transform.World[ o ];
     }
 
     // Inverse World Matrix
-    glm::mat4 inverseWorldMatrix = glm::inverse( worldMatrix );
     for( uint16_t o = 0; o < 4; o++ )
     {
-        p[ ( idx * INFO_PACKET_SIZE ) + 5 + o ] = inverseWorldMatrix[ o ];
+        p[ 5 + o ] = transform.InverseWorld[ o ];
     }
 
     // Normal Matrix
-    glm::mat4 normalMatrix = glm::inverseTranspose( worldMatrix );
     for( uint16_t o = 0; o < 4; o++ )
     {
-        p[ ( idx * INFO_PACKET_SIZE ) + 9 + o ] = normalMatrix[ o ];
+        p[ 9 + o ] = transform.Normal[ o ];
     }
 
     // Material
     // Type]#
-    p[ ( idx * INFO_PACKET_SIZE ) + 13 ] = glm::vec4( ( GLfloat )Primitive->Material.Type,
-                                                  -1.0f,
-                                                  -1.0f,
-                                                  -1.0f );
+    p[ 13 ] = glm::vec4( ( GLfloat )material.Type,
+                         -1.0f,
+                         -1.0f,
+                         -1.0f );
 
     // Color
-    p[ ( idx * INFO_PACKET_SIZE ) + 14 ] = Primitive->Material.Color;
+    p[ 14 ] = material.Color;
 
     // Lighting
-    p[ ( idx * INFO_PACKET_SIZE ) + 15 ] = glm::vec4( Primitive->Material.Diffuse,
-                                                     Primitive->Material.Specular,
-                                                     Primitive->Material.SpecularFactor,
-                                                     Primitive->Material.Emissive );
+    p[ 15 ] = glm::vec4( material.Diffuse,
+                         material.Specular,
+                         material.SpecularFactor,
+                         material.Emissive );
 
     // Effects
-    p[ ( idx * INFO_PACKET_SIZE ) + 16 ] = glm::vec4( Primitive->Material.Reflection,
-                                                     Primitive->Material.RefractiveIndex,
-                                                     Primitive->Material.CastShadow,
-                                                     -1.0 );
+    p[ 16 ] = glm::vec4( material.Reflection,
+                         material.RefractiveIndex,
+                         material.CastShadow,
+                         -1.0 );
 
 
     // Portal Offset / Spacewarp Factor
-    p[ ( idx * INFO_PACKET_SIZE ) + 17 ] = glm::vec4( Primitive->Material.PortalOffset,
-                                                  0.0f );
+    p[ 17 ] = glm::vec4( material.PortalOffset,
+                         0.0f );
 
     // Portal Rotation AxisAngle
-    p[ ( idx * INFO_PACKET_SIZE ) + 18 ] = glm::vec4( Primitive->Material.PortalAxis,
-                                                      Primitive->Material.PortalAngle );
+    p[ 18 ] = glm::vec4( material.PortalAxis,
+                         material.PortalAngle );
 
     // Object-specific parameters
     // Sides ( ConvexPoly )
-    p[ ( idx * INFO_PACKET_SIZE ) + 19 ] = glm::vec4( Primitive->Sides,
-                                                     -1.0f,
-                                                     -1.0f,
-                                                     -1.0f );
-
-    GL(glUnmapBuffer( GL_TEXTURE_BUFFER ));
-    GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
+    p[ 19 ] = glm::vec4( primitives.GetSides()[ handle ],
+                         -1.0f,
+                         -1.0f,
+                         -1.0f );
 }
 
 // Setup GLFW and GLEW to obtain an >= OpenGL 3.1 context and open a window
@@ -663,7 +877,12 @@ void GLTracer::compileShaders()
         { STR_BOOL, "DISABLE_LIGHTING", STR_FALSE },
         { STR_BOOL, "DISABLE_SHADOWS", STR_FALSE },
         { STR_BOOL, "LOW_ACCURACY_MODE", STR_FALSE },
-        { STR_BOOL, "DRAW_DEPTH_BUFFER", STR_FALSE }
+        { STR_BOOL, "DRAW_DEPTH_BUFFER", STR_FALSE },
+        { STR_INT, "ACCELL_STRUCTURE", std::to_string( ACCELL_STRUCTURE ) },
+        { STR_INT, "KD_STACK_SIZE", std::to_string( KD_MAX_DEPTH ) },
+        { STR_INT, "BVH_STACK_SIZE", std::to_string( BVH_MAX_DEPTH ) },
+        { STR_INT, "MAILBOX_SIZE", std::to_string( MAILBOX_SIZE ) },
+        { STR_INT, "OCTREE_STACK_SIZE", std::to_string( OCTREE_MAX_DEPTH + 1 ) }
     };
     m_raytracerFS->Compile( &rtConstants );
 
@@ -740,17 +959,59 @@ void GLTracer::setupUniforms()
     GL(glUniform1f( m_uniform_AmbientIntensity, AMBIENT_INTENSITY ));
     GL(glUniform4f( m_uniform_SkyLightColor, 1.0, 1.0, 1.0, 1.0 ));
 
-    GL(glUniform1i( glGetUniformLocation( m_raytracerProgram, "GridSubdivisions" ), m_grid->GetSubdivisions() ));
-    glm::vec3 p0 = m_grid->GetMinBound();
-    GL(glUniform3f( glGetUniformLocation( m_raytracerProgram, "GridMinBound" ), p0.x, p0.y, p0.z ));
-    glm::vec3 p1 = m_grid->GetMaxBound();
-    GL(glUniform3f( glGetUniformLocation( m_raytracerProgram, "GridMaxBound" ), p1.x, p1.y, p1.z ));
-    glm::vec3 cs = m_grid->GetCellSize();
-    GL(glUniform3f( glGetUniformLocation( m_raytracerProgram, "GridCellSize" ), cs.x, cs.y, cs.z ));
+#if ACCELL_STRUCTURE == ACC_GRID
+    setupGridUniforms();
+#endif
+
+#if ACCELL_STRUCTURE == ACC_KDTREE
+    setupKDTreeUniforms();
+#endif
+
+#if ACCELL_STRUCTURE == ACC_BVH
+    setupBVHUniforms();
+#endif
+
+#if ACCELL_STRUCTURE == ACC_TWO_LEVEL_GRID
+    setupTwoLevelGridUniforms();
+#endif
+
+#if ACCELL_STRUCTURE == ACC_HASHED_GRID
+    setupHashedGridUniforms();
+#endif
+
+#if ACCELL_STRUCTURE == ACC_OCTREE
+    setupOctreeUniforms();
+#endif
+
+    GL(glUniform1i( glGetUniformLocation( m_raytracerProgram, "ObjectCount" ), scene->GetPrimitiveStore().Size() ));
+    GL(glUniform1i( glGetUniformLocation( m_raytracerProgram, "ObjectInfoSize" ), INFO_PACKET_SIZE ));
+    GL(glUniform1i( glGetUniformLocation( m_raytracerProgram, "UnboundedCount" ), m_unboundedCount ));
 
     GL(glUniform1i( glGetUniformLocation( m_raytracerProgram, "PrimitiveSampler" ), 2 ));
     GL(glUniform1i( glGetUniformLocation( m_raytracerProgram, "AccellStructureSampler" ), 3 ));
     GL(glUniform1i( glGetUniformLocation( m_raytracerProgram, "ObjectRefSampler" ), 4 ));
+    GL(glUniform1i( glGetUniformLocation( m_raytracerProgram, "KDTreeSampler" ), 5 ));
+    GL(glUniform1i( glGetUniformLocation( m_raytracerProgram, "KDTreeObjectRefSampler" ), 6 ));
+    GL(glUniform1i( glGetUniformLocation( m_raytracerProgram, "BVHSampler" ), 7 ));
+    GL(glUniform1i( glGetUniformLocation( m_raytracerProgram, "BVHObjectRefSampler" ), 8 ));
+    GL(glUniform1i( glGetUniformLocation( m_raytracerProgram, "TwoLevelGridSampler" ), 9 ));
+    GL(glUniform1i( glGetUniformLocation( m_raytracerProgram, "TwoLevelGridObjectRefSampler" ), 10 ));
+    GL(glUniform1i( glGetUniformLocation( m_raytracerProgram, "HashedGridSampler" ), 11 ));
+    GL(glUniform1i( glGetUniformLocation( m_raytracerProgram, "HashedGridObjectRefSampler" ), 12 ));
+    GL(glUniform1i( glGetUniformLocation( m_raytracerProgram, "GridOccupancySampler" ), 13 ));
+    GL(glUniform1i( glGetUniformLocation( m_raytracerProgram, "UnboundedSampler" ), 14 ));
+}
+
+// The kD tree bounds change with every build, so these are refreshed alongside it
+void GLTracer::setupKDTreeUniforms()
+{
+    GL(glUseProgram( m_raytracerProgram ));
+
+    const Bounds& bounds = m_kdTree->GetBounds();
+    GL(glUniform3f( glGetUniformLocation( m_raytracerProgram, "KDTreeMinBound" ), bounds.Min.x, bounds.Min.y, bounds.Min.z ));
+    GL(glUniform3f( glGetUniformLocation( m_raytracerProgram, "KDTreeMaxBound" ), bounds.Max.x, bounds.Max.y, bounds.Max.z ));
+    glm::vec3 quantum = m_kdTree->GetSplitQuantum();
+    GL(glUniform3f( glGetUniformLocation( m_raytracerProgram, "KDTreeSplitQuantum" ), quantum.x, quantum.y, quantum.z ));
 }
 
 // Performs initial setup of the object info texture and it's buffer
@@ -759,7 +1020,7 @@ void GLTracer::generateObjectInfoTex()
     GL(glGenBuffers( 1, &m_objectInfoTBO ));
     GL(glBindBuffer( GL_TEXTURE_BUFFER, m_objectInfoTBO ));
 
-    int bufferSize = scene->GetObjects().size() * INFO_PACKET_SIZE * sizeof( glm::vec4 );
+    int bufferSize = scene->GetPrimitiveStore().Size() * INFO_PACKET_SIZE * sizeof( glm::vec4 );
     GL(glBufferData( GL_TEXTURE_BUFFER, bufferSize, 0, GL_DYNAMIC_DRAW ));
 
     // Create object info texture & bind it to the buffer
@@ -770,147 +1031,460 @@ void GLTracer::generateObjectInfoTex()
     GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
 }
 
-// Buffers the provided set of world objects to the info texture
-void GLTracer::bufferPrimitives( std::vector< Primitive* > primitives )
+// Buffers every primitive in the store to the info texture with a single mapping
+void GLTracer::bufferPrimitives( const PrimitiveStore& primitives )
 {
     // Load world objects into info texture
-    for( uint16_t i = 0; i < primitives.size(); i++ )
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, m_objectInfoTBO ));
+    glm::vec4* p = ( glm::vec4* ) glMapBuffer( GL_TEXTURE_BUFFER, GL_WRITE_ONLY );
+
+    for( int i = 0; i < primitives.Size(); i++ )
     {
-        BufferPrimitive( primitives[ i ], i );
+        writePrimitivePacket( p + i * INFO_PACKET_SIZE, primitives, i );
     }
 
-    GL(glUseProgram( m_raytracerProgram ));
-    GL(glUniform1i( glGetUniformLocation( m_raytracerProgram, "ObjectCount" ), scene->GetObjects().size() ));
-    GL(glUniform1i( glGetUniformLocation( m_raytracerProgram, "ObjectInfoSize" ), INFO_PACKET_SIZE ));
+    GL(glUnmapBuffer( GL_TEXTURE_BUFFER ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
 }
 
-// Performs initial setup of the grid texture and it's buffer
+// Buffers only the primitives marked as updated since the last Scene::Update
+void GLTracer::bufferUpdatedPrimitives( const PrimitiveStore& primitives )
+{
+    ArrayView< PrimitiveHandle > updated = primitives.GetUpdated();
+    for( int i = 0; i < updated.Size(); i++ )
+    {
+        BufferPrimitive( primitives, updated[ i ] );
+    }
+}
+
+// Performs initial setup of the grid textures and their buffers.
+// Cells and references are single 32 bit integers per texel, occupancy is 32 cells to a texel
 void GLTracer::generateGridTex()
 {
-    // Generate tree texture
+    // Generate grid texture, one first reference per cell
     GL(glGenBuffers( 1, &m_accellStructureTBO ));
     GL(glBindBuffer( GL_TEXTURE_BUFFER, m_accellStructureTBO ));
 
-    int gridBufferSize = m_grid->GetGridArrayLength() * 4 * sizeof( float );
+    int gridBufferSize = m_grid->GetGridArrayLength() * sizeof( int );
     GL(glBufferData( GL_TEXTURE_BUFFER, gridBufferSize, 0, GL_DYNAMIC_DRAW ));
 
     // Create accell structure texture & bind it to the buffer
     GL(glGenTextures( 1, &m_accellStructureTex ));
     GL(glActiveTexture( GL_TEXTURE3 ));
     GL(glBindTexture( GL_TEXTURE_BUFFER, m_accellStructureTex ));
-    GL(glTexBuffer( GL_TEXTURE_BUFFER, GL_RGBA32F, m_accellStructureTBO ));
+    GL(glTexBuffer( GL_TEXTURE_BUFFER, GL_R32I, m_accellStructureTBO ));
     GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
 
     // Generate object reference buffer
     GL(glGenBuffers( 1, &m_objectRefTBO ));
     GL(glBindBuffer( GL_TEXTURE_BUFFER, m_objectRefTBO ));
 
-    int objectRefBufferSize = m_grid->GetObjectRefVector().size() * 4 * sizeof( float );
+    int objectRefBufferSize = m_grid->GetObjectRefVector().size() * sizeof( int );
     GL(glBufferData( GL_TEXTURE_BUFFER, objectRefBufferSize, 0, GL_DYNAMIC_DRAW ));
 
     // Create object reference texture & bind it to the buffer
     GL(glGenTextures( 1, &m_objectRefTex ));
     GL(glActiveTexture( GL_TEXTURE4 ));
     GL(glBindTexture( GL_TEXTURE_BUFFER, m_objectRefTex ));
-    GL(glTexBuffer( GL_TEXTURE_BUFFER, GL_RGBA32F, m_objectRefTBO ));
+    GL(glTexBuffer( GL_TEXTURE_BUFFER, GL_R32I, m_objectRefTBO ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
+
+    // Generate occupancy buffer
+    GL(glGenBuffers( 1, &m_gridOccupancyTBO ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, m_gridOccupancyTBO ));
+
+    int occupancyBufferSize = m_grid->GetOccupancy().size() * sizeof( uint32_t );
+    GL(glBufferData( GL_TEXTURE_BUFFER, occupancyBufferSize, 0, GL_DYNAMIC_DRAW ));
+
+    // Create occupancy texture & bind it to the buffer
+    GL(glGenTextures( 1, &m_gridOccupancyTex ));
+    GL(glActiveTexture( GL_TEXTURE13 ));
+    GL(glBindTexture( GL_TEXTURE_BUFFER, m_gridOccupancyTex ));
+    GL(glTexBuffer( GL_TEXTURE_BUFFER, GL_R32UI, m_gridOccupancyTBO ));
     GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
 }
 
-// Buffers the grid into it's respective texture
+// Buffers the grid into it's respective textures, respecifying all buffers at the grid's current sizes
 void GLTracer::bufferGrid()
 {
+    const std::vector< int >& objectRefVector = m_grid->GetObjectRefVector();
+    const std::vector< uint32_t >& occupancy = m_grid->GetOccupancy();
+
     GL(glBindBuffer( GL_TEXTURE_BUFFER, m_accellStructureTBO ));
-    GL(glm::vec4* structureBuffer = ( glm::vec4* ) glMapBuffer( GL_TEXTURE_BUFFER, GL_WRITE_ONLY ));
+    GL(glBufferData( GL_TEXTURE_BUFFER, m_grid->GetGridArrayLength() * sizeof( int ), m_grid->GetGridArray(), GL_DYNAMIC_DRAW ));
 
-    const int* grid = m_grid->GetGridArray();
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, m_objectRefTBO ));
+    GL(glBufferData( GL_TEXTURE_BUFFER, objectRefVector.size() * sizeof( int ), objectRefVector.data(), GL_DYNAMIC_DRAW ));
 
-    for( int i = 0; i < m_grid->GetGridArrayLength(); ++i )
-    {
-        structureBuffer[ i ][ 0 ] = ( float )grid[ i ];
-    }
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, m_gridOccupancyTBO ));
+    GL(glBufferData( GL_TEXTURE_BUFFER, occupancy.size() * sizeof( uint32_t ), occupancy.data(), GL_DYNAMIC_DRAW ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
+}
 
-    GL(glUnmapBuffer( GL_TEXTURE_BUFFER ));
+// Buffers 32 bit values [ first, last ) of a grid array, one per texel
+void GLTracer::bufferGridRange( GLuint buffer, const void* values, int first, int last )
+{
+    if( first >= last ) return;
+
+    GLintptr offset = first * sizeof( int );
+    GLsizeiptr length = ( last - first ) * sizeof( int );
+
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, buffer ));
+    GL(glBufferSubData( GL_TEXTURE_BUFFER, offset, length, ( const char* ) values + offset ));
     GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
+}
 
-    // Buffer the leaf nodes' object references
-    GL(glBindBuffer( GL_TEXTURE_BUFFER, m_objectRefTBO ));
-    GL(glm::vec4* refBuffer = ( glm::vec4* ) glMapBuffer( GL_TEXTURE_BUFFER, GL_WRITE_ONLY ));
+// Sends the grid's bounds and resolution, which change whenever it is refitted
+void GLTracer::setupGridUniforms()
+{
+    glm::ivec3 subdivisions = m_grid->GetSubdivisions();
+    GL(glUniform3i( glGetUniformLocation( m_raytracerProgram, "GridSubdivisions" ), subdivisions.x, subdivisions.y, subdivisions.z ));
+    glm::vec3 p0 = m_grid->GetMinBound();
+    GL(glUniform3f( glGetUniformLocation( m_raytracerProgram, "GridMinBound" ), p0.x, p0.y, p0.z ));
+    glm::vec3 p1 = m_grid->GetMaxBound();
+    GL(glUniform3f( glGetUniformLocation( m_raytracerProgram, "GridMaxBound" ), p1.x, p1.y, p1.z ));
+    glm::vec3 cs = m_grid->GetCellSize();
+    GL(glUniform3f( glGetUniformLocation( m_raytracerProgram, "GridCellSize" ), cs.x, cs.y, cs.z ));
+}
 
-    const std::vector< int > objectRefVector = m_grid->GetObjectRefVector();
+// Performs initial setup of the unbounded primitive list's texture and buffer
+void GLTracer::generateUnboundedTex()
+{
+    GL(glGenBuffers( 1, &m_unboundedTBO ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, m_unboundedTBO ));
+    GL(glBufferData( GL_TEXTURE_BUFFER, 0, 0, GL_DYNAMIC_DRAW ));
+
+    GL(glGenTextures( 1, &m_unboundedTex ));
+    GL(glActiveTexture( GL_TEXTURE14 ));
+    GL(glBindTexture( GL_TEXTURE_BUFFER, m_unboundedTex ));
+    GL(glTexBuffer( GL_TEXTURE_BUFFER, GL_R32I, m_unboundedTBO ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
+}
 
-    for( int i = 0; i < objectRefVector.size(); ++i )
-    {
-        refBuffer[ i ][ 0 ] = ( float )objectRefVector[ i ];
-    }
+// Buffers the primitives the active structure keeps out of its cells or nodes, and sends their count
+void GLTracer::bufferUnbounded()
+{
+    UnboundedList none;
+    const UnboundedList* unbounded = &none;
+#if ACCELL_STRUCTURE == ACC_GRID
+    unbounded = &m_grid->GetUnbounded();
+#elif ACCELL_STRUCTURE == ACC_KDTREE
+    unbounded = &m_kdTree->GetUnbounded();
+#elif ACCELL_STRUCTURE == ACC_BVH
+    unbounded = &m_bvh->GetUnbounded();
+#elif ACCELL_STRUCTURE == ACC_TWO_LEVEL_GRID
+    unbounded = &m_twoLevelGrid->GetUnbounded();
+#elif ACCELL_STRUCTURE == ACC_HASHED_GRID
+    unbounded = &m_hashedGrid->GetUnbounded();
+#elif ACCELL_STRUCTURE == ACC_OCTREE
+    unbounded = &m_octree->GetUnbounded();
+#endif
 
-    GL(glUnmapBuffer( GL_TEXTURE_BUFFER ));
+    const std::vector< int >& primitives = unbounded->GetPrimitives();
+    m_unboundedCount = unbounded->Size();
+
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, m_unboundedTBO ));
+    GL(glBufferData( GL_TEXTURE_BUFFER, primitives.size() * sizeof( int ), primitives.data(), GL_DYNAMIC_DRAW ));
     GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
+
+    GL(glUniform1i( glGetUniformLocation( m_raytracerProgram, "UnboundedCount" ), m_unboundedCount ));
 }
 
-// Performs initial setup of the kD tree texture and it's buffer
+// Performs initial setup of the kD tree textures and their buffers, both integer formats on their own texture units
 void GLTracer::generateKDTreeTex()
 {
-    // Generate tree texture
+    // Generate tree texture, one ivec2 per node
     GL(glGenBuffers( 1, &m_accellStructureTBO ));
     GL(glBindBuffer( GL_TEXTURE_BUFFER, m_accellStructureTBO ));
 
-    int treeBufferSize = m_kdTree->GetTreeVector().size() * sizeof( glm::vec4 );
+    int treeBufferSize = m_kdTree->GetTreeVector().size() * sizeof( glm::ivec2 );
     GL(glBufferData( GL_TEXTURE_BUFFER, treeBufferSize, 0, GL_DYNAMIC_DRAW ));
 
     // Create accell structure texture & bind it to the buffer
     GL(glGenTextures( 1, &m_accellStructureTex ));
-    GL(glActiveTexture( GL_TEXTURE3 ));
+    GL(glActiveTexture( GL_TEXTURE5 ));
     GL(glBindTexture( GL_TEXTURE_BUFFER, m_accellStructureTex ));
-    GL(glTexBuffer( GL_TEXTURE_BUFFER, GL_RGBA32F, m_accellStructureTBO ));
+    GL(glTexBuffer( GL_TEXTURE_BUFFER, GL_RG32I, m_accellStructureTBO ));
     GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
 
     // Generate object reference buffer
     GL(glGenBuffers( 1, &m_objectRefTBO ));
     GL(glBindBuffer( GL_TEXTURE_BUFFER, m_objectRefTBO ));
 
-    int leafObjectBufferSize = m_kdTree->GetLeafObjectsVector().size() * sizeof( float );
+    int leafObjectBufferSize = m_kdTree->GetLeafObjectsVector().size() * sizeof( int );
     GL(glBufferData( GL_TEXTURE_BUFFER, leafObjectBufferSize, 0, GL_DYNAMIC_DRAW ));
 
     // Create object reference texture & bind it to the buffer
     GL(glGenTextures( 1, &m_objectRefTex ));
-    GL(glActiveTexture( GL_TEXTURE4 ));
+    GL(glActiveTexture( GL_TEXTURE6 ));
     GL(glBindTexture( GL_TEXTURE_BUFFER, m_objectRefTex ));
-    GL(glTexBuffer( GL_TEXTURE_BUFFER, GL_RGBA32F, m_objectRefTBO ));
+    GL(glTexBuffer( GL_TEXTURE_BUFFER, GL_R32I, m_objectRefTBO ));
     GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
 }
 
-// Buffers the kD Tree into it's respective texture
+// Buffers the kD Tree into it's respective textures. The tree changes shape between
+// builds, so the storage is respecified at the current size rather than mapped
 void GLTracer::bufferKDTree()
 {
-    // Buffer the tree itself
+    const std::vector< glm::ivec2 >& treeVector = m_kdTree->GetTreeVector();
+
     GL(glBindBuffer( GL_TEXTURE_BUFFER, m_accellStructureTBO ));
-    GL(glm::vec4* treeBuffer = ( glm::vec4* ) glMapBuffer( GL_TEXTURE_BUFFER, GL_WRITE_ONLY ));
+    GL(glBufferData( GL_TEXTURE_BUFFER, treeVector.size() * sizeof( glm::ivec2 ), treeVector.data(), GL_DYNAMIC_DRAW ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
 
-    const std::vector< glm::vec4 > treeVector = m_kdTree->GetTreeVector();
+    // Buffer the leaf nodes' object references
+    const std::vector< int >& leafObjectVector = m_kdTree->GetLeafObjectsVector();
 
-    for( int i = 0; i < treeVector.size(); ++i )
-    {
-        treeBuffer[ i ] = treeVector[ i ];
-    }
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, m_objectRefTBO ));
+    GL(glBufferData( GL_TEXTURE_BUFFER, leafObjectVector.size() * sizeof( int ), leafObjectVector.data(), GL_DYNAMIC_DRAW ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
+}
 
-    GL(glUnmapBuffer( GL_TEXTURE_BUFFER ));
+// Performs initial setup of the BVH textures and their buffers, on their own texture units
+void GLTracer::generateBVHTex()
+{
+    // Generate node texture, one texel per compressed node
+    GL(glGenBuffers( 1, &m_accellStructureTBO ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, m_accellStructureTBO ));
+
+    int nodeBufferSize = m_compressedBVH->GetNodes().size() * sizeof( CompressedBVHNode );
+    GL(glBufferData( GL_TEXTURE_BUFFER, nodeBufferSize, 0, GL_DYNAMIC_DRAW ));
+
+    // Create accell structure texture & bind it to the buffer
+    GL(glGenTextures( 1, &m_accellStructureTex ));
+    GL(glActiveTexture( GL_TEXTURE7 ));
+    GL(glBindTexture( GL_TEXTURE_BUFFER, m_accellStructureTex ));
+    GL(glTexBuffer( GL_TEXTURE_BUFFER, GL_RGBA32I, m_accellStructureTBO ));
     GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
 
-    // Buffer the leaf nodes' object references
+    // Generate object reference buffer
+    GL(glGenBuffers( 1, &m_objectRefTBO ));
     GL(glBindBuffer( GL_TEXTURE_BUFFER, m_objectRefTBO ));
-    float* leafObjectBuffer = ( float* ) glMapBuffer( GL_TEXTURE_BUFFER, GL_WRITE_ONLY );
 
-    const std::vector< int > leafObjectVector = m_kdTree->GetLeafObjectsVector();
+    int referenceBufferSize = m_compressedBVH->GetReferences().size() * sizeof( int );
+    GL(glBufferData( GL_TEXTURE_BUFFER, referenceBufferSize, 0, GL_DYNAMIC_DRAW ));
 
-    for( int i = 0; i < leafObjectVector.size(); ++i )
-    {
-        leafObjectBuffer[ i ] = ( float )leafObjectVector[ i ];
-    }
+    // Create object reference texture & bind it to the buffer
+    GL(glGenTextures( 1, &m_objectRefTex ));
+    GL(glActiveTexture( GL_TEXTURE8 ));
+    GL(glBindTexture( GL_TEXTURE_BUFFER, m_objectRefTex ));
+    GL(glTexBuffer( GL_TEXTURE_BUFFER, GL_R32I, m_objectRefTBO ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
+}
 
-    GL(glUnmapBuffer( GL_TEXTURE_BUFFER ));
+// Buffers the compressed BVH nodes as they are laid out in memory, and the -1 terminated leaf reference lists
+void GLTracer::bufferBVH()
+{
+    const std::vector< CompressedBVHNode >& nodes = m_compressedBVH->GetNodes();
+
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, m_accellStructureTBO ));
+    GL(glBufferData( GL_TEXTURE_BUFFER, nodes.size() * sizeof( CompressedBVHNode ), nodes.data(), GL_DYNAMIC_DRAW ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
+
+    const std::vector< int >& references = m_compressedBVH->GetReferences();
+
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, m_objectRefTBO ));
+    GL(glBufferData( GL_TEXTURE_BUFFER, references.size() * sizeof( int ), references.data(), GL_DYNAMIC_DRAW ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
+}
+
+// Buffers the requantised nodes [ first, last ) in place, references are unchanged by a refit
+void GLTracer::bufferBVHNodes( int first, int last )
+{
+    if( first >= last ) return;
+
+    const std::vector< CompressedBVHNode >& nodes = m_compressedBVH->GetNodes();
+
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, m_accellStructureTBO ));
+    GL(glBufferSubData( GL_TEXTURE_BUFFER, first * sizeof( CompressedBVHNode ), ( last - first ) * sizeof( CompressedBVHNode ), nodes.data() + first ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
+}
+
+// The root's exact bounds, every node's quantised bounds decode from them
+void GLTracer::setupBVHUniforms()
+{
+    const Bounds& bounds = m_compressedBVH->GetBounds();
+    GL(glUniform3f( glGetUniformLocation( m_raytracerProgram, "BVHMinBound" ), bounds.Min.x, bounds.Min.y, bounds.Min.z ));
+    GL(glUniform3f( glGetUniformLocation( m_raytracerProgram, "BVHMaxBound" ), bounds.Max.x, bounds.Max.y, bounds.Max.z ));
+}
+
+// Performs initial setup of the two level grid textures and their buffers, both integer formats
+void GLTracer::generateTwoLevelGridTex()
+{
+    // Generate cell texture, one ivec2 per cell of either level
+    GL(glGenBuffers( 1, &m_accellStructureTBO ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, m_accellStructureTBO ));
+
+    int cellBufferSize = m_twoLevelGrid->GetCells().size() * sizeof( TwoLevelGridCell );
+    GL(glBufferData( GL_TEXTURE_BUFFER, cellBufferSize, 0, GL_DYNAMIC_DRAW ));
+
+    // Create accell structure texture & bind it to the buffer
+    GL(glGenTextures( 1, &m_accellStructureTex ));
+    GL(glActiveTexture( GL_TEXTURE9 ));
+    GL(glBindTexture( GL_TEXTURE_BUFFER, m_accellStructureTex ));
+    GL(glTexBuffer( GL_TEXTURE_BUFFER, GL_RG32I, m_accellStructureTBO ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
+
+    // Generate object reference buffer
+    GL(glGenBuffers( 1, &m_objectRefTBO ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, m_objectRefTBO ));
+
+    int referenceBufferSize = m_twoLevelGrid->GetReferences().size() * sizeof( int );
+    GL(glBufferData( GL_TEXTURE_BUFFER, referenceBufferSize, 0, GL_DYNAMIC_DRAW ));
+
+    // Create object reference texture & bind it to the buffer
+    GL(glGenTextures( 1, &m_objectRefTex ));
+    GL(glActiveTexture( GL_TEXTURE10 ));
+    GL(glBindTexture( GL_TEXTURE_BUFFER, m_objectRefTex ));
+    GL(glTexBuffer( GL_TEXTURE_BUFFER, GL_R32I, m_objectRefTBO ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
+}
+
+// Buffers the cells of both levels and the leaf references, respecified at their current sizes
+void GLTracer::bufferTwoLevelGrid()
+{
+    const std::vector< TwoLevelGridCell >& cells = m_twoLevelGrid->GetCells();
+    const std::vector< int >& references = m_twoLevelGrid->GetReferences();
+
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, m_accellStructureTBO ));
+    GL(glBufferData( GL_TEXTURE_BUFFER, cells.size() * sizeof( TwoLevelGridCell ), cells.data(), GL_DYNAMIC_DRAW ));
+
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, m_objectRefTBO ));
+    GL(glBufferData( GL_TEXTURE_BUFFER, references.size() * sizeof( int ), references.data(), GL_DYNAMIC_DRAW ));
     GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
 }
 
+// Sends the top level's bounds and resolution, which follow the scene on every rebuild
+void GLTracer::setupTwoLevelGridUniforms()
+{
+    glm::ivec3 resolution = m_twoLevelGrid->GetResolution();
+    GL(glUniform3i( glGetUniformLocation( m_raytracerProgram, "TwoLevelGridResolution" ), resolution.x, resolution.y, resolution.z ));
+    glm::vec3 p0 = m_twoLevelGrid->GetBounds().Min;
+    GL(glUniform3f( glGetUniformLocation( m_raytracerProgram, "TwoLevelGridMinBound" ), p0.x, p0.y, p0.z ));
+    glm::vec3 p1 = m_twoLevelGrid->GetBounds().Max;
+    GL(glUniform3f( glGetUniformLocation( m_raytracerProgram, "TwoLevelGridMaxBound" ), p1.x, p1.y, p1.z ));
+    glm::vec3 cs = m_twoLevelGrid->GetCellSize();
+    GL(glUniform3f( glGetUniformLocation( m_raytracerProgram, "TwoLevelGridCellSize" ), cs.x, cs.y, cs.z ));
+}
+
+// Performs initial setup of the hashed grid table and reference textures, both integer formats
+void GLTracer::generateHashedGridTex()
+{
+    // Generate table texture, one ivec4 per slot
+    GL(glGenBuffers( 1, &m_accellStructureTBO ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, m_accellStructureTBO ));
+
+    int tableBufferSize = m_hashedGrid->GetTable().size() * sizeof( HashedGridSlot );
+    GL(glBufferData( GL_TEXTURE_BUFFER, tableBufferSize, 0, GL_DYNAMIC_DRAW ));
+
+    // Create accell structure texture & bind it to the buffer
+    GL(glGenTextures( 1, &m_accellStructureTex ));
+    GL(glActiveTexture( GL_TEXTURE11 ));
+    GL(glBindTexture( GL_TEXTURE_BUFFER, m_accellStructureTex ));
+    GL(glTexBuffer( GL_TEXTURE_BUFFER, GL_RGBA32I, m_accellStructureTBO ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
+
+    // Generate object reference buffer
+    GL(glGenBuffers( 1, &m_objectRefTBO ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, m_objectRefTBO ));
+
+    int referenceBufferSize = m_hashedGrid->GetReferences().size() * sizeof( int );
+    GL(glBufferData( GL_TEXTURE_BUFFER, referenceBufferSize, 0, GL_DYNAMIC_DRAW ));
+
+    // Create object reference texture & bind it to the buffer
+    GL(glGenTextures( 1, &m_objectRefTex ));
+    GL(glActiveTexture( GL_TEXTURE12 ));
+    GL(glBindTexture( GL_TEXTURE_BUFFER, m_objectRefTex ));
+    GL(glTexBuffer( GL_TEXTURE_BUFFER, GL_R32I, m_objectRefTBO ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
+}
+
+// Buffers the table and the cells' reference lists, respecified at their current sizes
+void GLTracer::bufferHashedGrid()
+{
+    const std::vector< HashedGridSlot >& table = m_hashedGrid->GetTable();
+    const std::vector< int >& references = m_hashedGrid->GetReferences();
+
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, m_accellStructureTBO ));
+    GL(glBufferData( GL_TEXTURE_BUFFER, table.size() * sizeof( HashedGridSlot ), table.data(), GL_DYNAMIC_DRAW ));
+
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, m_objectRefTBO ));
+    GL(glBufferData( GL_TEXTURE_BUFFER, references.size() * sizeof( int ), references.data(), GL_DYNAMIC_DRAW ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
+}
+
+// Sends the cell size, table size and the extent of the occupied cells, which change on every rebuild
+void GLTracer::setupHashedGridUniforms()
+{
+    GL(glUniform1f( glGetUniformLocation( m_raytracerProgram, "HashedGridCellSize" ), m_hashedGrid->GetCellSize() ));
+    GL(glUniform1i( glGetUniformLocation( m_raytracerProgram, "HashedGridTableMask" ), int( m_hashedGrid->GetTable().size() ) - 1 ));
+    glm::ivec3 minCell = m_hashedGrid->GetMinCell();
+    GL(glUniform3i( glGetUniformLocation( m_raytracerProgram, "HashedGridMinCell" ), minCell.x, minCell.y, minCell.z ));
+    glm::ivec3 resolution = m_hashedGrid->GetResolution();
+    GL(glUniform3i( glGetUniformLocation( m_raytracerProgram, "HashedGridResolution" ), resolution.x, resolution.y, resolution.z ));
+    glm::vec3 p0 = m_hashedGrid->GetBounds().Min;
+    GL(glUniform3f( glGetUniformLocation( m_raytracerProgram, "HashedGridMinBound" ), p0.x, p0.y, p0.z ));
+    glm::vec3 p1 = m_hashedGrid->GetBounds().Max;
+    GL(glUniform3f( glGetUniformLocation( m_raytracerProgram, "HashedGridMaxBound" ), p1.x, p1.y, p1.z ));
+}
+
+// Performs initial setup of the octree node and reference textures. Raytracer.frag's samplers already hold units 2-14,
+// leaving only unit 15 of the 16 guaranteed, and the octree needs two. Only one structure is built at a time,
+// so these go in the grid's units 3 and 4, read through AccellStructureSampler and ObjectRefSampler
+void GLTracer::generateOctreeTex()
+{
+    // Generate node texture, one ivec2 per node
+    GL(glGenBuffers( 1, &m_accellStructureTBO ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, m_accellStructureTBO ));
+
+    int nodeBufferSize = m_octree->GetNodes().size() * sizeof( OctreeNode );
+    GL(glBufferData( GL_TEXTURE_BUFFER, nodeBufferSize, 0, GL_DYNAMIC_DRAW ));
+
+    // Create accell structure texture & bind it to the buffer
+    GL(glGenTextures( 1, &m_accellStructureTex ));
+    GL(glActiveTexture( GL_TEXTURE3 ));
+    GL(glBindTexture( GL_TEXTURE_BUFFER, m_accellStructureTex ));
+    GL(glTexBuffer( GL_TEXTURE_BUFFER, GL_RG32I, m_accellStructureTBO ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
+
+    // Generate object reference buffer
+    GL(glGenBuffers( 1, &m_objectRefTBO ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, m_objectRefTBO ));
+
+    int referenceBufferSize = m_octree->GetReferences().size() * sizeof( int );
+    GL(glBufferData( GL_TEXTURE_BUFFER, referenceBufferSize, 0, GL_DYNAMIC_DRAW ));
+
+    // Create object reference texture & bind it to the buffer
+    GL(glGenTextures( 1, &m_objectRefTex ));
+    GL(glActiveTexture( GL_TEXTURE4 ));
+    GL(glBindTexture( GL_TEXTURE_BUFFER, m_objectRefTex ));
+    GL(glTexBuffer( GL_TEXTURE_BUFFER, GL_R32I, m_objectRefTBO ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
+}
+
+// Buffers the nodes and the leaves' reference lists, respecified at their current sizes
+void GLTracer::bufferOctree()
+{
+    const std::vector< OctreeNode >& nodes = m_octree->GetNodes();
+    const std::vector< int >& references = m_octree->GetReferences();
+
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, m_accellStructureTBO ));
+    GL(glBufferData( GL_TEXTURE_BUFFER, nodes.size() * sizeof( OctreeNode ), nodes.data(), GL_DYNAMIC_DRAW ));
+
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, m_objectRefTBO ));
+    GL(glBufferData( GL_TEXTURE_BUFFER, references.size() * sizeof( int ), references.data(), GL_DYNAMIC_DRAW ));
+    GL(glBindBuffer( GL_TEXTURE_BUFFER, 0 ));
+}
+
+// Sends the root cube, which changes on every rebuild
+void GLTracer::setupOctreeUniforms()
+{
+    glm::vec3 p0 = m_octree->GetBounds().Min;
+    GL(glUniform3f( glGetUniformLocation( m_raytracerProgram, "OctreeMinBound" ), p0.x, p0.y, p0.z ));
+    glm::vec3 p1 = m_octree->GetBounds().Max;
+    GL(glUniform3f( glGetUniformLocation( m_raytracerProgram, "OctreeMaxBound" ), p1.x, p1.y, p1.z ));
+}
+
 // Updates the OpenGL viewport size and dependent variables
 void GLTracer::callbackResizeWindow( GLFWwindow* window, int width, int height )
 {
@@ -0,0 +1,176 @@
+#include "PrimitiveStore.h"
+
+#include <algorithm>
+
+#include "Simd.h"
+
+PrimitiveHandle PrimitiveStore::Add( const Primitive& primitive )
+{
+    PrimitiveHandle handle = Size();
+
+    m_types.push_back( primitive.Type );
+    m_positions.push_back( primitive.Position );
+    m_orientations.push_back( primitive.Orientation );
+    m_scales.push_back( primitive.Scale );
+    m_sides.push_back( primitive.Sides );
+
+    m_materialIndices.push_back( int( m_materials.size() ) );
+    m_materials.push_back( primitive.Material );
+
+    m_transforms.push_back( PrimitiveTransform() );
+    m_staleFlags.push_back( false );
+    m_updatedFlags.push_back( false );
+    markUpdated( handle );
+
+    return handle;
+}
+
+void PrimitiveStore::Set( PrimitiveHandle handle, const Primitive& primitive )
+{
+    m_types[ handle ] = primitive.Type;
+    m_positions[ handle ] = primitive.Position;
+    m_orientations[ handle ] = primitive.Orientation;
+    m_scales[ handle ] = primitive.Scale;
+    m_sides[ handle ] = primitive.Sides;
+
+    m_materials[ m_materialIndices[ handle ] ] = primitive.Material;
+
+    markUpdated( handle );
+}
+
+// Reassembles a single primitive, for code that still works on the array-of-structures form
+Primitive PrimitiveStore::Get( PrimitiveHandle handle ) const
+{
+    Primitive primitive( m_types[ handle ], m_positions[ handle ], m_orientations[ handle ], m_scales[ handle ] );
+    primitive.ID = handle;
+    primitive.Sides = m_sides[ handle ];
+    primitive.Material = GetMaterial( handle );
+
+    return primitive;
+}
+
+void PrimitiveStore::UpdateTransforms()
+{
+    for( int first = 0; first < int( m_staleTransforms.size() ); first += SIMD_WIDTH )
+    {
+        int count = std::min( SIMD_WIDTH, int( m_staleTransforms.size() ) - first );
+        computeTransforms( &m_staleTransforms[ first ], count );
+    }
+
+    for( int i = 0; i < int( m_staleTransforms.size() ); ++i )
+    {
+        m_staleFlags[ m_staleTransforms[ i ] ] = false;
+    }
+    m_staleTransforms.clear();
+}
+
+void PrimitiveStore::ClearUpdated()
+{
+    for( int i = 0; i < int( m_updated.size() ); ++i )
+    {
+        m_updatedFlags[ m_updated[ i ] ] = false;
+    }
+    m_updated.clear();
+}
+
+void PrimitiveStore::markUpdated( PrimitiveHandle handle )
+{
+    if( !m_staleFlags[ handle ] )
+    {
+        m_staleFlags[ handle ] = true;
+        m_staleTransforms.push_back( handle );
+    }
+
+    if( !m_updatedFlags[ handle ] )
+    {
+        m_updatedFlags[ handle ] = true;
+        m_updated.push_back( handle );
+    }
+}
+
+// Builds the world, inverse world and normal matrices for up to SIMD_WIDTH primitives at once.
+// With world = T * R * S the inverses have closed forms, inverse = S^-1 * R^T * T^-1
+// and normal = R * S^-1 ( plus the translation terms of inverseTranspose ), so no general inversion is needed
+void PrimitiveStore::computeTransforms( const PrimitiveHandle* handles, int count )
+{
+    typedef SimdFloat< SIMD_WIDTH > Float;
+
+    // Gather the inputs into lanes, padding with the first primitive
+    float qx[ SIMD_WIDTH ], qy[ SIMD_WIDTH ], qz[ SIMD_WIDTH ], qw[ SIMD_WIDTH ];
+    float px[ SIMD_WIDTH ], py[ SIMD_WIDTH ], pz[ SIMD_WIDTH ];
+    float sx[ SIMD_WIDTH ], sy[ SIMD_WIDTH ], sz[ SIMD_WIDTH ];
+    for( int lane = 0; lane < SIMD_WIDTH; ++lane )
+    {
+        PrimitiveHandle handle = handles[ lane < count ? lane : 0 ];
+        const glm::quat& q = m_orientations[ handle ];
+        qx[ lane ] = q.x; qy[ lane ] = q.y; qz[ lane ] = q.z; qw[ lane ] = q.w;
+        px[ lane ] = m_positions[ handle ].x; py[ lane ] = m_positions[ handle ].y; pz[ lane ] = m_positions[ handle ].z;
+        sx[ lane ] = m_scales[ handle ].x; sy[ lane ] = m_scales[ handle ].y; sz[ lane ] = m_scales[ handle ].z;
+    }
+
+    Float x = Float::Load( qx ), y = Float::Load( qy ), z = Float::Load( qz ), w = Float::Load( qw );
+    Float p[ 3 ] = { Float::Load( px ), Float::Load( py ), Float::Load( pz ) };
+    Float s[ 3 ] = { Float::Load( sx ), Float::Load( sy ), Float::Load( sz ) };
+
+    // Rotation matrix, column-major as glm::mat3_cast
+    const Float one( 1.0f ), two( 2.0f );
+    Float r[ 3 ][ 3 ];
+    r[ 0 ][ 0 ] = one - two * ( y * y + z * z );
+    r[ 0 ][ 1 ] = two * ( x * y + w * z );
+    r[ 0 ][ 2 ] = two * ( x * z - w * y );
+    r[ 1 ][ 0 ] = two * ( x * y - w * z );
+    r[ 1 ][ 1 ] = one - two * ( x * x + z * z );
+    r[ 1 ][ 2 ] = two * ( y * z + w * x );
+    r[ 2 ][ 0 ] = two * ( x * z + w * y );
+    r[ 2 ][ 1 ] = two * ( y * z - w * x );
+    r[ 2 ][ 2 ] = one - two * ( x * x + y * y );
+
+    Float is[ 3 ] = { one / s[ 0 ], one / s[ 1 ], one / s[ 2 ] };
+
+    // -( R^T * p ) / s, the translation of the inverse
+    Float it[ 3 ];
+    for( int i = 0; i < 3; ++i )
+    {
+        it[ i ] = -( r[ i ][ 0 ] * p[ 0 ] + r[ i ][ 1 ] * p[ 1 ] + r[ i ][ 2 ] * p[ 2 ] ) * is[ i ];
+    }
+
+    // Scatter lanes back into the cache
+    float world[ 3 ][ 3 ][ SIMD_WIDTH ], inverse[ 3 ][ 3 ][ SIMD_WIDTH ], normal[ 3 ][ 3 ][ SIMD_WIDTH ], inverseT[ 3 ][ SIMD_WIDTH ];
+    for( int c = 0; c < 3; ++c )
+    {
+        for( int e = 0; e < 3; ++e )
+        {
+            ( r[ c ][ e ] * s[ c ] ).Store( world[ c ][ e ] );
+            ( r[ e ][ c ] * is[ e ] ).Store( inverse[ c ][ e ] );
+            ( r[ c ][ e ] * is[ c ] ).Store( normal[ c ][ e ] );
+        }
+        it[ c ].Store( inverseT[ c ] );
+    }
+
+    for( int lane = 0; lane < count; ++lane )
+    {
+        PrimitiveTransform& transform = m_transforms[ handles[ lane ] ];
+
+        for( int c = 0; c < 3; ++c )
+        {
+            for( int e = 0; e < 3; ++e )
+            {
+                transform.World[ c ][ e ] = world[ c ][ e ][ lane ];
+                transform.InverseWorld[ c ][ e ] = inverse[ c ][ e ][ lane ];
+                transform.Normal[ c ][ e ] = normal[ c ][ e ][ lane ];
+            }
+
+            transform.World[ c ][ 3 ] = 0.0f;
+            transform.InverseWorld[ c ][ 3 ] = 0.0f;
+            transform.Normal[ c ][ 3 ] = inverseT[ c ][ lane ];
+
+            transform.World[ 3 ][ c ] = m_positions[ handles[ lane ] ][ c ];
+            transform.InverseWorld[ 3 ][ c ] = inverseT[ c ][ lane ];
+            transform.Normal[ 3 ][ c ] = 0.0f;
+        }
+
+        transform.World[ 3 ][ 3 ] = 1.0f;
+        transform.InverseWorld[ 3 ][ 3 ] = 1.0f;
+        transform.Normal[ 3 ][ 3 ] = 1.0f;
+    }
+}
@@ -17,14 +17,14 @@ Scene::~Scene()
 
 void Scene::Update() // Must be called at the top of overridden Update() method
 {
-    m_updatedObjects.clear();
+    m_store.ClearUpdated();
 }
 
 // Performs pre-processing on world objects in prep for sending to OpenGL
 void Scene::addPrimitive( Primitive* Primitive )
 {
     // Assign unique per-primitive ID
-    Primitive->ID = m_primitives.size();
+    Primitive->ID = m_store.Add( *Primitive );
 
     m_primitives.push_back( Primitive );
 }
@@ -32,10 +32,12 @@ void Scene::addPrimitive( Primitive* Primitive )
 // Performs pre-processing on world object, then update's it at it's info texture index
 void Scene::updatePrimitive( Primitive* primitive )
 {
-    std::vector<Primitive*>::iterator it = std::find(m_primitives.begin(), m_primitives.end(), primitive);
-    int index = std::distance( m_primitives.begin(), it );
+    PrimitiveHandle index = PrimitiveHandle( primitive->ID );
 
-    m_updatedObjects.insert( std::pair< int, Primitive* >( index, primitive ) );
+    // Ignore primitives that were never added to this scene
+    if( index >= int( m_primitives.size() ) || m_primitives[ index ] != primitive ) return;
+
+    m_store.Set( index, *primitive );
 }
 
 // Calculates and updates the translation offset
@@ -0,0 +1,219 @@
+#include "TileScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <queue>
+
+// Added to every tile's cost while seeding so that unmeasured tiles still spread evenly
+const float MIN_TILE_COST = 1e-6f;
+
+static int defaultThreadCount( int threadCount )
+{
+    if( threadCount > 0 ) return threadCount;
+    return std::max( 1, int( std::thread::hardware_concurrency() ) );
+}
+
+TileScheduler::TileScheduler( int threadCount )
+    : m_threadCount( defaultThreadCount( threadCount ) ),
+      m_queues( m_threadCount )
+{
+    m_workerStats.resize( m_threadCount );
+
+    for( int t = 0; t < m_threadCount; ++t )
+    {
+        m_threads.push_back( std::thread( &TileScheduler::workerLoop, this, t ) );
+    }
+}
+
+TileScheduler::~TileScheduler()
+{
+    {
+        std::lock_guard< std::mutex > lock( m_poolMutex );
+        m_shutdown = true;
+    }
+    m_startCondition.notify_all();
+
+    for( int t = 0; t < m_threadCount; ++t )
+    {
+        m_threads[ t ].join();
+    }
+}
+
+// Without a history every run starts from contiguous blocks
+void TileScheduler::Run( int tileCount, const std::function< void( int tile, int thread ) >& work )
+{
+    m_scratchCosts.clear();
+    Run( tileCount, m_scratchCosts, work );
+}
+
+void TileScheduler::Run( int tileCount, std::vector< float >& tileCosts, const std::function< void( int tile, int thread ) >& work )
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    m_tileCosts = &tileCosts;
+    seedQueues( tileCount );
+    if( int( tileCosts.size() ) != tileCount )
+    {
+        tileCosts.assign( tileCount, 0.0f );
+    }
+    m_workerStats.assign( m_threadCount, TileWorkerStats() );
+    m_work = &work;
+
+    // Wake the pool and wait for every worker to run dry
+    {
+        std::lock_guard< std::mutex > lock( m_poolMutex );
+        m_activeWorkers = m_threadCount;
+        m_generation++;
+    }
+    m_startCondition.notify_all();
+
+    {
+        std::unique_lock< std::mutex > lock( m_poolMutex );
+        m_doneCondition.wait( lock, [ this ]() { return m_activeWorkers == 0; } );
+    }
+
+    m_work = 0;
+    m_tileCosts = 0;
+
+    std::chrono::duration< float > elapsed = std::chrono::steady_clock::now() - start;
+    m_runSeconds = elapsed.count();
+
+    for( int t = 0; t < m_threadCount; ++t )
+    {
+        m_workerStats[ t ].IdleSeconds = std::max( 0.0f, m_runSeconds - m_workerStats[ t ].BusySeconds );
+    }
+}
+
+// Distributes tiles over the worker deques.
+// With costs from a previous run of the same size, tiles are assigned most expensive first
+// to the least loaded worker, otherwise each worker starts with a contiguous block of tiles
+void TileScheduler::seedQueues( int tileCount )
+{
+    for( int t = 0; t < m_threadCount; ++t )
+    {
+        m_queues[ t ].Tiles.clear();
+    }
+
+    const std::vector< float >& tileCosts = *m_tileCosts;
+
+    if( int( tileCosts.size() ) == tileCount )
+    {
+        std::vector< int > order( tileCount );
+        std::iota( order.begin(), order.end(), 0 );
+        std::stable_sort( order.begin(), order.end(), [ &tileCosts ]( int a, int b ) { return tileCosts[ a ] > tileCosts[ b ]; } );
+
+        typedef std::pair< float, int > WorkerLoad;
+        std::priority_queue< WorkerLoad, std::vector< WorkerLoad >, std::greater< WorkerLoad > > loads;
+        for( int t = 0; t < m_threadCount; ++t )
+        {
+            loads.push( WorkerLoad( 0.0f, t ) );
+        }
+
+        for( int i = 0; i < tileCount; ++i )
+        {
+            WorkerLoad load = loads.top();
+            loads.pop();
+
+            m_queues[ load.second ].Tiles.push_back( order[ i ] );
+
+            load.first += tileCosts[ order[ i ] ] + MIN_TILE_COST;
+            loads.push( load );
+        }
+    }
+    else
+    {
+        for( int tile = 0; tile < tileCount; ++tile )
+        {
+            m_queues[ ( long long )tile * m_threadCount / tileCount ].Tiles.push_back( tile );
+        }
+    }
+}
+
+bool TileScheduler::popLocal( int thread, int& tile )
+{
+    WorkerQueue& queue = m_queues[ thread ];
+    std::lock_guard< std::mutex > lock( queue.Mutex );
+
+    if( queue.Tiles.empty() ) return false;
+
+    tile = queue.Tiles.front();
+    queue.Tiles.pop_front();
+    return true;
+}
+
+// Takes the cheapest remaining tile from the first non-empty deque after this worker's own
+bool TileScheduler::steal( int thread, int& tile )
+{
+    for( int i = 1; i < m_threadCount; ++i )
+    {
+        WorkerQueue& victim = m_queues[ ( thread + i ) % m_threadCount ];
+        std::lock_guard< std::mutex > lock( victim.Mutex );
+
+        if( victim.Tiles.empty() ) continue;
+
+        tile = victim.Tiles.back();
+        victim.Tiles.pop_back();
+        return true;
+    }
+
+    return false;
+}
+
+void TileScheduler::workerLoop( int thread )
+{
+    int generation = 0;
+
+    while( true )
+    {
+        {
+            std::unique_lock< std::mutex > lock( m_poolMutex );
+            m_startCondition.wait( lock, [ this, generation ]() { return m_shutdown || m_generation != generation; } );
+
+            if( m_shutdown ) return;
+            generation = m_generation;
+        }
+
+        runWorker( thread );
+
+        {
+            std::lock_guard< std::mutex > lock( m_poolMutex );
+            m_activeWorkers--;
+            if( m_activeWorkers == 0 )
+            {
+                m_doneCondition.notify_one();
+            }
+        }
+    }
+}
+
+// Drains this worker's deque, then steals until every deque is empty.
+// No tiles are added mid-run, so finding all deques empty means the run is complete
+void TileScheduler::runWorker( int thread )
+{
+    TileWorkerStats stats;
+    int tile = 0;
+
+    while( true )
+    {
+        bool stolen = false;
+        if( !popLocal( thread, tile ) )
+        {
+            if( !steal( thread, tile ) ) break;
+            stolen = true;
+        }
+
+        std::chrono::steady_clock::time_point tileStart = std::chrono::steady_clock::now();
+        ( *m_work )( tile, thread );
+        std::chrono::duration< float > cost = std::chrono::steady_clock::now() - tileStart;
+
+        // Each tile is run exactly once, so workers never write the same entry
+        ( *m_tileCosts )[ tile ] = cost.count();
+
+        stats.BusySeconds += cost.count();
+        stats.Tiles++;
+        if( stolen ) stats.Steals++;
+    }
+
+    m_workerStats[ thread ] = stats;
+}
@@ -0,0 +1,715 @@
+#include "accell/BVH.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "accell/LBVH.h"
+
+// Split candidates per axis
+const int BVH_SAH_BINS = 16;
+// Spatial split candidates per axis, evenly spaced over the node's bounds
+const int BVH_SPATIAL_BINS = 32;
+// Spatial splits are only tried where the best object split's children overlap by this fraction of the root's area
+const float BVH_SPATIAL_OVERLAP = 1e-5f;
+// Duplicate references spatial splits may add, as a fraction of the primitives in the tree
+const float BVH_SPATIAL_GROWTH = 0.5f;
+// Refitting gives way to a rebuild once the SAH cost exceeds the built cost by this factor
+const float BVH_REBUILD_DRIFT = 1.5f;
+// Treelet restructuring passes of LinearRestructured builds, each gains less than the one before
+const int BVH_TREELET_ROUNDS = 2;
+// Primitives handed to a build thread at a time
+const int BVH_BUILD_CHUNK = 1024;
+
+BVH::BVH( const PrimitiveStore& primitives, TileScheduler& scheduler, BuildMethod method )
+    : m_scheduler( scheduler )
+{
+    m_method = method;
+    if( m_method != BinnedSAH ) m_linear = new LBVH();
+
+    Build( primitives );
+}
+
+BVH::~BVH()
+{
+    delete m_linear;
+}
+
+void BVH::Build( const PrimitiveStore& primitives )
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // Clearing keeps capacity, the arrays are reused from the previous build
+    m_nodes.clear();
+    m_references.clear();
+    m_parents.clear();
+    m_stats = BVHStats();
+
+    m_primitiveCount = primitives.Size();
+    m_unbounded.Build( primitives );
+
+    m_primitiveBounds.resize( m_primitiveCount );
+    m_centroids.resize( m_primitiveCount );
+    m_primitiveLeaves.assign( m_primitiveCount, -1 );
+
+    // Bounds in parallel, each chunk writing its own range
+    int chunkCount = ( m_primitiveCount + BVH_BUILD_CHUNK - 1 ) / BVH_BUILD_CHUNK;
+    m_scheduler.Run( chunkCount, [ & ]( int chunk, int thread )
+    {
+        int last = std::min( ( chunk + 1 ) * BVH_BUILD_CHUNK, m_primitiveCount );
+        for( int i = chunk * BVH_BUILD_CHUNK; i < last; ++i )
+        {
+            m_primitiveBounds[ i ] = primitiveBounds( primitives, i );
+            m_centroids[ i ] = m_primitiveBounds[ i ].Center();
+        }
+    } );
+
+    if( m_method == BinnedSAH )
+    {
+        // References are partitioned in place, and end up as the leaves' contiguous ranges
+        for( int i = 0; i < m_primitiveCount; ++i )
+        {
+            if( !m_primitiveBounds[ i ].Empty() ) m_references.push_back( i );
+        }
+
+        if( !m_references.empty() ) buildNode( 0, int( m_references.size() ), -1, 0 );
+    }
+    else if( m_method == SpatialSAH )
+    {
+        // References are split into new lists per node, and leaves append theirs as they are made
+        std::vector< SplitReference > refs;
+        Bounds rootBounds;
+        for( int i = 0; i < m_primitiveCount; ++i )
+        {
+            if( m_primitiveBounds[ i ].Empty() ) continue;
+
+            refs.push_back( { m_primitiveBounds[ i ], i } );
+            rootBounds.Extend( m_primitiveBounds[ i ] );
+        }
+
+        int primitiveCount = int( refs.size() );
+        m_rootArea = rootBounds.SurfaceArea();
+        m_splitBudget = int( BVH_SPATIAL_GROWTH * primitiveCount );
+
+        if( !refs.empty() ) buildSpatialNode( primitives, refs, -1, 0 );
+        m_stats.Duplicates = int( m_references.size() ) - primitiveCount;
+    }
+    else
+    {
+        m_linear->Build( m_scheduler, m_primitiveBounds, m_method == LinearRestructured ? BVH_TREELET_ROUNDS : 0 );
+        if( m_linear->GetPrimitiveCount() > 0 ) flattenLinearNode( 0, -1, 0 );
+    }
+
+    if( m_nodes.empty() )
+    {
+        // A root with empty bounds. It isn't a leaf, so Traverse and the encoders check for empty bounds instead
+        BVHNode root;
+        root.Min = Bounds().Min;
+        root.Max = Bounds().Max;
+        root.Offset = 0;
+        root.Count = 0;
+        m_nodes.push_back( root );
+        m_parents.push_back( -1 );
+    }
+
+    m_bounds = Bounds( m_nodes[ 0 ].Min, m_nodes[ 0 ].Max );
+    m_stats.SAHCost = computeSAHCost();
+    m_builtSAHCost = m_stats.SAHCost;
+
+    m_dirtyNodes.assign( m_nodes.size(), false );
+    m_dirtyFirst = 0;
+    m_dirtyLast = int( m_nodes.size() );
+
+    std::chrono::duration< float > elapsed = std::chrono::steady_clock::now() - start;
+    m_stats.BuildSeconds = elapsed.count();
+}
+
+bool BVH::Update( const PrimitiveStore& primitives )
+{
+    m_dirtyFirst = 0;
+    m_dirtyLast = 0;
+
+    if( primitives.Size() != m_primitiveCount )
+    {
+        Build( primitives );
+        return true;
+    }
+
+    ArrayView< PrimitiveHandle > updated = primitives.GetUpdated();
+    if( updated.Empty() ) return false;
+
+    // Linear builds cost little more than a refit, and keep the tree as good as a fresh one.
+    // Spatial builds clip references to their leaves, which refitting can't follow
+    if( m_method != BinnedSAH )
+    {
+        Build( primitives );
+        return true;
+    }
+
+    m_unbounded.Build( primitives );
+
+    int first = int( m_nodes.size() );
+    int last = 0;
+
+    for( int i = 0; i < updated.Size(); ++i )
+    {
+        PrimitiveHandle handle = updated[ i ];
+        m_primitiveBounds[ handle ] = primitiveBounds( primitives, handle );
+
+        int leaf = m_primitiveLeaves[ handle ];
+        if( leaf < 0 )
+        {
+            // Wasn't in the tree, but now has bounds
+            if( m_primitiveBounds[ handle ].Empty() ) continue;
+
+            Build( primitives );
+            return true;
+        }
+
+        last = std::max( last, leaf + 1 );
+
+        // Mark the leaf and its ancestors, stopping at a path already marked
+        for( int node = leaf; node >= 0 && !m_dirtyNodes[ node ]; node = m_parents[ node ] )
+        {
+            m_dirtyNodes[ node ] = true;
+            first = std::min( first, node );
+        }
+    }
+
+    if( last == 0 ) return false;
+
+    // Children always follow their parent, so walking backwards refits bottom up
+    for( int node = last - 1; node >= first; --node )
+    {
+        if( !m_dirtyNodes[ node ] ) continue;
+
+        refitNode( node );
+        m_dirtyNodes[ node ] = false;
+    }
+
+    m_bounds = Bounds( m_nodes[ 0 ].Min, m_nodes[ 0 ].Max );
+    m_stats.SAHCost = computeSAHCost();
+
+    if( m_stats.SAHCost > m_builtSAHCost * BVH_REBUILD_DRIFT )
+    {
+        Build( primitives );
+        return true;
+    }
+
+    m_dirtyFirst = first;
+    m_dirtyLast = last;
+    return false;
+}
+
+int BVH::IntersectRays(
+    const Ray* rays,
+    int rayCount,
+    const std::vector< Primitive* >& primitives,
+    ArrayView< PrimitiveTransform > transforms,
+    RayHit* hits,
+    Collisions::RayQueryMode mode
+    ) const
+{
+    return IntersectStructureRays( *this, rays, rayCount, primitives, transforms, hits, mode );
+}
+
+int BVH::buildNode( int first, int last, int parent, int depth )
+{
+    Bounds nodeBounds;
+    Bounds centroidBounds;
+    for( int i = first; i < last; ++i )
+    {
+        nodeBounds.Extend( m_primitiveBounds[ m_references[ i ] ] );
+        centroidBounds.Extend( m_centroids[ m_references[ i ] ] );
+    }
+
+    int index = int( m_nodes.size() );
+    BVHNode node;
+    node.Min = nodeBounds.Min;
+    node.Max = nodeBounds.Max;
+    node.Offset = first;
+    node.Count = last - first;
+    m_nodes.push_back( node );
+    m_parents.push_back( parent );
+
+    m_stats.Nodes++;
+    m_stats.MaxDepth = std::max( m_stats.MaxDepth, depth );
+
+    int mid = -1;
+    if( last - first > 1 && depth < BVH_MAX_DEPTH - 1 )
+    {
+        mid = partitionSAH( first, last, nodeBounds, centroidBounds );
+    }
+
+    if( mid < 0 )
+    {
+        m_stats.Leaves++;
+        for( int i = first; i < last; ++i )
+        {
+            m_primitiveLeaves[ m_references[ i ] ] = index;
+        }
+        return index;
+    }
+
+    // First child lands directly after this node
+    buildNode( first, mid, index, depth + 1 );
+    int second = buildNode( mid, last, index, depth + 1 );
+
+    m_nodes[ index ].Offset = second;
+    m_nodes[ index ].Count = 0;
+
+    return index;
+}
+
+// Builds a SpatialSAH node over refs, which it consumes, and its subtree depth first.
+// Leaves append their primitives to the references, duplicates of a primitive landing in different leaves
+int BVH::buildSpatialNode( const PrimitiveStore& primitives, std::vector< SplitReference >& refs, int parent, int depth )
+{
+    Bounds nodeBounds;
+    Bounds centroidBounds;
+    for( const SplitReference& ref : refs )
+    {
+        nodeBounds.Extend( ref.Box );
+        centroidBounds.Extend( ref.Box.Center() );
+    }
+
+    int index = int( m_nodes.size() );
+    BVHNode node;
+    node.Min = nodeBounds.Min;
+    node.Max = nodeBounds.Max;
+    node.Offset = int( m_references.size() );
+    node.Count = int( refs.size() );
+    m_nodes.push_back( node );
+    m_parents.push_back( parent );
+
+    m_stats.Nodes++;
+    m_stats.MaxDepth = std::max( m_stats.MaxDepth, depth );
+
+    std::vector< SplitReference > left;
+    std::vector< SplitReference > right;
+    if( refs.size() < 2 || depth >= BVH_MAX_DEPTH - 1 || !splitSpatial( primitives, refs, nodeBounds, centroidBounds, left, right ) )
+    {
+        m_stats.Leaves++;
+        for( const SplitReference& ref : refs )
+        {
+            m_references.push_back( ref.Primitive );
+            m_primitiveLeaves[ ref.Primitive ] = index;
+        }
+        return index;
+    }
+
+    // The children's lists hold everything from here down
+    std::vector< SplitReference >().swap( refs );
+
+    // First child lands directly after this node
+    buildSpatialNode( primitives, left, index, depth + 1 );
+    int second = buildSpatialNode( primitives, right, index, depth + 1 );
+
+    m_nodes[ index ].Offset = second;
+    m_nodes[ index ].Count = 0;
+
+    return index;
+}
+
+// Picks the cheapest of a leaf, the best binned object split and, where that split's children overlap, the best
+// spatial split within the duplicate budget. Returns false for a leaf, otherwise fills left and right
+bool BVH::splitSpatial(
+    const PrimitiveStore& primitives,
+    const std::vector< SplitReference >& refs,
+    const Bounds& nodeBounds,
+    const Bounds& centroidBounds,
+    std::vector< SplitReference >& left,
+    std::vector< SplitReference >& right
+    )
+{
+    int count = int( refs.size() );
+    float nodeArea = nodeBounds.SurfaceArea();
+
+    // Object split over binned centroids, as partitionSAH
+    int objectAxis = -1;
+    int objectSplit = 0;
+    float objectCost = 0.0f;
+    Bounds objectLeft;
+    Bounds objectRight;
+
+    glm::vec3 centroidExtent = centroidBounds.Extent();
+    for( int axis = 0; axis < 3; ++axis )
+    {
+        if( centroidExtent[ axis ] <= 0.0f ) continue;
+
+        Bounds binBounds[ BVH_SAH_BINS ];
+        int binCounts[ BVH_SAH_BINS ] = { 0 };
+        float binScale = BVH_SAH_BINS / centroidExtent[ axis ];
+
+        for( const SplitReference& ref : refs )
+        {
+            int b = std::min( int( ( ref.Box.Center()[ axis ] - centroidBounds.Min[ axis ] ) * binScale ), BVH_SAH_BINS - 1 );
+            binCounts[ b ]++;
+            binBounds[ b ].Extend( ref.Box );
+        }
+
+        Bounds rightBounds[ BVH_SAH_BINS ];
+        int rightCount[ BVH_SAH_BINS ];
+        Bounds accum;
+        int accumCount = 0;
+        for( int b = BVH_SAH_BINS - 1; b > 0; --b )
+        {
+            accum.Extend( binBounds[ b ] );
+            accumCount += binCounts[ b ];
+            rightBounds[ b ] = accum;
+            rightCount[ b ] = accumCount;
+        }
+
+        accum = Bounds();
+        accumCount = 0;
+        for( int b = 1; b < BVH_SAH_BINS; ++b )
+        {
+            accum.Extend( binBounds[ b - 1 ] );
+            accumCount += binCounts[ b - 1 ];
+            if( accumCount == 0 || rightCount[ b ] == 0 ) continue;
+
+            float cost = BVH_TRAVERSAL_COST + BVH_INTERSECT_COST *
+                         ( accum.SurfaceArea() * accumCount + rightBounds[ b ].SurfaceArea() * rightCount[ b ] ) / nodeArea;
+
+            if( objectAxis < 0 || cost < objectCost )
+            {
+                objectAxis = axis;
+                objectSplit = b;
+                objectCost = cost;
+                objectLeft = accum;
+                objectRight = rightBounds[ b ];
+            }
+        }
+    }
+
+    // Spatial split over evenly spaced planes, references counted on every side they reach.
+    // Only worth its duplicates where the object split leaves overlapping children
+    int spatialAxis = -1;
+    int spatialSplit = 0;
+    float spatialCost = 0.0f;
+
+    float overlapArea = objectAxis >= 0 ? objectLeft.Intersection( objectRight ).SurfaceArea() : nodeArea;
+    glm::vec3 extent = nodeBounds.Extent();
+
+    if( m_splitBudget > 0 && overlapArea > BVH_SPATIAL_OVERLAP * m_rootArea )
+    {
+        for( int axis = 0; axis < 3; ++axis )
+        {
+            if( extent[ axis ] <= 0.0f ) continue;
+
+            Bounds binBounds[ BVH_SPATIAL_BINS ];
+            int entries[ BVH_SPATIAL_BINS ] = { 0 };
+            int exits[ BVH_SPATIAL_BINS ] = { 0 };
+            float binScale = BVH_SPATIAL_BINS / extent[ axis ];
+            float binSize = extent[ axis ] / BVH_SPATIAL_BINS;
+            float axisMin = nodeBounds.Min[ axis ];
+
+            for( const SplitReference& ref : refs )
+            {
+                int entry = std::min( std::max( int( ( ref.Box.Min[ axis ] - axisMin ) * binScale ), 0 ), BVH_SPATIAL_BINS - 1 );
+                int exit = std::min( std::max( int( ( ref.Box.Max[ axis ] - axisMin ) * binScale ), 0 ), BVH_SPATIAL_BINS - 1 );
+                entries[ entry ]++;
+                exits[ exit ]++;
+
+                // Each bin gets the part of the reference inside it
+                for( int b = entry; b <= exit; ++b )
+                {
+                    Bounds clipped = ref.Box;
+                    clipped.Min[ axis ] = std::max( clipped.Min[ axis ], axisMin + b * binSize );
+                    clipped.Max[ axis ] = std::min( clipped.Max[ axis ], axisMin + ( b + 1 ) * binSize );
+                    binBounds[ b ].Extend( clipped );
+                }
+            }
+
+            float rightArea[ BVH_SPATIAL_BINS ];
+            int rightCount[ BVH_SPATIAL_BINS ];
+            Bounds accum;
+            int accumCount = 0;
+            for( int b = BVH_SPATIAL_BINS - 1; b > 0; --b )
+            {
+                accum.Extend( binBounds[ b ] );
+                accumCount += exits[ b ];
+                rightArea[ b ] = accum.SurfaceArea();
+                rightCount[ b ] = accumCount;
+            }
+
+            accum = Bounds();
+            accumCount = 0;
+            for( int b = 1; b < BVH_SPATIAL_BINS; ++b )
+            {
+                accum.Extend( binBounds[ b - 1 ] );
+                accumCount += entries[ b - 1 ];
+                if( accumCount == 0 || rightCount[ b ] == 0 ) continue;
+                if( accumCount + rightCount[ b ] - count > m_splitBudget ) continue;
+
+                float cost = BVH_TRAVERSAL_COST + BVH_INTERSECT_COST *
+                             ( accum.SurfaceArea() * accumCount + rightArea[ b ] * rightCount[ b ] ) / nodeArea;
+
+                if( spatialAxis < 0 || cost < spatialCost )
+                {
+                    spatialAxis = axis;
+                    spatialSplit = b;
+                    spatialCost = cost;
+                }
+            }
+        }
+    }
+
+    bool useSpatial = spatialAxis >= 0 && ( objectAxis < 0 || spatialCost < objectCost );
+    float bestCost = useSpatial ? spatialCost : objectCost;
+    bool forceSplit = count > BVH_MAX_LEAF_SIZE;
+
+    if( !forceSplit && ( ( objectAxis < 0 && spatialAxis < 0 ) || bestCost >= BVH_INTERSECT_COST * count ) ) return false;
+
+    if( useSpatial )
+    {
+        float binScale = BVH_SPATIAL_BINS / extent[ spatialAxis ];
+        float axisMin = nodeBounds.Min[ spatialAxis ];
+        float plane = axisMin + spatialSplit * ( extent[ spatialAxis ] / BVH_SPATIAL_BINS );
+
+        for( const SplitReference& ref : refs )
+        {
+            int entry = std::min( std::max( int( ( ref.Box.Min[ spatialAxis ] - axisMin ) * binScale ), 0 ), BVH_SPATIAL_BINS - 1 );
+            int exit = std::min( std::max( int( ( ref.Box.Max[ spatialAxis ] - axisMin ) * binScale ), 0 ), BVH_SPATIAL_BINS - 1 );
+
+            if( exit < spatialSplit )
+            {
+                left.push_back( ref );
+                continue;
+            }
+            if( entry >= spatialSplit )
+            {
+                right.push_back( ref );
+                continue;
+            }
+
+            // Straddles the plane, clip it to each side its surface actually reaches
+            SplitReference leftRef = ref;
+            SplitReference rightRef = ref;
+            leftRef.Box.Max[ spatialAxis ] = plane;
+            rightRef.Box.Min[ spatialAxis ] = plane;
+
+            bool inLeft = !leftRef.Box.Empty() && PrimitiveOverlapsBox( primitives, ref.Primitive, leftRef.Box );
+            bool inRight = !rightRef.Box.Empty() && PrimitiveOverlapsBox( primitives, ref.Primitive, rightRef.Box );
+            if( !inLeft && !inRight )
+            {
+                // Missed by both overlap tests at the edge of precision, keep it wherever it has bounds
+                inLeft = !leftRef.Box.Empty();
+                inRight = !rightRef.Box.Empty();
+            }
+
+            if( inLeft ) left.push_back( leftRef );
+            if( inRight ) right.push_back( rightRef );
+            if( inLeft && inRight ) m_splitBudget--;
+        }
+
+        if( !left.empty() && !right.empty() ) return true;
+
+        // Every straddling surface fell to one side, fall back on the object split
+        m_splitBudget += int( left.size() + right.size() ) - count;
+        left.clear();
+        right.clear();
+    }
+
+    if( objectAxis < 0 )
+    {
+        // Coincident centroids, split down the middle
+        left.assign( refs.begin(), refs.begin() + count / 2 );
+        right.assign( refs.begin() + count / 2, refs.end() );
+        return true;
+    }
+
+    float binScale = BVH_SAH_BINS / centroidExtent[ objectAxis ];
+    for( const SplitReference& ref : refs )
+    {
+        int b = std::min( int( ( ref.Box.Center()[ objectAxis ] - centroidBounds.Min[ objectAxis ] ) * binScale ), BVH_SAH_BINS - 1 );
+        ( b < objectSplit ? left : right ).push_back( ref );
+    }
+
+    return true;
+}
+
+// Writes the LBVH's subtree depth first in this tree's layout, making a leaf of any subtree
+// the SAH prefers as one, or that reaches the depth limit
+int BVH::flattenLinearNode( int node, int parent, int depth )
+{
+    const Bounds& nodeBounds = m_linear->GetBounds( node );
+
+    int index = int( m_nodes.size() );
+    BVHNode flat;
+    flat.Min = nodeBounds.Min;
+    flat.Max = nodeBounds.Max;
+    flat.Offset = int( m_references.size() );
+    flat.Count = m_linear->GetCount( node );
+    m_nodes.push_back( flat );
+    m_parents.push_back( parent );
+
+    m_stats.Nodes++;
+    m_stats.MaxDepth = std::max( m_stats.MaxDepth, depth );
+
+    if( m_linear->IsLeaf( node ) || m_linear->PrefersLeaf( node ) || depth >= BVH_MAX_DEPTH - 1 )
+    {
+        m_stats.Leaves++;
+        gatherLinearLeaves( node );
+        for( int i = flat.Offset; i < int( m_references.size() ); ++i )
+        {
+            m_primitiveLeaves[ m_references[ i ] ] = index;
+        }
+        return index;
+    }
+
+    // First child lands directly after this node
+    glm::ivec2 children = m_linear->GetChildren( node );
+    flattenLinearNode( children.x, index, depth + 1 );
+    int second = flattenLinearNode( children.y, index, depth + 1 );
+
+    m_nodes[ index ].Offset = second;
+    m_nodes[ index ].Count = 0;
+
+    return index;
+}
+
+// Appends the primitives under an LBVH node to the references
+void BVH::gatherLinearLeaves( int node )
+{
+    if( m_linear->IsLeaf( node ) )
+    {
+        m_references.push_back( m_linear->GetPrimitive( node ) );
+        return;
+    }
+
+    glm::ivec2 children = m_linear->GetChildren( node );
+    gatherLinearLeaves( children.x );
+    gatherLinearLeaves( children.y );
+}
+
+// Bins the references' centroids along each axis and sweeps the bin boundaries for the cheapest split.
+// Returns where [ first, last ) was partitioned, or -1 if a leaf is cheaper
+int BVH::partitionSAH( int first, int last, const Bounds& nodeBounds, const Bounds& centroidBounds )
+{
+    int count = last - first;
+    float nodeArea = nodeBounds.SurfaceArea();
+    glm::vec3 extent = centroidBounds.Extent();
+
+    int bestAxis = -1;
+    int bestSplit = 0;
+    float bestCost = 0.0f;
+
+    for( int axis = 0; axis < 3; ++axis )
+    {
+        if( extent[ axis ] <= 0.0f ) continue;
+
+        Bounds binBounds[ BVH_SAH_BINS ];
+        int binCounts[ BVH_SAH_BINS ] = { 0 };
+        float binScale = BVH_SAH_BINS / extent[ axis ];
+
+        for( int i = first; i < last; ++i )
+        {
+            int ref = m_references[ i ];
+            int b = std::min( int( ( m_centroids[ ref ][ axis ] - centroidBounds.Min[ axis ] ) * binScale ), BVH_SAH_BINS - 1 );
+            binCounts[ b ]++;
+            binBounds[ b ].Extend( m_primitiveBounds[ ref ] );
+        }
+
+        // Sweep from the right, storing the area and count of everything right of each boundary
+        float rightArea[ BVH_SAH_BINS ];
+        int rightCount[ BVH_SAH_BINS ];
+        Bounds accum;
+        int accumCount = 0;
+        for( int b = BVH_SAH_BINS - 1; b > 0; --b )
+        {
+            accum.Extend( binBounds[ b ] );
+            accumCount += binCounts[ b ];
+            rightArea[ b ] = accum.SurfaceArea();
+            rightCount[ b ] = accumCount;
+        }
+
+        // Then from the left, evaluating the split below bin b
+        accum = Bounds();
+        accumCount = 0;
+        for( int b = 1; b < BVH_SAH_BINS; ++b )
+        {
+            accum.Extend( binBounds[ b - 1 ] );
+            accumCount += binCounts[ b - 1 ];
+            if( accumCount == 0 || rightCount[ b ] == 0 ) continue;
+
+            float cost = BVH_TRAVERSAL_COST + BVH_INTERSECT_COST *
+                         ( accum.SurfaceArea() * accumCount + rightArea[ b ] * rightCount[ b ] ) / nodeArea;
+
+            if( bestAxis < 0 || cost < bestCost )
+            {
+                bestAxis = axis;
+                bestSplit = b;
+                bestCost = cost;
+            }
+        }
+    }
+
+    bool forceSplit = count > BVH_MAX_LEAF_SIZE;
+
+    if( bestAxis < 0 )
+    {
+        // Coincident centroids, split down the middle if the leaf would be too large
+        if( !forceSplit ) return -1;
+        return first + count / 2;
+    }
+
+    if( !forceSplit && bestCost >= BVH_INTERSECT_COST * count ) return -1;
+
+    float binScale = BVH_SAH_BINS / extent[ bestAxis ];
+    float axisMin = centroidBounds.Min[ bestAxis ];
+    int* mid = std::partition( &m_references[ first ], &m_references[ first ] + count, [ & ]( int ref )
+    {
+        int b = std::min( int( ( m_centroids[ ref ][ bestAxis ] - axisMin ) * binScale ), BVH_SAH_BINS - 1 );
+        return b < bestSplit;
+    } );
+
+    return int( mid - &m_references[ 0 ] );
+}
+
+// A primitive's bounds, empty for unbounded primitives so they stay out of the tree
+Bounds BVH::primitiveBounds( const PrimitiveStore& primitives, PrimitiveHandle handle ) const
+{
+    if( !IsBounded( primitives.GetTypes()[ handle ] ) ) return Bounds();
+
+    return ComputePrimitiveBounds( primitives, handle );
+}
+
+// Recomputes a node's bounds from its references, or from its children which must already be current
+void BVH::refitNode( int index )
+{
+    BVHNode& node = m_nodes[ index ];
+    Bounds bounds;
+
+    if( node.IsLeaf() )
+    {
+        for( int i = node.Offset; i < node.Offset + node.Count; ++i )
+        {
+            bounds.Extend( m_primitiveBounds[ m_references[ i ] ] );
+        }
+    }
+    else
+    {
+        bounds.Extend( Bounds( m_nodes[ index + 1 ].Min, m_nodes[ index + 1 ].Max ) );
+        bounds.Extend( Bounds( m_nodes[ node.Offset ].Min, m_nodes[ node.Offset ].Max ) );
+    }
+
+    node.Min = bounds.Min;
+    node.Max = bounds.Max;
+}
+
+// Sum over nodes of the probability a random ray through the root reaches them, times their cost
+float BVH::computeSAHCost() const
+{
+    float rootArea = Bounds( m_nodes[ 0 ].Min, m_nodes[ 0 ].Max ).SurfaceArea();
+    if( rootArea <= 0.0f ) return 0.0f;
+
+    float cost = 0.0f;
+    for( int i = 0; i < int( m_nodes.size() ); ++i )
+    {
+        const BVHNode& node = m_nodes[ i ];
+        float area = Bounds( node.Min, node.Max ).SurfaceArea();
+        cost += area * ( node.IsLeaf() ? BVH_INTERSECT_COST * node.Count : BVH_TRAVERSAL_COST );
+    }
+
+    return cost / rootArea;
+}
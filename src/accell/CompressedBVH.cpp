@@ -0,0 +1,289 @@
+#include "accell/CompressedBVH.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+void CompressedBVH::Encode( const BVH& bvh )
+{
+    const std::vector< BVHNode >& nodes = bvh.GetNodes();
+
+    m_nodes.clear();
+    m_references.clear();
+    m_unbounded = bvh.GetUnbounded();
+    m_stats = CompressedBVHStats();
+    m_bounds = Bounds();
+    m_dirtyFirst = 0;
+    m_dirtyLast = 0;
+
+    // An empty tree is a single empty root
+    if( nodes.empty() || Bounds( nodes[ 0 ].Min, nodes[ 0 ].Max ).Empty() ) return;
+
+    m_bounds = Bounds( nodes[ 0 ].Min, nodes[ 0 ].Max );
+
+    if( nodes[ 0 ].IsLeaf() )
+    {
+        // A lone leaf still needs a node to hold its bounds, its sibling is an empty list
+        CompressedBVHNode node;
+        quantise( m_bounds, m_bounds, node.Planes );
+        quantise( Bounds(), m_bounds, node.Planes + 6 );
+
+        int start = appendLeaf( bvh, nodes[ 0 ] );
+        m_references.push_back( -1 );
+        node.Link = -1 - ( ( start << 1 ) | 1 );
+        m_nodes.push_back( node );
+    }
+    else
+    {
+        encodeNode( bvh, 0, m_bounds );
+    }
+
+    m_stats.Nodes = int( m_nodes.size() );
+    m_stats.Bytes = int( m_nodes.size() * sizeof( CompressedBVHNode ) + m_references.size() * sizeof( int ) );
+    m_stats.UncompressedBytes = int( nodes.size() * 2 * sizeof( glm::vec4 ) + bvh.GetReferences().size() * sizeof( int ) );
+}
+
+Bounds CompressedBVH::DecodeChild( const CompressedBVHNode& node, int child, const Bounds& parent )
+{
+    const uint8_t* planes = node.Planes + child * 6;
+    glm::vec3 step = ( parent.Max - parent.Min ) * ( 1.0f / 255.0f );
+
+    // Min planes count up from the parent's min, max planes down from its max, so 0 and 255 decode exactly
+    glm::vec3 low = glm::vec3( planes[ 0 ], planes[ 1 ], planes[ 2 ] );
+    glm::vec3 high = glm::vec3( 255 - planes[ 3 ], 255 - planes[ 4 ], 255 - planes[ 5 ] );
+
+    return Bounds( parent.Min + low * step, parent.Max - high * step );
+}
+
+bool CompressedBVH::Refit( const BVH& bvh )
+{
+    const std::vector< BVHNode >& nodes = bvh.GetNodes();
+
+    // A lone leaf root is a single node anyway
+    if( m_nodes.empty() || nodes[ 0 ].IsLeaf() || !contains( m_bounds, Bounds( nodes[ 0 ].Min, nodes[ 0 ].Max ) ) )
+    {
+        Encode( bvh );
+        m_dirtyFirst = 0;
+        m_dirtyLast = int( m_nodes.size() );
+        return true;
+    }
+
+    m_dirtyFirst = int( m_nodes.size() );
+    m_dirtyLast = 0;
+
+    if( bvh.GetDirtyFirst() < bvh.GetDirtyLast() ) refitNode( bvh, 0, 0, int( nodes.size() ), m_bounds );
+
+    if( m_dirtyFirst >= m_dirtyLast )
+    {
+        m_dirtyFirst = 0;
+        m_dirtyLast = 0;
+    }
+    return false;
+}
+
+// Emits the BVH branch at index, whose bounds decode to decoded, and its subtree depth first
+int CompressedBVH::encodeNode( const BVH& bvh, int index, const Bounds& decoded )
+{
+    const std::vector< BVHNode >& nodes = bvh.GetNodes();
+
+    int children[ 2 ];
+    sourceChildren( nodes, index, children );
+
+    int node = int( m_nodes.size() );
+    m_nodes.emplace_back();
+
+    Bounds childBounds[ 2 ];
+    for( int c = 0; c < 2; ++c )
+    {
+        const BVHNode& child = nodes[ children[ c ] ];
+        quantise( Bounds( child.Min, child.Max ), decoded, m_nodes[ node ].Planes + c * 6 );
+        childBounds[ c ] = DecodeChild( m_nodes[ node ], c, decoded );
+    }
+
+    int link;
+    if( nodes[ children[ 0 ] ].IsLeaf() )
+    {
+        int start = appendLeaf( bvh, nodes[ children[ 0 ] ] );
+        appendLeaf( bvh, nodes[ children[ 1 ] ] );
+        link = -1 - ( ( start << 1 ) | 1 );
+    }
+    else
+    {
+        encodeNode( bvh, children[ 0 ], childBounds[ 0 ] );
+
+        if( nodes[ children[ 1 ] ].IsLeaf() )
+        {
+            link = -1 - ( appendLeaf( bvh, nodes[ children[ 1 ] ] ) << 1 );
+        }
+        else
+        {
+            link = encodeNode( bvh, children[ 1 ], childBounds[ 1 ] );
+        }
+    }
+
+    // Recursing may have grown the vector, so look the node up again
+    m_nodes[ node ].Link = link;
+
+    return node;
+}
+
+// Walks the node encoding the BVH branch at index, whose subtree ends at end, down to the children the refit reached
+void CompressedBVH::refitNode( const BVH& bvh, int node, int index, int end, const Bounds& decoded )
+{
+    const std::vector< BVHNode >& nodes = bvh.GetNodes();
+
+    int children[ 2 ];
+    sourceChildren( nodes, index, children );
+
+    // Nodes are depth first, the first BVH child's subtree runs up to the second's
+    int ends[ 2 ];
+    for( int c = 0; c < 2; ++c ) ends[ c ] = children[ c ] == index + 1 ? nodes[ index ].Offset : end;
+
+    int links[ 2 ];
+    childLinks( node, links[ 0 ], links[ 1 ] );
+
+    for( int c = 0; c < 2; ++c )
+    {
+        if( ends[ c ] <= bvh.GetDirtyFirst() || children[ c ] >= bvh.GetDirtyLast() ) continue;
+
+        const BVHNode& child = nodes[ children[ c ] ];
+        Bounds childBounds = DecodeChild( m_nodes[ node ], c, decoded );
+
+        if( contains( childBounds, Bounds( child.Min, child.Max ) ) )
+        {
+            if( links[ c ] >= 0 ) refitNode( bvh, links[ c ], children[ c ], ends[ c ], childBounds );
+            continue;
+        }
+
+        quantise( Bounds( child.Min, child.Max ), decoded, m_nodes[ node ].Planes + c * 6 );
+        markDirty( node );
+
+        if( links[ c ] >= 0 ) requantiseNode( bvh, links[ c ], children[ c ], DecodeChild( m_nodes[ node ], c, decoded ) );
+    }
+}
+
+// Quantises a whole subtree again, within its root's new decoded bounds
+void CompressedBVH::requantiseNode( const BVH& bvh, int node, int index, const Bounds& decoded )
+{
+    const std::vector< BVHNode >& nodes = bvh.GetNodes();
+
+    int children[ 2 ];
+    sourceChildren( nodes, index, children );
+
+    int links[ 2 ];
+    childLinks( node, links[ 0 ], links[ 1 ] );
+
+    markDirty( node );
+
+    for( int c = 0; c < 2; ++c )
+    {
+        const BVHNode& child = nodes[ children[ c ] ];
+        quantise( Bounds( child.Min, child.Max ), decoded, m_nodes[ node ].Planes + c * 6 );
+
+        if( links[ c ] >= 0 ) requantiseNode( bvh, links[ c ], children[ c ], DecodeChild( m_nodes[ node ], c, decoded ) );
+    }
+}
+
+void CompressedBVH::markDirty( int node )
+{
+    m_dirtyFirst = std::min( m_dirtyFirst, node );
+    m_dirtyLast = std::max( m_dirtyLast, node + 1 );
+}
+
+// Copies a leaf's references as a -1 terminated list, returning where it starts
+int CompressedBVH::appendLeaf( const BVH& bvh, const BVHNode& leaf )
+{
+    const std::vector< int >& references = bvh.GetReferences();
+
+    int start = int( m_references.size() );
+    m_references.insert( m_references.end(), references.begin() + leaf.Offset, references.begin() + leaf.Offset + leaf.Count );
+    m_references.push_back( -1 );
+
+    return start;
+}
+
+// Where a node's children are, each a node index or -1 - the start of a leaf's references
+void CompressedBVH::childLinks( int index, int& first, int& second ) const
+{
+    int link = m_nodes[ index ].Link;
+    if( link >= 0 )
+    {
+        first = index + 1;
+        second = link;
+        return;
+    }
+
+    int packed = -1 - link;
+    int start = packed >> 1;
+    if( packed & 1 )
+    {
+        // Both leaves, the second list follows the first's terminator
+        int end = start;
+        while( m_references[ end ] != -1 ) end++;
+
+        first = -1 - start;
+        second = -1 - ( end + 1 );
+    }
+    else
+    {
+        first = index + 1;
+        second = -1 - start;
+    }
+}
+
+// The BVH children of the branch at index in the order they're encoded. A branch child goes first, so it can be the next node
+void CompressedBVH::sourceChildren( const std::vector< BVHNode >& nodes, int index, int children[ 2 ] )
+{
+    children[ 0 ] = index + 1;
+    children[ 1 ] = nodes[ index ].Offset;
+    if( nodes[ children[ 0 ] ].IsLeaf() && !nodes[ children[ 1 ] ].IsLeaf() ) std::swap( children[ 0 ], children[ 1 ] );
+}
+
+bool CompressedBVH::contains( const Bounds& outer, const Bounds& inner )
+{
+    for( int axis = 0; axis < 3; ++axis )
+    {
+        if( inner.Min[ axis ] < outer.Min[ axis ] || inner.Max[ axis ] > outer.Max[ axis ] ) return false;
+    }
+    return true;
+}
+
+// Rounds a child's bounds outwards to 8 bit planes within its parent's decoded bounds.
+// Empty bounds get inverted planes, min 255 and max 0. Decoded they would span the whole parent,
+// so traverseBVH in Raytracer.frag reads them as a flag and skips the child
+void CompressedBVH::quantise( const Bounds& child, const Bounds& parent, uint8_t* planes )
+{
+    if( child.Empty() )
+    {
+        for( int axis = 0; axis < 3; ++axis )
+        {
+            planes[ axis ] = 255;
+            planes[ axis + 3 ] = 0;
+        }
+        return;
+    }
+
+    glm::vec3 step = ( parent.Max - parent.Min ) * ( 1.0f / 255.0f );
+
+    for( int axis = 0; axis < 3; ++axis )
+    {
+        int low = 0;
+        int high = 255;
+
+        float extent = parent.Max[ axis ] - parent.Min[ axis ];
+        if( extent > 0.0f )
+        {
+            low = int( std::floor( ( child.Min[ axis ] - parent.Min[ axis ] ) / extent * 255.0f ) );
+            high = 255 - int( std::floor( ( parent.Max[ axis ] - child.Max[ axis ] ) / extent * 255.0f ) );
+            low = std::min( std::max( low, 0 ), 255 );
+            high = std::min( std::max( high, 0 ), 255 );
+        }
+
+        // Step outwards past any rounding in the decode
+        while( low > 0 && parent.Min[ axis ] + float( low ) * step[ axis ] > child.Min[ axis ] ) low--;
+        while( high < 255 && parent.Max[ axis ] - float( 255 - high ) * step[ axis ] < child.Max[ axis ] ) high++;
+
+        planes[ axis ] = uint8_t( low );
+        planes[ axis + 3 ] = uint8_t( high );
+    }
+}
@@ -3,255 +3,533 @@
 #include "Ray.h"
 #include "Collisions.h"
 #include "Utility.h"
+#include "Bounds.h"
+#include "accell/GridWalk.h"
+
+#include <algorithm>
 
 #define DRAW_OBJECT_CELLS
 //#define DRAW_RAY_PATH
 
+// Spare slots each cell gets beyond its references when the grid is packed
+const int GRID_CELL_SLACK = 2;
+// Fitted bounds are grown by this fraction of the scene's largest extent
+const float GRID_BOUNDS_PADDING = 0.01f;
+
+// Primitives, or cells when sorting, handed to a build thread at a time
+const int GRID_BUILD_CHUNK = 64;
+
 Ray testRay( glm::vec3( 5, 5, 5 ), glm::vec3( 0, 0, 1 ) );
-std::vector< glm::vec3 > objectCells;
 std::vector< glm::vec3 > hitCells;
 
-Grid::Grid( std::vector< Primitive* > primitives, glm::vec3 p0, glm::vec3 p1, int subdivisions )
+// Calls visit( cell ) for every cell in a primitive's range that it is stored in
+template< typename Visitor >
+void Grid::forEachCell( const PrimitiveStore& primitives, PrimitiveHandle handle, const CellRange& range, Visitor visit ) const
+{
+    for( int z = range.Min.z; z <= range.Max.z; ++z )
+    {
+        for( int y = range.Min.y; y <= range.Max.y; ++y )
+        {
+            for( int x = range.Min.x; x <= range.Max.x; ++x )
+            {
+                if( primitiveInCell( primitives, handle, glm::ivec3( x, y, z ) ) )
+                {
+                    visit( cellIndex( glm::ivec3( x, y, z ) ) );
+                }
+            }
+        }
+    }
+}
+
+Grid::Grid( const PrimitiveStore& primitives, TileScheduler& scheduler, float density )
+    : m_scheduler( scheduler )
+{
+    m_density = density;
+    Fit( primitives );
+}
+
+Grid::Grid( const PrimitiveStore& primitives, TileScheduler& scheduler, glm::vec3 p0, glm::vec3 p1, glm::ivec3 subdivisions )
+    : m_scheduler( scheduler )
+{
+    setBounds( p0, p1, subdivisions );
+    buildGrid( primitives );
+    m_unbounded.Build( primitives );
+}
+
+// Fits the bounds to the scene's finite primitives and picks the resolution for them, then rebuilds
+void Grid::Fit( const PrimitiveStore& primitives )
+{
+    Bounds bounds = FitBounds( primitives );
+
+    m_fitPrimitiveCount = primitives.Size();
+    setBounds( bounds.Min, bounds.Max, ChooseResolution( bounds, primitives.Size(), m_density ) );
+    buildGrid( primitives );
+    m_unbounded.Build( primitives );
+}
+
+// Scene bounds padded so primitives on the bounds, and flat scenes, have some room
+Bounds Grid::FitBounds( const PrimitiveStore& primitives )
+{
+    Bounds bounds = ComputeSceneBounds( primitives );
+
+    glm::vec3 extent = bounds.Extent();
+    glm::vec3 pad( glm::max( glm::max( extent.x, glm::max( extent.y, extent.z ) ) * GRID_BOUNDS_PADDING, GRID_BOUNDS_PADDING ) );
+
+    return Bounds( bounds.Min - pad, bounds.Max + pad );
+}
+
+// Cleary's heuristic: cubic-ish cells sized so the grid holds about density cells per primitive,
+// with each axis resolved in proportion to its extent
+glm::ivec3 Grid::ChooseResolution( const Bounds& bounds, int primitiveCount, float density )
+{
+    glm::vec3 extent = bounds.Extent();
+    float volume = extent.x * extent.y * extent.z;
+    if( volume <= 0.0f ) return glm::ivec3( 1 );
+
+    float cellsPerUnit = std::cbrt( density * std::max( 1, primitiveCount ) / volume );
+    return glm::clamp( glm::ivec3( glm::ceil( extent * cellsPerUnit ) ), glm::ivec3( 1 ), glm::ivec3( GRID_MAX_RESOLUTION ) );
+}
+
+GridStats Grid::GetStats() const
+{
+    GridStats stats;
+    stats.Resolution = m_subdivisions;
+    stats.Cells = m_arrayLength;
+    stats.Density = m_density;
+
+    for( int i = 0; i < m_arrayLength; ++i )
+    {
+        stats.References += m_cellCounts[ i ];
+        stats.MaxCellReferences = std::max( stats.MaxCellReferences, m_cellCounts[ i ] );
+        if( m_cellCounts[ i ] == 0 ) stats.EmptyCells++;
+    }
+
+    stats.ReferencesPerCell = float( stats.References ) / float( m_arrayLength );
+    return stats;
+}
+
+void Grid::setBounds( const glm::vec3& p0, const glm::vec3& p1, const glm::ivec3& subdivisions )
 {
     m_subdivisions = subdivisions;
-    m_arrayLength = subdivisions * subdivisions * subdivisions;
-    m_grid = new int[ m_arrayLength ];
+    m_arrayLength = subdivisions.x * subdivisions.y * subdivisions.z;
     m_p0 = p0;
     m_p1 = p1;
 
-    m_cellSize = ( m_p1 - m_p0 ) / float( subdivisions );
+    m_cellSize = ( m_p1 - m_p0 ) / glm::vec3( subdivisions );
 
-    buildGrid( primitives );
+    m_grid.resize( m_arrayLength );
+    m_cellCounts.resize( m_arrayLength );
+    m_cellCapacities.resize( m_arrayLength );
+    m_occupancy.resize( ( m_arrayLength + 31 ) / 32 );
+    m_cellCursors = std::vector< std::atomic< int > >( m_arrayLength );
 }
 
-Grid::~Grid()
+// Whether a bounded primitive reaches outside the grid
+bool Grid::outsideGrid( const PrimitiveStore& primitives, PrimitiveHandle handle ) const
 {
-    delete[] m_grid;
+    if( !IsBounded( primitives.GetTypes()[ handle ] ) ) return false;
+
+    Bounds b = ComputePrimitiveBounds( primitives, handle );
+    if( b.Empty() ) return false;
+
+    return glm::any( glm::lessThan( b.Min, m_p0 ) ) || glm::any( glm::lessThan( m_p1, b.Max ) );
 }
 
-void Grid::Update( std::vector< Primitive* > primitives, const glm::vec3& camPos, const glm::vec3& camDir )
+bool Grid::Update( const std::vector< Primitive* >& primitives, const PrimitiveStore& store, const glm::vec3& camPos, const glm::vec3& camDir )
 {
-    //buildGrid( primitives );
     testRay.Origin = camPos;
     testRay.Direction = camDir;
+
+    m_dirtyCellFirst = m_arrayLength;
+    m_dirtyCellLast = 0;
+    m_dirtyRefFirst = int( m_cellObjectRefs.size() );
+    m_dirtyRefLast = 0;
+    m_refsGrown = false;
+
+    int known = int( m_primitiveCells.size() );
+    ArrayView< PrimitiveHandle > updated = store.GetUpdated();
+
+    // A fitted grid is refitted once primitives leave it, or their count outgrows its resolution
+    if( m_density > 0.0f )
+    {
+        bool refit = store.Size() > 2 * m_fitPrimitiveCount;
+        for( PrimitiveHandle handle = known; handle < store.Size() && !refit; ++handle )
+        {
+            refit = outsideGrid( store, handle );
+        }
+        for( int i = 0; i < updated.Size() && !refit; ++i )
+        {
+            refit = outsideGrid( store, updated[ i ] );
+        }
+
+        if( refit )
+        {
+            Fit( store );
 #ifdef DRAW_RAY_PATH
-    traverseGrid();
+            traverseGrid( primitives, store.GetTransforms() );
 #endif
+            return true;
+        }
+    }
+
+    // The unbounded list is a short scan of the types, redone whenever anything changed
+    if( known < store.Size() || !updated.Empty() )
+    {
+        m_unbounded.Build( store );
+    }
+
+    // Primitives added since the last update
+    for( PrimitiveHandle handle = known; handle < store.Size(); ++handle )
+    {
+        Insert( store, handle );
+    }
+
+    for( int i = 0; i < updated.Size(); ++i )
+    {
+        PrimitiveHandle handle = updated[ i ];
+        if( handle >= known ) continue;
+
+        // Which cells of its range a primitive overlaps changes as it turns, so moved primitives are always reinserted
+        Remove( handle );
+        Insert( store, handle );
+    }
+
+    // Relocated cells leave their old slots behind, repack once those outweigh the live ones
+    if( m_garbage > m_refsEnd / 2 )
+    {
+        buildGrid( store );
+    }
+
+#ifdef DRAW_RAY_PATH
+    traverseGrid( primitives, store.GetTransforms() );
+#endif
+
+    if( m_dirtyCellFirst > m_dirtyCellLast ) m_dirtyCellFirst = m_dirtyCellLast;
+    if( m_dirtyRefFirst > m_dirtyRefLast ) m_dirtyRefFirst = m_dirtyRefLast;
+
+    return m_refsGrown;
 }
 
-void Grid::traverseGrid()
+void Grid::Insert( const PrimitiveStore& primitives, PrimitiveHandle handle )
 {
-    Ray ray = testRay;
+    if( handle >= int( m_primitiveCells.size() ) ) m_primitiveCells.resize( handle + 1 );
+
+    CellRange range = cellRange( primitives, handle );
+    m_primitiveCells[ handle ] = range;
 
-    // Initialization
-    IsectData gridIsectData;
-    // Test grid bounds to see if ray intersects, return if not
-    if( !Collisions::IsectAABB( ray, m_p0, m_p1, gridIsectData ) )
+    forEachCell( primitives, handle, range, [ & ]( int cell )
     {
-        return;
-    }
-    else
+        insertRef( cell, handle );
+    } );
+}
+
+// Removes a primitive from every cell it was inserted into, using the range stored at insertion
+void Grid::Remove( PrimitiveHandle handle )
+{
+    if( handle >= int( m_primitiveCells.size() ) ) return;
+
+    CellRange range = m_primitiveCells[ handle ];
+
+    for( int z = range.Min.z; z <= range.Max.z; ++z )
     {
-        // If the ray isn't inside the scene, advance to boundary
-        if( !Collisions::AABBContainsPoint( ray.Origin, m_p0, m_p1 ) )
+        for( int y = range.Min.y; y <= range.Max.y; ++y )
         {
-            ray.Origin = gridIsectData.Position;
+            for( int x = range.Min.x; x <= range.Max.x; ++x )
+            {
+                removeRef( cellIndex( glm::ivec3( x, y, z ) ), handle );
+            }
         }
     }
 
-    glm::ivec3 step;
-    step = sign( testRay.Direction );
+    m_primitiveCells[ handle ] = CellRange();
+}
 
-    // Determine which cell the ray originated in
-    glm::vec3 localPos = ray.Origin - m_p0;
-    glm::ivec3 cell = glm::ivec3( localPos / m_cellSize );
+// Debug traversal of the view ray, recording the cells visited up to the closest hit
+void Grid::traverseGrid( const std::vector< Primitive* >& primitives, ArrayView< PrimitiveTransform > transforms )
+{
+    RayHit hit;
+    Collisions::InitRayHits( &hit, 1 );
+
+    hitCells.clear();
+    intersectRay( testRay, primitives, transforms, hit, Collisions::ClosestHit, &hitCells );
+}
+
+int Grid::IntersectRays(
+    const Ray* rays,
+    int rayCount,
+    const std::vector< Primitive* >& primitives,
+    ArrayView< PrimitiveTransform > transforms,
+    RayHit* hits,
+    Collisions::RayQueryMode mode
+    ) const
+{
+    int hitCount = 0;
+
+    for( int i = 0; i < rayCount; ++i )
+    {
+        // A hit on an unbounded primitive caps the walk through the cells
+        bool rayHit = m_unbounded.IntersectRays( &rays[ i ], 1, primitives, transforms, &hits[ i ], mode ) > 0;
+        if( intersectRay( rays[ i ], primitives, transforms, hits[ i ], mode, 0 ) ) rayHit = true;
+
+        if( rayHit ) hitCount++;
+    }
+
+    return hitCount;
+}
+
+// Walks the cells pierced by the ray with a GridWalk, testing each cell's object list.
+// A mailbox skips primitives already tested in an earlier cell, their nearest hit is already in hit.
+// A hit beyond the current cell can still be beaten by an object in a later cell,
+// so closest hit traversal only stops once the hit lies within the cell being left
+bool Grid::intersectRay( const Ray& ray, const std::vector< Primitive* >& primitives, ArrayView< PrimitiveTransform > transforms, RayHit& hit, Collisions::RayQueryMode mode, std::vector< glm::vec3 >* visitedCells ) const
+{
+    if( mode == Collisions::AnyHit && hit.PrimitiveIndex >= 0 ) return false;
 
-    // Determine the shortest axis to a cell boundary
-    glm::vec3 cellP0 = m_p0 + ( glm::vec3( cell ) * m_cellSize );
-    glm::vec3 cellP1 = cellP0 + m_cellSize;
+    glm::vec3 inverseDirection = 1.0f / ray.Direction;
 
-    glm::vec3 tMax( Collisions::FAR_PLANE );
-    IsectData planeIsectData;
+    // Clip the ray to the grid bounds and its limit, return if it misses
+    glm::vec3 t0 = ( m_p0 - ray.Origin ) * inverseDirection;
+    glm::vec3 t1 = ( m_p1 - ray.Origin ) * inverseDirection;
+    glm::vec3 tNear = glm::min( t0, t1 );
+    glm::vec3 tFar = glm::max( t0, t1 );
+    float tEnter = glm::max( glm::max( tNear.x, tNear.y ), glm::max( tNear.z, 0.0f ) );
+    float tExit = glm::min( glm::min( tFar.x, tFar.y ), glm::min( tFar.z, hit.Distance ) );
+    if( tEnter > tExit ) return false;
 
-    for( int axis = 0; axis < 3; ++axis )
+    GridWalk walk( ray, inverseDirection, m_p0, m_cellSize, m_subdivisions, tEnter );
+    bool cellHit = false;
+    Mailbox mailbox;
+
+    while( true )
     {
-        glm::vec3 planePos = glm::vec3( 0.0f );
-        if( step[ axis ] == -1 )
+        if( visitedCells )
         {
-            planePos[ axis ] = cellP0[ axis ];
+            visitedCells->push_back( m_p0 + glm::vec3( walk.Cell ) * m_cellSize );
         }
-        if( step[ axis ] == 1 )
+
+        // Object lists are contiguous and -1 terminated
+        int index = cellIndex( walk.Cell );
+        if( IsOccupied( index ) )
         {
-            planePos[ axis ] = cellP1[ axis ];
+            for( const int* ref = &m_cellObjectRefs[ m_grid[ index ] ]; *ref != -1; ++ref )
+            {
+                if( !mailbox.Admit( *ref ) ) continue;
+
+                if( Collisions::IntersectRays( &ray, 1, primitives, transforms, ref, 1, &hit, mode ) > 0 )
+                {
+                    cellHit = true;
+                    if( mode == Collisions::AnyHit ) break;
+                }
+            }
         }
 
-        glm::vec3 planeNormal( 0.0f );
-        planeNormal[ axis ] = -1.0f;
+        float tCellExit = walk.Exit();
 
-        if( Collisions::IsectPlane( ray, planePos, planeNormal, planeIsectData ) )
-        {
-            tMax[ axis ] = glm::distance( ray.Origin, planeIsectData.Position );
-        }
+        if( cellHit && mode == Collisions::AnyHit ) break;
+        if( hit.Distance <= tCellExit || tCellExit >= tExit ) break;
+        if( !walk.Advance( m_subdivisions ) ) break;
     }
 
-    glm::vec3 tDelta = m_cellSize * glm::vec3( step ) * ( 1.0f / ray.Direction );
+    return cellHit;
+}
 
-    // Incrementation
-    hitCells.clear();
+// Two passes over each primitive's cell range, both spread across the scheduler's threads in chunks of primitives.
+// The first counts every cell's references, a prefix sum then allocates each list once with GRID_CELL_SLACK
+// spare slots, and the second scatters the references into them. Build time follows the reference count.
+// All cells and refs are marked dirty
+void Grid::buildGrid( const PrimitiveStore& primitives )
+{
+    int primitiveCount = primitives.Size();
+    int chunkCount = ( primitiveCount + GRID_BUILD_CHUNK - 1 ) / GRID_BUILD_CHUNK;
+    m_primitiveCells.resize( primitiveCount );
 
-    while( cell.x >= 0 && cell.x <= m_subdivisions &&
-           cell.y >= 0 && cell.y <= m_subdivisions &&
-           cell.z >= 0 && cell.z <= m_subdivisions )
+    for( int i = 0; i < m_arrayLength; ++i )
     {
-        hitCells.push_back( m_p0 + glm::vec3( cell ) * m_cellSize );
-
-        float minTMax = min( tMax.x, min( tMax.y, tMax.z ) );
+        m_cellCursors[ i ].store( 0, std::memory_order_relaxed );
+    }
 
-        if( minTMax == tMax.x )
+    m_scheduler.Run( chunkCount, [ & ]( int chunk, int thread )
+    {
+        int last = std::min( ( chunk + 1 ) * GRID_BUILD_CHUNK, primitiveCount );
+        for( PrimitiveHandle handle = chunk * GRID_BUILD_CHUNK; handle < last; ++handle )
         {
-            tMax.x = tMax.x + tDelta.x;
-            cell.x = cell.x + step.x;
+            m_primitiveCells[ handle ] = cellRange( primitives, handle );
+            forEachCell( primitives, handle, m_primitiveCells[ handle ], [ this ]( int cell )
+            {
+                m_cellCursors[ cell ].fetch_add( 1, std::memory_order_relaxed );
+            } );
         }
-        else if( minTMax == tMax.y )
+    } );
+
+    int offset = 0;
+    std::fill( m_occupancy.begin(), m_occupancy.end(), 0u );
+    for( int i = 0; i < m_arrayLength; ++i )
+    {
+        m_cellCounts[ i ] = m_cellCursors[ i ].load( std::memory_order_relaxed );
+        if( m_cellCounts[ i ] > 0 ) setOccupied( i, true );
+        m_cellCapacities[ i ] = m_cellCounts[ i ] + 1 + GRID_CELL_SLACK;
+        m_grid[ i ] = offset;
+        m_cellCursors[ i ].store( offset, std::memory_order_relaxed );
+        offset += m_cellCapacities[ i ];
+    }
+
+    // Unused slots, terminators included, stay -1
+    m_cellObjectRefs.assign( offset, -1 );
+    m_refsEnd = offset;
+    m_garbage = 0;
+
+    m_scheduler.Run( chunkCount, [ & ]( int chunk, int thread )
+    {
+        int last = std::min( ( chunk + 1 ) * GRID_BUILD_CHUNK, primitiveCount );
+        for( PrimitiveHandle handle = chunk * GRID_BUILD_CHUNK; handle < last; ++handle )
         {
-            tMax.y = tMax.y + tDelta.y;
-            cell.y = cell.y + step.y;
+            forEachCell( primitives, handle, m_primitiveCells[ handle ], [ & ]( int cell )
+            {
+                m_cellObjectRefs[ m_cellCursors[ cell ].fetch_add( 1, std::memory_order_relaxed ) ] = handle;
+            } );
         }
-        else if( minTMax == tMax.z )
+    } );
+
+    // Slots were claimed in thread order, sort each list so builds are reproducible
+    int cellChunkCount = ( m_arrayLength + GRID_BUILD_CHUNK - 1 ) / GRID_BUILD_CHUNK;
+    m_scheduler.Run( cellChunkCount, [ & ]( int chunk, int thread )
+    {
+        int last = std::min( ( chunk + 1 ) * GRID_BUILD_CHUNK, m_arrayLength );
+        for( int i = chunk * GRID_BUILD_CHUNK; i < last; ++i )
         {
-            tMax.z = tMax.z + tDelta.z;
-            cell.z = cell.z + step.z;
+            std::sort( m_cellObjectRefs.begin() + m_grid[ i ], m_cellObjectRefs.begin() + m_grid[ i ] + m_cellCounts[ i ] );
         }
+    } );
+
+    m_refsGrown = true;
+    m_dirtyCellFirst = 0;
+    m_dirtyCellLast = m_arrayLength;
+    m_dirtyRefFirst = 0;
+    m_dirtyRefLast = int( m_cellObjectRefs.size() );
+}
+
+// Cells overlapped by a primitive's bounds, empty for unbounded primitives which are kept out of the grid
+Grid::CellRange Grid::cellRange( const PrimitiveStore& primitives, PrimitiveHandle handle ) const
+{
+    CellRange range;
+    if( !IsBounded( primitives.GetTypes()[ handle ] ) ) return range;
+
+    Bounds bounds = ComputePrimitiveBounds( primitives, handle ).Intersection( Bounds( m_p0, m_p1 ) );
+    if( bounds.Empty() ) return range;
+
+    glm::ivec3 lastCell = m_subdivisions - 1;
+    range.Min = glm::clamp( glm::ivec3( glm::floor( ( bounds.Min - m_p0 ) / m_cellSize ) ), glm::ivec3( 0 ), lastCell );
+    range.Max = glm::clamp( glm::ivec3( glm::floor( ( bounds.Max - m_p0 ) / m_cellSize ) ), glm::ivec3( 0 ), lastCell );
+
+    return range;
+}
+
+// Narrows a primitive's cell range down to the cells its surface passes through
+bool Grid::primitiveInCell( const PrimitiveStore& primitives, PrimitiveHandle handle, const glm::ivec3& cell ) const
+{
+    glm::vec3 cellMin = m_p0 + glm::vec3( cell ) * m_cellSize;
+    return PrimitiveOverlapsBox( primitives, handle, Bounds( cellMin, cellMin + m_cellSize ) );
+}
+
+void Grid::insertRef( int cell, PrimitiveHandle handle )
+{
+    // Room for the reference and the terminator after it
+    if( m_cellCounts[ cell ] + 2 > m_cellCapacities[ cell ] )
+    {
+        relocateCell( cell );
     }
+
+    if( m_cellCounts[ cell ] == 0 )
+    {
+        setOccupied( cell, true );
+        markDirtyCell( cell );
+    }
+
+    int slot = m_grid[ cell ] + m_cellCounts[ cell ]++;
+    m_cellObjectRefs[ slot ] = handle;
+    markDirtyRefs( slot, slot + 1 );
 }
 
-void Grid::buildGrid( std::vector< Primitive* > primitives )
+void Grid::removeRef( int cell, PrimitiveHandle handle )
 {
-    memset( m_grid, -1, m_arrayLength * sizeof( int ) );
-    objectCells.clear();
+    int start = m_grid[ cell ];
+    int count = m_cellCounts[ cell ];
 
-    for( int x = 0; x < m_subdivisions; ++x )
+    for( int i = start; i < start + count; ++i )
     {
-        for( int y = 0; y < m_subdivisions; ++y )
+        if( m_cellObjectRefs[ i ] != handle ) continue;
+
+        // Swap the last reference into the hole, keeping the list contiguous
+        m_cellObjectRefs[ i ] = m_cellObjectRefs[ start + count - 1 ];
+        m_cellObjectRefs[ start + count - 1 ] = -1;
+        m_cellCounts[ cell ] = count - 1;
+        markDirtyRefs( i, start + count );
+
+        if( count == 1 )
         {
-            for( int z = 0; z < m_subdivisions; ++z )
-            {
-                int idx = x + y * m_subdivisions + z * m_subdivisions * m_subdivisions;
-                m_grid[ idx ] = m_cellObjectRefs.size();
-                glm::vec3 pos0( m_p0.x + x * m_cellSize.x, m_p0.y + y * m_cellSize.y, m_p0.z + z * m_cellSize.z );
-                glm::vec3 pos1 = pos0 + m_cellSize;
-                bool objectCell = false;
-                for( int i = 0; i < primitives.size(); ++i )
-                {
-                    glm::vec3 op0;
-                    glm::vec3 op1;
-
-                    // Determine Bounding Boxes for relevant shapes
-                    switch( primitives[ i ]->Type )
-                    {
-                        case Primitive::Sphere:
-                        case Primitive::Disc:
-                        {
-                            glm::vec3 dim = glm::vec3( 1.0f ) * max( primitives[ i ]->Scale.x, max( primitives[ i ]->Scale.y, primitives[ i ]->Scale.z ) );
-                            op0 = primitives[ i ]->Position - dim;
-                            op1 = primitives[ i ]->Position + dim;
-
-                            break;
-                        }
-                        case Primitive::AABB:
-                        {
-                            glm::vec3 dim = glm::vec3( 0.5f ) * primitives[ i ]->Scale;
-                            op0 = primitives[ i ]->Position - dim;
-                            op1 = primitives[ i ]->Position + dim;
-
-                            break;
-                        }
-                        default:
-                            break;
-                    }
-
-                    // Compute grid intersections
-                    switch( primitives[ i ]->Type )
-                    {
-                        case Primitive::Plane:
-                        {
-                            glm::vec3 cellP0 = m_p0 + ( glm::vec3( x, y, z ) * m_cellSize );
-                            glm::vec3 cellP1 = cellP0 + m_cellSize;
-
-                            if( Collisions::PlaneIntersectsAABB( primitives[ i ]->Position, glm::normalize( primitives[ i ]->Orientation * vec3( 0, -1, 0 ) ), cellP0, cellP1 ) )
-                            {
-                                m_cellObjectRefs.push_back( primitives[ i ]->ID );
-                                objectCell = true;
-                            }
-                            break;
-                        }
-                        case Primitive::Sphere:
-                        /* TODO: Fix for lower grid resolutions
-                        {
-                            glm::vec3 cellPos = m_p0 + ( glm::vec3( x, y, z ) * m_cellSize ) + m_cellSize * 0.5f;
-
-                            if( Collisions::SphereContainsPoint( cellPos, primitives[ i ]->Position, primitives[ i ]->Orientation, primitives[ i ]->Scale * ( m_cellSize * 0.5f ) ) )
-                            {
-                                m_cellObjectRefs.push_back( primitives[ i ]->ID );
-                                objectCell = true;
-                            }
-                            break;
-                        }
-                        */
-                        case Primitive::Disc:
-                        {
-                            glm::vec3 cellP0 = m_p0 + ( glm::vec3( x, y, z ) * m_cellSize );
-                            glm::vec3 cellP1 = cellP0 + m_cellSize;
-
-                            if( Collisions::AABBContainsAABB( primitives[ i ]->Position - primitives[ i ]->Scale, primitives[ i ]->Position + primitives[ i ]->Scale, cellP0, cellP1 ) )
-                            {
-                                m_cellObjectRefs.push_back( primitives[ i ]->ID );
-                                objectCell = true;
-                            }
-                            break;
-                        }
-                        case Primitive::AABB:
-                        {
-                            vec3 localPos0 = op0 - m_p0;
-                            ivec3 cell0 = ivec3( localPos0 / m_cellSize );
-                            vec3 localPos1 = op1 - m_p0;
-                            ivec3 cell1 = ivec3( localPos1 / m_cellSize );
-
-                            if( x >= cell0.x && x <= cell1.x &&
-                                y >= cell0.y && y <= cell1.y &&
-                                z >= cell0.z && z <= cell1.z )
-                            {
-                                if( x == cell0.x || y == cell0.y || z == cell0.z || x == cell1.x || y == cell1.y || z == cell1.z )
-                                {
-                                    m_cellObjectRefs.push_back( primitives[ i ]->ID );
-                                    objectCell = true;
-                                }
-                            }
-                            break;
-                        }
-                        default:
-                            break;
-                    }
-                }
-                if( objectCell )
-                {
-                    objectCells.push_back( m_p0 + glm::vec3( x, y, z ) * m_cellSize );
-                }
-                m_cellObjectRefs.push_back( -1 );
-            }
+            setOccupied( cell, false );
+            markDirtyCell( cell );
         }
+        return;
     }
 }
 
+// Moves a full cell's list to the end of the used slots with double the capacity.
+// The vector grows geometrically so the GPU buffer is rarely respecified
+void Grid::relocateCell( int cell )
+{
+    int capacity = m_cellCapacities[ cell ] * 2;
+
+    if( m_refsEnd + capacity > int( m_cellObjectRefs.size() ) )
+    {
+        m_cellObjectRefs.resize( std::max( m_refsEnd + capacity, int( m_cellObjectRefs.size() ) * 2 ), -1 );
+        m_refsGrown = true;
+    }
+
+    int start = m_refsEnd;
+    int count = m_cellCounts[ cell ];
+    std::copy( &m_cellObjectRefs[ m_grid[ cell ] ], &m_cellObjectRefs[ m_grid[ cell ] ] + count, &m_cellObjectRefs[ start ] );
+
+    m_garbage += m_cellCapacities[ cell ];
+    m_refsEnd += capacity;
+    m_grid[ cell ] = start;
+    m_cellCapacities[ cell ] = capacity;
+
+    markDirtyCell( cell );
+    markDirtyRefs( start, start + count );
+}
+
+void Grid::markDirtyCell( int cell )
+{
+    m_dirtyCellFirst = std::min( m_dirtyCellFirst, cell );
+    m_dirtyCellLast = std::max( m_dirtyCellLast, cell + 1 );
+}
+
+void Grid::setOccupied( int cell, bool occupied )
+{
+    uint32_t bit = 1u << ( cell & 31 );
+    if( occupied ) m_occupancy[ cell >> 5 ] |= bit;
+    else m_occupancy[ cell >> 5 ] &= ~bit;
+}
+
+void Grid::markDirtyRefs( int first, int last )
+{
+    m_dirtyRefFirst = std::min( m_dirtyRefFirst, first );
+    m_dirtyRefLast = std::max( m_dirtyRefLast, last );
+}
+
 void Grid::Draw()
 {
 #ifdef DRAW_OBJECT_CELLS
     glLineWidth( 1.0f );
-    for( int i = objectCells.size() - 1; i >= 0; --i )
+    for( int i = m_arrayLength - 1; i >= 0; --i )
     {
-        float distFactor = 30.0f / glm::distance( objectCells[ i ], testRay.Origin );
+        if( m_cellCounts[ i ] == 0 ) continue;
+
+        glm::vec3 cellPos = m_p0 + glm::vec3( i % m_subdivisions.x, ( i / m_subdivisions.x ) % m_subdivisions.y, i / ( m_subdivisions.x * m_subdivisions.y ) ) * m_cellSize;
+        float distFactor = 30.0f / glm::distance( cellPos, testRay.Origin );
         glColor3f( 0, distFactor, 0 );
-        drawCube( objectCells[ i ], objectCells[ i ] + m_cellSize );
+        drawCube( cellPos, cellPos + m_cellSize );
     }
 #endif
 
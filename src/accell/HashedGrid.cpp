@@ -0,0 +1,166 @@
+#include "accell/HashedGrid.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+#include "accell/Grid.h"
+
+// The table is kept at most this full, keeping probe sequences short
+const float HASHED_GRID_MAX_LOAD = 0.5f;
+
+HashedGrid::HashedGrid( const PrimitiveStore& primitives, float density )
+{
+    m_density = density;
+    Build( primitives );
+}
+
+void HashedGrid::Build( const PrimitiveStore& primitives )
+{
+    m_cellRefs.clear();
+    m_references.clear();
+    m_stats = HashedGridStats();
+
+    m_unbounded.Build( primitives );
+
+    // Cubic cells sized for about density cells per bounded primitive over the space they span
+    int boundedCount = std::max( 1, primitives.Size() - m_unbounded.Size() );
+    glm::vec3 extent = Grid::FitBounds( primitives ).Extent();
+    m_cellSize = std::cbrt( extent.x * extent.y * extent.z / ( m_density * boundedCount ) );
+    if( !( m_cellSize > 0.0f ) ) m_cellSize = 1.0f;
+
+    ArrayView< Primitive::ObjectType > types = primitives.GetTypes();
+
+    for( PrimitiveHandle handle = 0; handle < primitives.Size(); ++handle )
+    {
+        if( !IsBounded( types[ handle ] ) ) continue;
+
+        Bounds b = ComputePrimitiveBounds( primitives, handle );
+        if( b.Empty() ) continue;
+
+        glm::ivec3 first = glm::ivec3( glm::floor( b.Min / m_cellSize ) );
+        glm::ivec3 last = glm::ivec3( glm::floor( b.Max / m_cellSize ) );
+
+        for( int z = first.z; z <= last.z; ++z )
+        {
+            for( int y = first.y; y <= last.y; ++y )
+            {
+                for( int x = first.x; x <= last.x; ++x )
+                {
+                    CellRef ref;
+                    ref.Cell = glm::ivec3( x, y, z );
+                    ref.Handle = handle;
+                    m_cellRefs.push_back( ref );
+                }
+            }
+        }
+    }
+
+    // Group references by cell
+    std::sort( m_cellRefs.begin(), m_cellRefs.end(), []( const CellRef& a, const CellRef& b )
+    {
+        if( a.Cell.z != b.Cell.z ) return a.Cell.z < b.Cell.z;
+        if( a.Cell.y != b.Cell.y ) return a.Cell.y < b.Cell.y;
+        if( a.Cell.x != b.Cell.x ) return a.Cell.x < b.Cell.x;
+        return a.Handle < b.Handle;
+    } );
+
+    int occupied = 0;
+    for( int i = 0; i < int( m_cellRefs.size() ); ++i )
+    {
+        if( i == 0 || m_cellRefs[ i ].Cell != m_cellRefs[ i - 1 ].Cell ) occupied++;
+    }
+
+    int tableSize = 1;
+    while( tableSize * HASHED_GRID_MAX_LOAD < std::max( occupied, 1 ) ) tableSize *= 2;
+
+    HashedGridSlot emptySlot;
+    emptySlot.Cell = glm::ivec3( 0 );
+    emptySlot.First = -1;
+    m_table.assign( tableSize, emptySlot );
+
+    // Lay out each cell's -1 terminated list and insert the cell, tracking the extent of them all
+    m_bounds = Bounds();
+    glm::ivec3 minCell( INT_MAX );
+    glm::ivec3 maxCell( INT_MIN );
+
+    for( int i = 0; i < int( m_cellRefs.size() ); )
+    {
+        glm::ivec3 cell = m_cellRefs[ i ].Cell;
+        insertCell( cell, int( m_references.size() ) );
+
+        for( ; i < int( m_cellRefs.size() ) && m_cellRefs[ i ].Cell == cell; ++i )
+        {
+            m_references.push_back( m_cellRefs[ i ].Handle );
+        }
+        m_references.push_back( -1 );
+
+        minCell = glm::min( minCell, cell );
+        maxCell = glm::max( maxCell, cell );
+    }
+
+    if( occupied > 0 )
+    {
+        m_minCell = minCell;
+        m_resolution = maxCell - minCell + 1;
+        m_bounds = Bounds( glm::vec3( minCell ) * m_cellSize, glm::vec3( maxCell + 1 ) * m_cellSize );
+    }
+    else
+    {
+        m_minCell = glm::ivec3( 0 );
+        m_resolution = glm::ivec3( 0 );
+    }
+
+    m_stats.CellSize = m_cellSize;
+    m_stats.OccupiedCells = occupied;
+    m_stats.TableSize = tableSize;
+    m_stats.References = int( m_cellRefs.size() );
+    m_stats.Bytes = int( m_table.size() * sizeof( HashedGridSlot ) + m_references.size() * sizeof( int ) );
+}
+
+// Spatial hash of Teschner et al. on the cell's integer coordinates, wrapping in 32 bits
+uint32_t HashedGrid::Hash( const glm::ivec3& cell )
+{
+    return ( uint32_t( cell.x ) * 73856093u ) ^ ( uint32_t( cell.y ) * 19349663u ) ^ ( uint32_t( cell.z ) * 83492791u );
+}
+
+int HashedGrid::FindCell( const glm::ivec3& cell ) const
+{
+    uint32_t mask = uint32_t( m_table.size() - 1 );
+
+    for( uint32_t slot = Hash( cell ) & mask; ; slot = ( slot + 1 ) & mask )
+    {
+        const HashedGridSlot& entry = m_table[ slot ];
+        if( entry.First == -1 ) return -1;
+        if( entry.Cell == cell ) return entry.First;
+    }
+}
+
+void HashedGrid::insertCell( const glm::ivec3& cell, int first )
+{
+    uint32_t mask = uint32_t( m_table.size() - 1 );
+    uint32_t slot = Hash( cell ) & mask;
+    int probeLength = 1;
+
+    while( m_table[ slot ].First != -1 )
+    {
+        slot = ( slot + 1 ) & mask;
+        probeLength++;
+    }
+
+    m_table[ slot ].Cell = cell;
+    m_table[ slot ].First = first;
+    m_stats.MaxProbeLength = std::max( m_stats.MaxProbeLength, probeLength );
+}
+
+int HashedGrid::IntersectRays(
+    const Ray* rays,
+    int rayCount,
+    const std::vector< Primitive* >& primitives,
+    ArrayView< PrimitiveTransform > transforms,
+    RayHit* hits,
+    Collisions::RayQueryMode mode
+    ) const
+{
+    return IntersectStructureRays( *this, rays, rayCount, primitives, transforms, hits, mode );
+}
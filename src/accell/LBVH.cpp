@@ -0,0 +1,385 @@
+#include "accell/LBVH.h"
+
+#include <algorithm>
+
+#include "accell/BVH.h"
+
+// Primitives or nodes handed to a build thread at a time
+const int LBVH_CHUNK = 16384;
+// Radix sort digit width, four passes cover the 30 bit codes
+const int LBVH_RADIX_BITS = 8;
+const int LBVH_RADIX = 1 << LBVH_RADIX_BITS;
+const int LBVH_MORTON_BITS = 30;
+// Subtrees with fewer primitives than this are left as built, restructuring them gains little
+const int LBVH_TREELET_MIN_PRIMITIVES = 7;
+
+static int countLeadingZeros( uint32_t x )
+{
+    if( x == 0 ) return 32;
+
+    int n = 0;
+    if( ( x & 0xFFFF0000u ) == 0 ) { n += 16; x <<= 16; }
+    if( ( x & 0xFF000000u ) == 0 ) { n += 8; x <<= 8; }
+    if( ( x & 0xF0000000u ) == 0 ) { n += 4; x <<= 4; }
+    if( ( x & 0xC0000000u ) == 0 ) { n += 2; x <<= 2; }
+    if( ( x & 0x80000000u ) == 0 ) { n += 1; }
+    return n;
+}
+
+// Spreads the low 10 bits of v to every third bit
+static uint32_t expandBits( uint32_t v )
+{
+    v = ( v * 0x00010001u ) & 0xFF0000FFu;
+    v = ( v * 0x00000101u ) & 0x0F00F00Fu;
+    v = ( v * 0x00000011u ) & 0xC30C30C3u;
+    v = ( v * 0x00000005u ) & 0x49249249u;
+    return v;
+}
+
+uint32_t LBVH::MortonCode( const glm::vec3& unit )
+{
+    glm::vec3 q = glm::clamp( unit * 1024.0f, glm::vec3( 0.0f ), glm::vec3( 1023.0f ) );
+    return ( expandBits( uint32_t( q.x ) ) << 2 ) | ( expandBits( uint32_t( q.y ) ) << 1 ) | expandBits( uint32_t( q.z ) );
+}
+
+void LBVH::Build( TileScheduler& scheduler, const std::vector< Bounds >& primitiveBounds, int treeletRounds )
+{
+    m_restructured = 0;
+
+    m_handles.clear();
+    for( int handle = 0; handle < int( primitiveBounds.size() ); ++handle )
+    {
+        if( !primitiveBounds[ handle ].Empty() ) m_handles.push_back( handle );
+    }
+
+    int n = int( m_handles.size() );
+    m_leafCount = n;
+    if( n == 0 ) return;
+
+    int chunkCount = ( n + LBVH_CHUNK - 1 ) / LBVH_CHUNK;
+
+    // Centroid bounds, reduced per chunk, quantise the codes
+    m_chunkBounds.assign( chunkCount, Bounds() );
+    scheduler.Run( chunkCount, [ & ]( int chunk, int thread )
+    {
+        int last = std::min( ( chunk + 1 ) * LBVH_CHUNK, n );
+        for( int i = chunk * LBVH_CHUNK; i < last; ++i )
+        {
+            m_chunkBounds[ chunk ].Extend( primitiveBounds[ m_handles[ i ] ].Center() );
+        }
+    } );
+
+    Bounds centroidBounds;
+    for( int chunk = 0; chunk < chunkCount; ++chunk )
+    {
+        centroidBounds.Extend( m_chunkBounds[ chunk ] );
+    }
+
+    glm::vec3 extent = centroidBounds.Extent();
+    glm::vec3 scale( 0.0f );
+    for( int axis = 0; axis < 3; ++axis )
+    {
+        if( extent[ axis ] > 0.0f ) scale[ axis ] = 1.0f / extent[ axis ];
+    }
+
+    m_codes.resize( n );
+    scheduler.Run( chunkCount, [ & ]( int chunk, int thread )
+    {
+        int last = std::min( ( chunk + 1 ) * LBVH_CHUNK, n );
+        for( int i = chunk * LBVH_CHUNK; i < last; ++i )
+        {
+            m_codes[ i ] = MortonCode( ( primitiveBounds[ m_handles[ i ] ].Center() - centroidBounds.Min ) * scale );
+        }
+    } );
+
+    sortCodes( scheduler );
+
+    int nodeCount = 2 * n - 1;
+    m_children.resize( n - 1 );
+    m_parents.resize( nodeCount );
+    m_bounds.resize( nodeCount );
+    m_counts.resize( nodeCount );
+    m_costs.resize( nodeCount );
+    if( int( m_visits.size() ) < n - 1 ) m_visits = std::vector< std::atomic< int > >( n - 1 );
+
+    // Every internal node finds its own range and split from the sorted codes alone
+    m_parents[ 0 ] = -1;
+    int internalChunkCount = ( n - 1 + LBVH_CHUNK - 1 ) / LBVH_CHUNK;
+    scheduler.Run( internalChunkCount, [ & ]( int chunk, int thread )
+    {
+        int last = std::min( ( chunk + 1 ) * LBVH_CHUNK, n - 1 );
+        for( int i = chunk * LBVH_CHUNK; i < last; ++i )
+        {
+            buildInternalNode( i );
+        }
+    } );
+
+    propagate( scheduler, primitiveBounds, false );
+    for( int round = 0; round < treeletRounds; ++round )
+    {
+        propagate( scheduler, primitiveBounds, true );
+    }
+}
+
+bool LBVH::PrefersLeaf( int node ) const
+{
+    return m_counts[ node ] <= BVH_MAX_LEAF_SIZE && m_costs[ node ] >= BVH_INTERSECT_COST * m_counts[ node ] * m_bounds[ node ].SurfaceArea();
+}
+
+// Parallel LSD radix sort of the codes, carrying their handles.
+// Each pass, every chunk counts its digits, a prefix sum over ( digit, chunk ) gives each chunk its own slots
+// per digit, and the chunks scatter into them in order, keeping the sort stable
+void LBVH::sortCodes( TileScheduler& scheduler )
+{
+    int n = m_leafCount;
+    int chunkCount = ( n + LBVH_CHUNK - 1 ) / LBVH_CHUNK;
+
+    m_codesScratch.resize( n );
+    m_handlesScratch.resize( n );
+    m_histograms.resize( chunkCount * LBVH_RADIX );
+
+    for( int shift = 0; shift < LBVH_MORTON_BITS; shift += LBVH_RADIX_BITS )
+    {
+        scheduler.Run( chunkCount, [ & ]( int chunk, int thread )
+        {
+            int* histogram = &m_histograms[ chunk * LBVH_RADIX ];
+            std::fill( histogram, histogram + LBVH_RADIX, 0 );
+
+            int last = std::min( ( chunk + 1 ) * LBVH_CHUNK, n );
+            for( int i = chunk * LBVH_CHUNK; i < last; ++i )
+            {
+                histogram[ ( m_codes[ i ] >> shift ) & ( LBVH_RADIX - 1 ) ]++;
+            }
+        } );
+
+        int offset = 0;
+        for( int digit = 0; digit < LBVH_RADIX; ++digit )
+        {
+            for( int chunk = 0; chunk < chunkCount; ++chunk )
+            {
+                int count = m_histograms[ chunk * LBVH_RADIX + digit ];
+                m_histograms[ chunk * LBVH_RADIX + digit ] = offset;
+                offset += count;
+            }
+        }
+
+        scheduler.Run( chunkCount, [ & ]( int chunk, int thread )
+        {
+            int* slots = &m_histograms[ chunk * LBVH_RADIX ];
+
+            int last = std::min( ( chunk + 1 ) * LBVH_CHUNK, n );
+            for( int i = chunk * LBVH_CHUNK; i < last; ++i )
+            {
+                int slot = slots[ ( m_codes[ i ] >> shift ) & ( LBVH_RADIX - 1 ) ]++;
+                m_codesScratch[ slot ] = m_codes[ i ];
+                m_handlesScratch[ slot ] = m_handles[ i ];
+            }
+        } );
+
+        m_codes.swap( m_codesScratch );
+        m_handles.swap( m_handlesScratch );
+    }
+}
+
+// Length of the prefix shared by sorted codes i and j, -1 outside the array.
+// Duplicate codes are told apart by their indices, as if appended to the code
+int LBVH::prefixLength( int i, int j ) const
+{
+    if( j < 0 || j >= m_leafCount ) return -1;
+
+    uint32_t a = m_codes[ i ];
+    uint32_t b = m_codes[ j ];
+    if( a == b ) return 32 + countLeadingZeros( uint32_t( i ^ j ) );
+
+    return countLeadingZeros( a ^ b );
+}
+
+// Internal node i covers a range of leaves with i at one end, found by search along the longer shared prefix,
+// and splits it where the prefix shared by the whole range ends
+void LBVH::buildInternalNode( int i )
+{
+    int direction = prefixLength( i, i + 1 ) > prefixLength( i, i - 1 ) ? 1 : -1;
+
+    // Range length, bounded by doubling then found by binary search
+    int minPrefix = prefixLength( i, i - direction );
+    int lengthMax = 2;
+    while( prefixLength( i, i + lengthMax * direction ) > minPrefix ) lengthMax *= 2;
+
+    int length = 0;
+    for( int step = lengthMax / 2; step >= 1; step /= 2 )
+    {
+        if( prefixLength( i, i + ( length + step ) * direction ) > minPrefix ) length += step;
+    }
+    int j = i + length * direction;
+
+    // Last leaf sharing more than the range's prefix with i
+    int nodePrefix = prefixLength( i, j );
+    int split = 0;
+    int step = length;
+    do
+    {
+        step = ( step + 1 ) / 2;
+        if( split + step < length && prefixLength( i, i + ( split + step ) * direction ) > nodePrefix ) split += step;
+    }
+    while( step > 1 );
+
+    int gamma = i + split * direction + std::min( direction, 0 );
+
+    int left = std::min( i, j ) == gamma ? m_leafCount - 1 + gamma : gamma;
+    int right = std::max( i, j ) == gamma + 1 ? m_leafCount - 1 + gamma + 1 : gamma + 1;
+
+    m_children[ i ] = glm::ivec2( left, right );
+    m_parents[ left ] = i;
+    m_parents[ right ] = i;
+}
+
+// Walks up from every leaf, the first child to reach a node stops and the second, with both children done,
+// updates the node and carries on. Restructuring passes also optimise the treelet at each node they update,
+// only ever touching nodes below it, which no other thread is still visiting
+void LBVH::propagate( TileScheduler& scheduler, const std::vector< Bounds >& primitiveBounds, bool restructure )
+{
+    int n = m_leafCount;
+    int chunkCount = ( n + LBVH_CHUNK - 1 ) / LBVH_CHUNK;
+
+    for( int i = 0; i < n - 1; ++i )
+    {
+        m_visits[ i ].store( 0, std::memory_order_relaxed );
+    }
+
+    scheduler.Run( chunkCount, [ & ]( int chunk, int thread )
+    {
+        int last = std::min( ( chunk + 1 ) * LBVH_CHUNK, n );
+        for( int i = chunk * LBVH_CHUNK; i < last; ++i )
+        {
+            int leaf = n - 1 + i;
+            if( !restructure )
+            {
+                m_bounds[ leaf ] = primitiveBounds[ m_handles[ i ] ];
+                m_counts[ leaf ] = 1;
+                m_costs[ leaf ] = BVH_INTERSECT_COST * m_bounds[ leaf ].SurfaceArea();
+            }
+
+            for( int node = m_parents[ leaf ]; node >= 0; node = m_parents[ node ] )
+            {
+                if( m_visits[ node ].fetch_add( 1, std::memory_order_acq_rel ) == 0 ) break;
+
+                updateNode( node );
+                if( restructure && m_counts[ node ] >= LBVH_TREELET_MIN_PRIMITIVES ) restructureTreelet( node );
+            }
+        }
+    } );
+}
+
+void LBVH::updateNode( int node )
+{
+    int left = m_children[ node ].x;
+    int right = m_children[ node ].y;
+
+    Bounds bounds = m_bounds[ left ];
+    bounds.Extend( m_bounds[ right ] );
+    m_bounds[ node ] = bounds;
+    m_counts[ node ] = m_counts[ left ] + m_counts[ right ];
+
+    float area = bounds.SurfaceArea();
+    float cost = BVH_TRAVERSAL_COST * area + m_costs[ left ] + m_costs[ right ];
+    if( m_counts[ node ] <= BVH_MAX_LEAF_SIZE ) cost = std::min( cost, BVH_INTERSECT_COST * m_counts[ node ] * area );
+    m_costs[ node ] = cost;
+}
+
+// Grows a treelet of up to Treelet::MaxLeaves leaves below the root, expanding the largest leaf each time,
+// finds the topology over those leaves with the lowest SAH cost by dynamic programming over their subsets,
+// and rebuilds the treelet that way if it's cheaper than the current one
+void LBVH::restructureTreelet( int root )
+{
+    Treelet treelet;
+    treelet.Leaves[ 0 ] = m_children[ root ].x;
+    treelet.Leaves[ 1 ] = m_children[ root ].y;
+    treelet.LeafCount = 2;
+
+    while( treelet.LeafCount < Treelet::MaxLeaves )
+    {
+        int largest = -1;
+        float largestArea = -1.0f;
+        for( int i = 0; i < treelet.LeafCount; ++i )
+        {
+            float area = m_bounds[ treelet.Leaves[ i ] ].SurfaceArea();
+            if( !IsLeaf( treelet.Leaves[ i ] ) && area > largestArea )
+            {
+                largest = i;
+                largestArea = area;
+            }
+        }
+        if( largest < 0 ) break;
+
+        int node = treelet.Leaves[ largest ];
+        treelet.Internals[ treelet.InternalCount++ ] = node;
+        treelet.Leaves[ largest ] = m_children[ node ].x;
+        treelet.Leaves[ treelet.LeafCount++ ] = m_children[ node ].y;
+    }
+
+    if( treelet.LeafCount < 3 ) return;
+
+    // Subsets are visited in increasing order, so every proper subset is done before the sets holding it
+    int all = ( 1 << treelet.LeafCount ) - 1;
+    for( int subset = 1; subset <= all; ++subset )
+    {
+        int lowest = subset & -subset;
+        if( subset == lowest )
+        {
+            int leaf = treelet.Leaves[ countLeadingZeros( 1u ) - countLeadingZeros( uint32_t( lowest ) ) ];
+            treelet.SubsetBounds[ subset ] = m_bounds[ leaf ];
+            treelet.SubsetCosts[ subset ] = m_costs[ leaf ];
+            treelet.SubsetCounts[ subset ] = m_counts[ leaf ];
+            continue;
+        }
+
+        treelet.SubsetBounds[ subset ] = treelet.SubsetBounds[ subset ^ lowest ];
+        treelet.SubsetBounds[ subset ].Extend( treelet.SubsetBounds[ lowest ] );
+        treelet.SubsetCounts[ subset ] = treelet.SubsetCounts[ subset ^ lowest ] + treelet.SubsetCounts[ lowest ];
+
+        // Each split once, by the side holding the lowest leaf
+        float bestSplitCost = FLT_MAX;
+        for( int part = ( subset - 1 ) & subset; part > 0; part = ( part - 1 ) & subset )
+        {
+            if( !( part & lowest ) ) continue;
+
+            float splitCost = treelet.SubsetCosts[ part ] + treelet.SubsetCosts[ subset ^ part ];
+            if( splitCost < bestSplitCost )
+            {
+                bestSplitCost = splitCost;
+                treelet.SubsetSplits[ subset ] = part;
+            }
+        }
+
+        float area = treelet.SubsetBounds[ subset ].SurfaceArea();
+        float cost = BVH_TRAVERSAL_COST * area + bestSplitCost;
+        if( treelet.SubsetCounts[ subset ] <= BVH_MAX_LEAF_SIZE ) cost = std::min( cost, BVH_INTERSECT_COST * treelet.SubsetCounts[ subset ] * area );
+        treelet.SubsetCosts[ subset ] = cost;
+    }
+
+    if( !( treelet.SubsetCosts[ all ] < m_costs[ root ] ) ) return;
+
+    rebuildTreelet( treelet, all, root );
+    m_restructured++;
+}
+
+// Gives node the chosen split of a subset of the treelet's leaves, taking replaced nodes for its children's splits
+int LBVH::rebuildTreelet( Treelet& treelet, int subset, int node )
+{
+    int lowest = subset & -subset;
+    if( subset == lowest ) return treelet.Leaves[ countLeadingZeros( 1u ) - countLeadingZeros( uint32_t( lowest ) ) ];
+
+    int part = treelet.SubsetSplits[ subset ];
+    int left = rebuildTreelet( treelet, part, ( part & ( part - 1 ) ) ? treelet.Internals[ treelet.NextInternal++ ] : -1 );
+    int rest = subset ^ part;
+    int right = rebuildTreelet( treelet, rest, ( rest & ( rest - 1 ) ) ? treelet.Internals[ treelet.NextInternal++ ] : -1 );
+
+    m_children[ node ] = glm::ivec2( left, right );
+    m_parents[ left ] = node;
+    m_parents[ right ] = node;
+    m_bounds[ node ] = treelet.SubsetBounds[ subset ];
+    m_counts[ node ] = treelet.SubsetCounts[ subset ];
+    m_costs[ node ] = treelet.SubsetCosts[ subset ];
+
+    return node;
+}
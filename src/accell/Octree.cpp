@@ -0,0 +1,146 @@
+#include "accell/Octree.h"
+
+#include <algorithm>
+
+// Nodes holding more references than this are subdivided
+const int OCTREE_LEAF_SIZE = 8;
+
+// One octant of a box, see OctreeNode for the numbering
+static Bounds octantBounds( const Bounds& box, int octant )
+{
+    glm::vec3 center = box.Center();
+    Bounds child = box;
+
+    if( octant & 4 ) child.Min.x = center.x; else child.Max.x = center.x;
+    if( octant & 2 ) child.Min.y = center.y; else child.Max.y = center.y;
+    if( octant & 1 ) child.Min.z = center.z; else child.Max.z = center.z;
+
+    return child;
+}
+
+Octree::Octree( const PrimitiveStore& primitives )
+{
+    Build( primitives );
+}
+
+void Octree::Build( const PrimitiveStore& primitives )
+{
+    m_nodes.clear();
+    m_references.clear();
+    m_stats = OctreeStats();
+
+    m_unbounded.Build( primitives );
+
+    ArrayView< Primitive::ObjectType > types = primitives.GetTypes();
+    m_primitiveBounds.resize( primitives.Size() );
+
+    std::vector< int > refs;
+    Bounds sceneBounds;
+    for( PrimitiveHandle handle = 0; handle < primitives.Size(); ++handle )
+    {
+        m_primitiveBounds[ handle ] = IsBounded( types[ handle ] ) ? ComputePrimitiveBounds( primitives, handle ) : Bounds();
+        if( m_primitiveBounds[ handle ].Empty() ) continue;
+
+        refs.push_back( handle );
+        sceneBounds.Extend( m_primitiveBounds[ handle ] );
+    }
+
+    m_nodes.emplace_back();
+
+    if( refs.empty() )
+    {
+        // An empty leaf, which traversal never reaches
+        m_bounds = Bounds();
+        m_nodes[ 0 ].Mask = 0;
+        m_nodes[ 0 ].Offset = 0;
+        m_references.push_back( -1 );
+    }
+    else
+    {
+        // A cube, so every node is one too
+        glm::vec3 extent = sceneBounds.Extent();
+        float size = glm::max( glm::max( extent.x, extent.y ), extent.z );
+        if( !( size > 0.0f ) ) size = 1.0f;
+
+        glm::vec3 center = sceneBounds.Center();
+        m_bounds = Bounds( center - glm::vec3( size * 0.5f ), center + glm::vec3( size * 0.5f ) );
+
+        buildNode( primitives, 0, m_bounds, refs, 0 );
+    }
+
+    m_stats.Nodes = int( m_nodes.size() );
+    m_stats.Bytes = int( m_nodes.size() * sizeof( OctreeNode ) + m_references.size() * sizeof( int ) );
+}
+
+int Octree::IntersectRays(
+    const Ray* rays,
+    int rayCount,
+    const std::vector< Primitive* >& primitives,
+    ArrayView< PrimitiveTransform > transforms,
+    RayHit* hits,
+    Collisions::RayQueryMode mode
+    ) const
+{
+    return IntersectStructureRays( *this, rays, rayCount, primitives, transforms, hits, mode );
+}
+
+// Fills in the node at index over box, which refs consumes, subdividing while it holds too many references
+// and the octants would separate them. Children are appended as a block, then built depth first
+void Octree::buildNode( const PrimitiveStore& primitives, int index, const Bounds& box, std::vector< int >& refs, int depth )
+{
+    m_stats.MaxDepth = std::max( m_stats.MaxDepth, depth );
+
+    if( int( refs.size() ) > OCTREE_LEAF_SIZE && depth < OCTREE_MAX_DEPTH )
+    {
+        std::vector< int > octantRefs[ 8 ];
+        int mask = 0;
+        bool separates = false;
+
+        for( int octant = 0; octant < 8; ++octant )
+        {
+            Bounds octantBox = octantBounds( box, octant );
+            for( int ref : refs )
+            {
+                if( m_primitiveBounds[ ref ].Intersection( octantBox ).Empty() ) continue;
+                if( !PrimitiveOverlapsBox( primitives, ref, octantBox ) ) continue;
+
+                octantRefs[ octant ].push_back( ref );
+            }
+
+            if( !octantRefs[ octant ].empty() ) mask |= 1 << octant;
+            if( octantRefs[ octant ].size() < refs.size() ) separates = true;
+        }
+
+        // Octants that would each hold everything only multiply the references
+        if( mask != 0 && separates )
+        {
+            int first = int( m_nodes.size() );
+            for( int octant = 0; octant < 8; ++octant )
+            {
+                if( mask & ( 1 << octant ) ) m_nodes.emplace_back();
+            }
+
+            m_nodes[ index ].Mask = mask;
+            m_nodes[ index ].Offset = first;
+
+            // The octants' lists hold everything from here down
+            std::vector< int >().swap( refs );
+
+            int child = first;
+            for( int octant = 0; octant < 8; ++octant )
+            {
+                if( !( mask & ( 1 << octant ) ) ) continue;
+                buildNode( primitives, child++, octantBounds( box, octant ), octantRefs[ octant ], depth + 1 );
+            }
+            return;
+        }
+    }
+
+    m_nodes[ index ].Mask = 0;
+    m_nodes[ index ].Offset = int( m_references.size() );
+    m_references.insert( m_references.end(), refs.begin(), refs.end() );
+    m_references.push_back( -1 );
+
+    m_stats.Leaves++;
+    m_stats.References += int( refs.size() );
+}
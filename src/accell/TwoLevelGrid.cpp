@@ -0,0 +1,161 @@
+#include "accell/TwoLevelGrid.h"
+
+#include <algorithm>
+
+#include "accell/Grid.h"
+
+// Cells per primitive over the whole scene for the top level, kept coarse so sparse space is crossed in few steps
+const float TWO_LEVEL_TOP_DENSITY = 0.5f;
+// Cells per reference inside a subdivided top cell
+const float TWO_LEVEL_SUB_DENSITY = GRID_DEFAULT_DENSITY;
+// Top cells holding more references than this get a sub grid
+const int TWO_LEVEL_LEAF_SIZE = 4;
+// Sub grid resolutions are packed into 8 bits per axis
+const int TWO_LEVEL_MAX_SUB_RESOLUTION = 16;
+
+// Inclusive range of cells a box overlaps, false if it misses the grid
+static bool cellRange( const Bounds& b, const glm::vec3& gridMin, const glm::vec3& cellSize, const glm::ivec3& resolution, glm::ivec3& first, glm::ivec3& last )
+{
+    if( b.Empty() ) return false;
+
+    first = glm::clamp( glm::ivec3( glm::floor( ( b.Min - gridMin ) / cellSize ) ), glm::ivec3( 0 ), resolution - 1 );
+    last = glm::clamp( glm::ivec3( glm::floor( ( b.Max - gridMin ) / cellSize ) ), glm::ivec3( 0 ), resolution - 1 );
+    return true;
+}
+
+TwoLevelGrid::TwoLevelGrid( const PrimitiveStore& primitives )
+{
+    Build( primitives );
+}
+
+void TwoLevelGrid::Build( const PrimitiveStore& primitives )
+{
+    m_cells.clear();
+    m_references.clear();
+    m_stats = TwoLevelGridStats();
+
+    m_unbounded.Build( primitives );
+    m_bounds = Grid::FitBounds( primitives );
+    m_resolution = Grid::ChooseResolution( m_bounds, primitives.Size(), TWO_LEVEL_TOP_DENSITY );
+    m_cellSize = m_bounds.Extent() / glm::vec3( m_resolution );
+
+    int topCount = m_resolution.x * m_resolution.y * m_resolution.z;
+    m_topLists.resize( topCount );
+    for( int i = 0; i < topCount; ++i )
+    {
+        m_topLists[ i ].clear();
+    }
+
+    // Bin every primitive into the top cells it overlaps
+    m_primitiveBounds.resize( primitives.Size() );
+    for( PrimitiveHandle handle = 0; handle < primitives.Size(); ++handle )
+    {
+        m_primitiveBounds[ handle ] = IsBounded( primitives.GetTypes()[ handle ] ) ? ComputePrimitiveBounds( primitives, handle ) : Bounds();
+
+        glm::ivec3 first, last;
+        if( !cellRange( m_primitiveBounds[ handle ], m_bounds.Min, m_cellSize, m_resolution, first, last ) ) continue;
+
+        for( int z = first.z; z <= last.z; ++z )
+        {
+            for( int y = first.y; y <= last.y; ++y )
+            {
+                for( int x = first.x; x <= last.x; ++x )
+                {
+                    m_topLists[ x + m_resolution.x * ( y + m_resolution.y * z ) ].push_back( handle );
+                }
+            }
+        }
+    }
+
+    // Sparse cells keep their list, crowded ones are subdivided
+    m_cells.resize( topCount );
+    for( int i = 0; i < topCount; ++i )
+    {
+        const std::vector< int >& list = m_topLists[ i ];
+
+        if( int( list.size() ) <= TWO_LEVEL_LEAF_SIZE )
+        {
+            m_cells[ i ].InitLeaf( int( m_references.size() ), int( list.size() ) );
+            m_references.insert( m_references.end(), list.begin(), list.end() );
+            addLeafStats( m_cells[ i ] );
+        }
+        else
+        {
+            glm::ivec3 cell( i % m_resolution.x, ( i / m_resolution.x ) % m_resolution.y, i / ( m_resolution.x * m_resolution.y ) );
+            glm::vec3 cellMin = m_bounds.Min + glm::vec3( cell ) * m_cellSize;
+            subdivideCell( i, Bounds( cellMin, cellMin + m_cellSize ) );
+        }
+    }
+
+    m_stats.Resolution = m_resolution;
+    m_stats.TopCells = topCount;
+}
+
+// Gives a crowded top cell a sub grid fitted to its references, appending the sub cells and their lists
+void TwoLevelGrid::subdivideCell( int cell, const Bounds& cellBounds )
+{
+    const std::vector< int >& list = m_topLists[ cell ];
+
+    glm::ivec3 resolution = glm::min( Grid::ChooseResolution( cellBounds, int( list.size() ), TWO_LEVEL_SUB_DENSITY ), glm::ivec3( TWO_LEVEL_MAX_SUB_RESOLUTION ) );
+    glm::vec3 subCellSize = cellBounds.Extent() / glm::vec3( resolution );
+    int subCount = resolution.x * resolution.y * resolution.z;
+
+    m_subLists.resize( std::max( int( m_subLists.size() ), subCount ) );
+    for( int i = 0; i < subCount; ++i )
+    {
+        m_subLists[ i ].clear();
+    }
+
+    for( int i = 0; i < int( list.size() ); ++i )
+    {
+        PrimitiveHandle handle = list[ i ];
+
+        glm::ivec3 first, last;
+        if( !cellRange( m_primitiveBounds[ handle ].Intersection( cellBounds ), cellBounds.Min, subCellSize, resolution, first, last ) ) continue;
+
+        for( int z = first.z; z <= last.z; ++z )
+        {
+            for( int y = first.y; y <= last.y; ++y )
+            {
+                for( int x = first.x; x <= last.x; ++x )
+                {
+                    m_subLists[ x + resolution.x * ( y + resolution.y * z ) ].push_back( handle );
+                }
+            }
+        }
+    }
+
+    int firstChild = int( m_cells.size() );
+    m_cells.resize( firstChild + subCount );
+    m_cells[ cell ].InitSubdivided( firstChild, resolution );
+
+    for( int i = 0; i < subCount; ++i )
+    {
+        TwoLevelGridCell& leaf = m_cells[ firstChild + i ];
+        leaf.InitLeaf( int( m_references.size() ), int( m_subLists[ i ].size() ) );
+        m_references.insert( m_references.end(), m_subLists[ i ].begin(), m_subLists[ i ].end() );
+        addLeafStats( leaf );
+    }
+
+    m_stats.SubGrids++;
+    m_stats.SubCells += subCount;
+}
+
+void TwoLevelGrid::addLeafStats( const TwoLevelGridCell& leaf )
+{
+    m_stats.References += leaf.Count;
+    m_stats.MaxLeafReferences = std::max( m_stats.MaxLeafReferences, leaf.Count );
+    if( leaf.Count == 0 ) m_stats.EmptyLeaves++;
+}
+
+int TwoLevelGrid::IntersectRays(
+    const Ray* rays,
+    int rayCount,
+    const std::vector< Primitive* >& primitives,
+    ArrayView< PrimitiveTransform > transforms,
+    RayHit* hits,
+    Collisions::RayQueryMode mode
+    ) const
+{
+    return IntersectStructureRays( *this, rays, rayCount, primitives, transforms, hits, mode );
+}
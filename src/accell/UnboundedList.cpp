@@ -0,0 +1,28 @@
+#include "accell/UnboundedList.h"
+
+#include "Bounds.h"
+
+void UnboundedList::Build( const PrimitiveStore& primitives )
+{
+    m_primitives.clear();
+
+    ArrayView< Primitive::ObjectType > types = primitives.GetTypes();
+    for( PrimitiveHandle handle = 0; handle < primitives.Size(); ++handle )
+    {
+        if( !IsBounded( types[ handle ] ) ) m_primitives.push_back( handle );
+    }
+}
+
+int UnboundedList::IntersectRays(
+    const Ray* rays,
+    int rayCount,
+    const std::vector< Primitive* >& primitives,
+    ArrayView< PrimitiveTransform > transforms,
+    RayHit* hits,
+    Collisions::RayQueryMode mode
+    ) const
+{
+    if( m_primitives.empty() ) return 0;
+
+    return Collisions::IntersectRays( rays, rayCount, primitives, transforms, m_primitives.data(), Size(), hits, mode );
+}
@@ -0,0 +1,122 @@
+#include "accell/WideBVH.h"
+
+template< int N >
+void WideBVH< N >::Collapse( const BVH& bvh )
+{
+    const std::vector< BVHNode >& nodes = bvh.GetNodes();
+
+    m_nodes.clear();
+    m_references = bvh.GetReferences();
+    m_unbounded = bvh.GetUnbounded();
+    m_stats = WideBVHStats();
+
+    // An empty tree is a single empty root
+    if( nodes.empty() || Bounds( nodes[ 0 ].Min, nodes[ 0 ].Max ).Empty() ) return;
+
+    collapseNode( nodes, 0 );
+
+    int children = 0;
+    for( const WideBVHNode< N >& node : m_nodes ) children += node.ChildCount;
+    m_stats.Nodes = int( m_nodes.size() );
+    m_stats.ChildrenPerNode = float( children ) / float( m_stats.Nodes );
+}
+
+template< int N >
+int WideBVH< N >::collapseNode( const std::vector< BVHNode >& nodes, int index )
+{
+    // Gather the binary subtree's top into N children, opening the largest branch each time
+    int children[ N ];
+    int childCount = 0;
+
+    if( nodes[ index ].IsLeaf() )
+    {
+        children[ childCount++ ] = index;
+    }
+    else
+    {
+        children[ childCount++ ] = index + 1;
+        children[ childCount++ ] = nodes[ index ].Offset;
+    }
+
+    while( childCount < N )
+    {
+        int largest = -1;
+        float largestArea = -1.0f;
+        for( int i = 0; i < childCount; ++i )
+        {
+            const BVHNode& child = nodes[ children[ i ] ];
+            if( child.IsLeaf() ) continue;
+
+            float area = Bounds( child.Min, child.Max ).SurfaceArea();
+            if( area > largestArea )
+            {
+                largest = i;
+                largestArea = area;
+            }
+        }
+        if( largest < 0 ) break;
+
+        int opened = children[ largest ];
+        children[ largest ] = opened + 1;
+        children[ childCount++ ] = nodes[ opened ].Offset;
+    }
+
+    int wideIndex = int( m_nodes.size() );
+    m_nodes.emplace_back();
+
+    for( int i = 0; i < N; ++i )
+    {
+        // Unused lanes get empty bounds, they are masked out by ChildCount anyway
+        Bounds bounds;
+        int offset = 0;
+        int count = 0;
+
+        if( i < childCount )
+        {
+            const BVHNode& child = nodes[ children[ i ] ];
+            bounds = Bounds( child.Min, child.Max );
+
+            if( child.IsLeaf() )
+            {
+                offset = child.Offset;
+                count = child.Count;
+                m_stats.Leaves++;
+            }
+            else
+            {
+                offset = collapseNode( nodes, children[ i ] );
+            }
+        }
+
+        // Recursing may have grown the vector, so look the node up again
+        WideBVHNode< N >& node = m_nodes[ wideIndex ];
+        node.MinX[ i ] = bounds.Min.x;
+        node.MinY[ i ] = bounds.Min.y;
+        node.MinZ[ i ] = bounds.Min.z;
+        node.MaxX[ i ] = bounds.Max.x;
+        node.MaxY[ i ] = bounds.Max.y;
+        node.MaxZ[ i ] = bounds.Max.z;
+        node.Offset[ i ] = offset;
+        node.Count[ i ] = count;
+    }
+
+    m_nodes[ wideIndex ].ChildCount = childCount;
+
+    return wideIndex;
+}
+
+template< int N >
+int WideBVH< N >::IntersectRays(
+    const Ray* rays,
+    int rayCount,
+    const std::vector< Primitive* >& primitives,
+    ArrayView< PrimitiveTransform > transforms,
+    RayHit* hits,
+    Collisions::RayQueryMode mode
+    ) const
+{
+    return IntersectStructureRays( *this, rays, rayCount, primitives, transforms, hits, mode );
+}
+
+template class WideBVH< 4 >;
+template class WideBVH< 8 >;
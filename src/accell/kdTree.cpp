@@ -1,139 +1,263 @@
 #include "accell/kdTree.h"
 //#define DEBUG
 
-#include <queue>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
 
-const int MAX_OBJECTS_PER_LEAF = 1;
+// SAH cost model, relative costs of one traversal step and one primitive test
+const float KD_TRAVERSAL_COST = 1.0f;
+const float KD_INTERSECT_COST = 1.5f;
+// Splits that leave one side empty are discounted to favour cutting off empty space
+const float KD_EMPTY_BONUS = 0.8f;
+// Split candidates per axis
+const int KD_SAH_BINS = 32;
 
-kdTree::kdTree( std::vector<Primitive*> primitives )
+kdTree::kdTree( const PrimitiveStore& primitives )
 {
     BuildTree( primitives );
-    true;
 }
 
-kdTree::~kdTree()
-{
-    delete m_rootNode;
-}
-
-void kdTree::BuildTree( std::vector<Primitive*> primitives )
+void kdTree::BuildTree( const PrimitiveStore& primitives )
 {
+    m_nodes.clear();
+    m_refs.clear();
     m_leafObjectsVector.clear();
+    m_stats = kdTreeStats();
 #ifdef DEBUG
     std::cout << "Beginning kD Tree Build" << std::endl << std::endl;
 #endif
-    m_rootNode = BuildNode( primitives, 0 );
+    // Unbounded primitives ( planes ) are listed apart, the tree bounds everything else
+    m_unbounded.Build( primitives );
+    m_bounds = ComputeSceneBounds( primitives );
+    m_splitQuantum = m_bounds.Extent() / float( KD_SPLIT_STEPS );
+
+    for( int i = 0; i < primitives.Size(); ++i )
+    {
+        if( !IsBounded( primitives.GetTypes()[ i ] ) ) continue;
+
+        BuildRef ref;
+        ref.Handle = i;
+        ref.Box = ComputePrimitiveBounds( primitives, i ).Intersection( m_bounds );
+        if( !ref.Box.Empty() ) m_refs.push_back( ref );
+    }
+
+    // Havran's depth limit, bounded by the GPU stack
+    m_maxDepth = int( 8.0f + 1.3f * std::log2( float( std::max( 1, primitives.Size() ) ) ) );
+    m_maxDepth = std::min( m_maxDepth, KD_MAX_DEPTH );
+
+    buildNode( primitives, 0, int( m_refs.size() ), m_bounds, 0 );
 #ifdef DEBUG
+    // The root's references are all that's left on the stack, each should have reached a leaf
+    std::vector< bool > inLeaf( primitives.Size(), false );
+    for( int handle : m_leafObjectsVector )
+    {
+        if( handle >= 0 ) inLeaf[ handle ] = true;
+    }
+    for( const BuildRef& ref : m_refs )
+    {
+        if( !inLeaf[ ref.Handle ] ) std::cout << "kD Tree: primitive " << ref.Handle << " is in no leaf" << std::endl;
+    }
+
     std::cout << "Constructing Tree Vector" << std::endl << std::endl;
 #endif
     constructTreeVector();
 }
 
-kdNode* kdTree::BuildNode( std::vector<Primitive*> primitives, int depth )
+int kdTree::buildNode( const PrimitiveStore& primitives, int first, int last, const Bounds& nodeBounds, int depth )
 {
-    if( primitives.size() == 0 ) return constructLeafNode( primitives );
-
-    bool samePos = true;
-    Primitive* prevObject = primitives[ 0 ];
-    for( int i = 0; i < primitives.size(); ++i )
-    {
-        if( primitives[ i ]->Position != prevObject->Position )
-        {
-            samePos = false;
-            break;
-        }
-    }
+    int axis = 0;
+    float splitPos = 0.0f;
+    float splitCost = 0.0f;
+    float leafCost = KD_INTERSECT_COST * ( last - first );
 
-    if( primitives.size() > MAX_OBJECTS_PER_LEAF && !samePos )
+    if( last > first && depth < m_maxDepth &&
+        findSplit( first, last, nodeBounds, axis, splitPos, splitCost ) && splitCost < leafCost )
     {
-        int axis = depth % 3;
-
-        float splitPos = 0;
-        for( int i = 0; i < primitives.size(); ++i )
-        {
-            splitPos += primitives[ i ]->Position[ axis ];
-        }
-        splitPos /= primitives.size();
-
-        return constructBranchNode( primitives, axis, splitPos, depth );
+        return constructBranchNode( primitives, first, last, nodeBounds, axis, splitPos, depth );
     }
     else
     {
-        return constructLeafNode( primitives );
+        return constructLeafNode( first, last, nodeBounds, depth );
     }
 }
 
-kdNode* kdTree::constructBranchNode( std::vector<Primitive*> primitives, int axis, float splitPos, int depth )
+// Evaluates KD_SAH_BINS - 1 evenly spaced planes per axis in O( N + bins ),
+// counting each reference into the bins holding its min and max
+bool kdTree::findSplit( int first, int last, const Bounds& nodeBounds, int& axis, float& splitPos, float& cost ) const
 {
-    std::vector<Primitive*> leftObjects;
-    std::vector<Primitive*> rightObjects;
-    for( int i = 0; i < primitives.size(); ++i )
+    float nodeArea = nodeBounds.SurfaceArea();
+    if( nodeArea <= 0.0f ) return false;
+
+    glm::vec3 extent = nodeBounds.Extent();
+    bool found = false;
+
+    for( int a = 0; a < 3; ++a )
     {
-        if( primitives[ i ]->Position[ axis ] < splitPos )
+        if( extent[ a ] <= 0.0f ) continue;
+
+        int minBins[ KD_SAH_BINS ] = { 0 };
+        int maxBins[ KD_SAH_BINS ] = { 0 };
+        float binScale = KD_SAH_BINS / extent[ a ];
+
+        for( int i = first; i < last; ++i )
         {
-            leftObjects.push_back( primitives[ i ] );
+            int b0 = glm::clamp( int( ( m_refs[ i ].Box.Min[ a ] - nodeBounds.Min[ a ] ) * binScale ), 0, KD_SAH_BINS - 1 );
+            int b1 = glm::clamp( int( ( m_refs[ i ].Box.Max[ a ] - nodeBounds.Min[ a ] ) * binScale ), 0, KD_SAH_BINS - 1 );
+            minBins[ b0 ]++;
+            maxBins[ b1 ]++;
         }
-        else
+
+        // Sweep the planes between bins, a reference is left of plane p if it starts in a bin
+        // below p, and right of it unless it also ends in a bin below p
+        int leftCount = 0;
+        int endedCount = 0;
+        for( int p = 1; p < KD_SAH_BINS; ++p )
         {
-            rightObjects.push_back( primitives[ i ] );
+            leftCount += minBins[ p - 1 ];
+            endedCount += maxBins[ p - 1 ];
+            int rightCount = ( last - first ) - endedCount;
+
+            float pos = snapSplit( a, nodeBounds.Min[ a ] + extent[ a ] * p / KD_SAH_BINS );
+            if( pos <= nodeBounds.Min[ a ] || pos >= nodeBounds.Max[ a ] ) continue;
+
+            Bounds left = nodeBounds;
+            left.Max[ a ] = pos;
+            Bounds right = nodeBounds;
+            right.Min[ a ] = pos;
+
+            float c = KD_TRAVERSAL_COST + KD_INTERSECT_COST *
+                      ( left.SurfaceArea() * leftCount + right.SurfaceArea() * rightCount ) / nodeArea;
+            if( leftCount == 0 || rightCount == 0 ) c *= KD_EMPTY_BONUS;
+
+            if( !found || c < cost )
+            {
+                found = true;
+                cost = c;
+                axis = a;
+                splitPos = pos;
+            }
         }
     }
 
-    kdNode* node = new kdNode();
-    node->Value = glm::vec4( 0.0f, axis, splitPos, -1.0f );
+    return found;
+}
+
+int kdTree::constructBranchNode( const PrimitiveStore& primitives, int first, int last, const Bounds& nodeBounds, int axis, float splitPos, int depth )
+{
+    Bounds leftBounds = nodeBounds;
+    leftBounds.Max[ axis ] = splitPos;
+    Bounds rightBounds = nodeBounds;
+    rightBounds.Min[ axis ] = splitPos;
+
+    int index = int( m_nodes.size() );
+    kdNode node;
+    node.InitBranch( axis, splitPos );
+    m_nodes.push_back( node );
+
+    m_stats.Nodes++;
+    m_stats.SAHCost += KD_TRAVERSAL_COST * nodeBounds.SurfaceArea() / m_bounds.SurfaceArea();
 
 #ifdef DEBUG
     std::cout << "Branch Node" << std::endl;
     std::cout << "\tDepth: " << depth << std::endl;
     std::cout << "\tAxis: " << axis << std::endl;
-    std::cout << "\tValue: " << node->Value[0] << ", " << node->Value[1] << std::endl << std::endl;
+    std::cout << "\tValue: " << splitPos << std::endl << std::endl;
 #endif
 
-    node->LeftChild = BuildNode( leftObjects, depth + 1 );
-    node->RightChild = BuildNode( rightObjects, depth + 1 );
+    // Each child's references are pushed above this node's range just before it's built and popped after,
+    // so a child's own subtree only ever grows the stack above its range.
+    // A reference goes to a child only if the primitive's surface passes through it, not just its bounds.
+    // m_refs may reallocate while growing, so references are copied out by index
+    for( int i = first; i < last; ++i )
+    {
+        BuildRef ref = m_refs[ i ];
+        if( ( ref.Box.Min[ axis ] < splitPos || ref.Box.Max[ axis ] <= splitPos ) &&
+            PrimitiveOverlapsBox( primitives, ref.Handle, leftBounds ) )
+        {
+            // Flat references lying on the plane go left
+            ref.Box.Max[ axis ] = glm::min( ref.Box.Max[ axis ], splitPos );
+            m_refs.push_back( ref );
+        }
+    }
+    int leftLast = int( m_refs.size() );
+
+    // Left child lands directly after this node
+    buildNode( primitives, last, leftLast, leftBounds, depth + 1 );
+    m_refs.resize( last );
+
+    for( int i = first; i < last; ++i )
+    {
+        BuildRef ref = m_refs[ i ];
+        if( ref.Box.Max[ axis ] > splitPos && PrimitiveOverlapsBox( primitives, ref.Handle, rightBounds ) )
+        {
+            ref.Box.Min[ axis ] = glm::max( ref.Box.Min[ axis ], splitPos );
+            m_refs.push_back( ref );
+        }
+    }
+    int rightLast = int( m_refs.size() );
 
-    return node;
+    int rightChild = buildNode( primitives, last, rightLast, rightBounds, depth + 1 );
+    m_nodes[ index ].SetRightChild( rightChild );
+    m_refs.resize( last );
+
+    return index;
 }
 
-kdNode* kdTree::constructLeafNode( std::vector<Primitive*> primitives )
+int kdTree::constructLeafNode( int first, int last, const Bounds& nodeBounds, int depth )
 {
-    kdNode* node = new kdNode();
-    node->Value = glm::vec4( 1.0f, m_leafObjectsVector.size(), -1.0f, -1.0f );
+    int index = int( m_nodes.size() );
+    kdNode node;
+    node.InitLeaf( int( m_leafObjectsVector.size() ), last - first );
+    m_nodes.push_back( node );
 
-    for( int i = 0; i < primitives.size(); ++i )
+    for( int i = first; i < last; ++i )
     {
-        m_leafObjectsVector.push_back( primitives[ i ]->ID );
+        m_leafObjectsVector.push_back( m_refs[ i ].Handle );
     }
 
     m_leafObjectsVector.push_back( -1 );
 
+    m_stats.Nodes++;
+    m_stats.Leaves++;
+    if( last == first ) m_stats.EmptyLeaves++;
+    m_stats.MaxDepth = std::max( m_stats.MaxDepth, depth );
+    m_stats.LeafReferences += last - first;
+    m_stats.SAHCost += KD_INTERSECT_COST * ( last - first ) * nodeBounds.SurfaceArea() / m_bounds.SurfaceArea();
+
 #ifdef DEBUG
     std::cout << "Leaf Node" << std::endl;
-    std::cout << "\tValue: " << node->Value[0] << ", " << node->Value[1] << std::endl << std::endl;
+    std::cout << "\tValue: " << node.LeafObjects << ", " << node.ReferenceCount() << std::endl << std::endl;
 #endif
 
-    return node;
+    return index;
 }
 
-void kdTree::constructTreeVector()
+// Rounds a split position to the nearest step of the tree's split lattice
+float kdTree::snapSplit( int axis, float splitPos ) const
 {
-    m_treeVector.clear();
-
-    std::queue< kdNode* > nodeQueue;
+    float step = std::round( ( splitPos - m_bounds.Min[ axis ] ) / m_splitQuantum[ axis ] );
+    return m_bounds.Min[ axis ] + step * m_splitQuantum[ axis ];
+}
 
-    nodeQueue.push( m_rootNode );
+// Packs the nodes into the GPU layout, which keeps the depth first order and flags
+void kdTree::constructTreeVector()
+{
+    m_treeVector.resize( m_nodes.size() );
 
-    while( !nodeQueue.empty() )
+    for( int i = 0; i < int( m_nodes.size() ); ++i )
     {
-        kdNode* node = nodeQueue.front();
-        nodeQueue.pop();
+        const kdNode& node = m_nodes[ i ];
 
-#ifdef DEBUG
-        std::cout << "Value: " << node->Value[0] << ", " << node->Value[1] << std::endl << std::endl;
-#endif
-        m_treeVector.push_back( node->Value );
-
-        if( node->LeftChild != NULL ) nodeQueue.push( node->LeftChild );
-        if( node->RightChild != NULL ) nodeQueue.push( node->RightChild );
+        if( node.IsLeaf() )
+        {
+            m_treeVector[ i ] = glm::ivec2( node.LeafObjects, int( node.Flags ) );
+        }
+        else
+        {
+            int axis = node.Axis();
+            int step = int( std::round( ( node.Split - m_bounds.Min[ axis ] ) / m_splitQuantum[ axis ] ) );
+            m_treeVector[ i ] = glm::ivec2( step, int( node.Flags ) );
+        }
     }
 }